@@ -0,0 +1,131 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "workload.h"
+
+
+struct BenchConfig {
+    WorkloadConfig workload;
+    int repeat = 3;
+    std::string filter;                     // run only cases whose name contains this
+    std::string scratchDir = "/tmp";        // where file-backed cases write
+    size_t ledgerRows = 10000000;           // rows in the statement cases' ledger
+};
+
+
+struct BenchResult {
+    std::string name;
+    uint64_t ops = 0;
+    uint64_t bytes = 0;                     // when set, mb_per_sec is reported
+    double seconds = 0.0;
+    // Case-specific figures (p99_us, mb_per_sec, ...) emitted verbatim.
+    std::vector<std::pair<std::string, double>> extra;
+};
+
+
+// Start/stop pair handed to each case so setup stays out of the timing.
+class BenchClock {
+public:
+    void start() { begin = std::chrono::steady_clock::now(); }
+    void stop() { elapsed += std::chrono::steady_clock::now() - begin; }
+    double seconds() const { return std::chrono::duration<double>(elapsed).count(); }
+
+    // Bytes processed inside the measured region, for throughput cases.
+    void addBytes(uint64_t n) { processed += n; }
+    uint64_t bytes() const { return processed; }
+
+private:
+    uint64_t processed = 0;
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::duration elapsed{};
+};
+
+
+// Swallows std::cout and std::cerr while a case runs code that prints per
+// operation (status lines, minor-limit warnings).
+class OutputSilencer {
+public:
+    OutputSilencer() : savedOut(std::cout.rdbuf(&sink)), savedErr(std::cerr.rdbuf(&sink)) {}
+    ~OutputSilencer() {
+        std::cout.rdbuf(savedOut);
+        std::cerr.rdbuf(savedErr);
+    }
+
+private:
+    struct NullBuffer : std::streambuf {
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    } sink;
+    std::streambuf* savedOut;
+    std::streambuf* savedErr;
+};
+
+
+class BenchRunner {
+public:
+    explicit BenchRunner(const BenchConfig &cfg) : cfg(cfg) {}
+
+    const BenchConfig& config() const { return cfg; }
+
+    bool enabled(const std::string &name) const {
+        return cfg.filter.empty() || name.find(cfg.filter) != std::string::npos;
+    }
+
+    // Runs `body` cfg.repeat times and keeps the median run. The body
+    // brackets its measured region with clock.start()/stop() and returns
+    // the number of operations it performed.
+    template <typename Body>
+    void run(const std::string &name, Body body) {
+        if (!enabled(name)) return;
+        std::vector<BenchResult> runs;
+        for (int r = 0; r < std::max(1, cfg.repeat); r++) {
+            BenchClock clock;
+            BenchResult res;
+            res.name = name;
+            res.ops = body(clock);
+            res.seconds = clock.seconds();
+            res.bytes = clock.bytes();
+            runs.push_back(res);
+        }
+        std::sort(runs.begin(), runs.end(),
+                  [](const BenchResult &a, const BenchResult &b) { return a.seconds < b.seconds; });
+        add(runs[runs.size() / 2]);
+    }
+
+    // For cases that measure something other than a single timed loop.
+    void add(const BenchResult &res) {
+        std::cerr << "  " << res.name << ": " << res.ops << " ops in "
+                  << res.seconds * 1e3 << " ms\n";
+        results.push_back(res);
+    }
+
+    void writeJson(std::ostream &out) const;
+
+private:
+    BenchConfig cfg;
+    std::vector<BenchResult> results;
+};
+
+
+// Suites, one per bench_*.cpp file.
+void benchBanking(BenchRunner &runner);
+void benchReplay(BenchRunner &runner);
+void benchGroupCommit(BenchRunner &runner);
+void benchServer(BenchRunner &runner);
+void benchStatement(BenchRunner &runner);
+void benchReads(BenchRunner &runner);
+void benchSegment(BenchRunner &runner);
+void benchTier(BenchRunner &runner);
+void benchStartup(BenchRunner &runner);
+void benchNetting(BenchRunner &runner);
+void benchReplication(BenchRunner &runner);
+void benchPartition(BenchRunner &runner);
+
+#endif // BENCH_H
@@ -0,0 +1,277 @@
+#include "bench.h"
+#include "banking.h"
+#include "ledger.h"
+#include "metrics.h"
+#include "queue.h"
+#include "stack.h"
+#include "TransactionList.h"
+#include <cstdio>
+
+
+static void populate(Banking &bank, const std::vector<Account> &accounts) {
+    for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+}
+
+
+static std::vector<LedgerEntry> makeLedger(size_t rows) {
+    std::vector<LedgerEntry> ledger;
+    ledger.reserve(rows);
+    double balance = 0.0;
+    for (size_t i = 0; i < rows; i++) {
+        bool deposit = (i % 3) != 2 || balance < 50.0;
+        double amount = 10.0 + static_cast<double>(i % 97);
+        balance += deposit ? amount : -amount;
+        ledger.push_back({deposit ? "Deposit" : "Withdraw", amount, balance, "2025-01-01 12:00:00"});
+    }
+    return ledger;
+}
+
+
+static void benchAccounts(BenchRunner &runner, const std::vector<Account> &accounts,
+                          const std::vector<Transaction> &txns) {
+    runner.run("banking/account_lookup", [&](BenchClock &clock) {
+        Banking bank;
+        populate(bank, accounts);
+        size_t found = 0;
+        clock.start();
+        for (const auto &t : txns) found += bank.getAccount(t.accNo) != nullptr;
+        clock.stop();
+        return static_cast<uint64_t>(txns.size() + (found == 0));
+    });
+
+    runner.run("banking/deposit", [&](BenchClock &clock) {
+        Banking bank;
+        populate(bank, accounts);
+        OutputSilencer quiet;
+        clock.start();
+        for (const auto &t : txns) bank.deposit(t.accNo, t.amount);
+        clock.stop();
+        return static_cast<uint64_t>(txns.size());
+    });
+
+    runner.run("banking/withdraw", [&](BenchClock &clock) {
+        Banking bank;
+        populate(bank, accounts);
+        OutputSilencer quiet;
+        clock.start();
+        for (const auto &t : txns) bank.withdraw(t.accNo, 1.0);
+        clock.stop();
+        return static_cast<uint64_t>(txns.size());
+    });
+
+    runner.run("banking/transfer", [&](BenchClock &clock) {
+        Banking bank;
+        populate(bank, accounts);
+        OutputSilencer quiet;
+        uint64_t ops = 0;
+        clock.start();
+        for (const auto &t : txns) {
+            if (t.type != TRANSFER) continue;
+            bank.transfer(t.accNo, t.targetAcc, t.amount);
+            ops++;
+        }
+        clock.stop();
+        return ops;
+    });
+
+    // The end-to-end batch path used by "BankingTransactionManager batch".
+    runner.run("banking/batch_process", [&](BenchClock &clock) {
+        Banking bank;
+        populate(bank, accounts);
+        OutputSilencer quiet;
+        clock.start();
+        for (const auto &t : txns) bank.enqueueTransaction(t);
+        bank.processAllTransactions();
+        clock.stop();
+        return static_cast<uint64_t>(txns.size());
+    });
+}
+
+
+static void benchContainers(BenchRunner &runner, const std::vector<Transaction> &txns) {
+    runner.run("queue/enqueue_dequeue", [&](BenchClock &clock) {
+        Queue<Transaction> q;
+        double sum = 0.0;
+        clock.start();
+        for (const auto &t : txns) q.enqueue(t);
+        while (!q.isEmpty()) sum += q.dequeue().amount;
+        clock.stop();
+        return static_cast<uint64_t>(txns.size() + (sum < 0));
+    });
+
+    runner.run("stack/push_pop", [&](BenchClock &clock) {
+        Stack<Transaction> s;
+        double sum = 0.0;
+        clock.start();
+        for (const auto &t : txns) s.push(t);
+        while (!s.isEmpty()) sum += s.pop().amount;
+        clock.stop();
+        return static_cast<uint64_t>(txns.size() + (sum < 0));
+    });
+}
+
+
+static void benchLedger(BenchRunner &runner) {
+    const std::string user = runner.config().scratchDir + "/bench_ledger";
+    const std::string path = user + "_transactions.txt";
+    const size_t rows = std::min<size_t>(runner.config().workload.transactions, 100000);
+    const auto ledger = makeLedger(rows);
+
+    runner.run("ledger/save", [&](BenchClock &clock) {
+        clock.start();
+        saveTransactionsToFile(user, ledger);
+        clock.stop();
+        return static_cast<uint64_t>(rows);
+    });
+
+    runner.run("ledger/load", [&](BenchClock &clock) {
+        saveTransactionsToFile(user, ledger);
+        clock.start();
+        auto loaded = loadTransactionsFromFile(user);
+        clock.stop();
+        return static_cast<uint64_t>(loaded.size());
+    });
+
+    // One CLI "deposit": load the whole history, append a row, rewrite it.
+    runner.run("ledger/cli_append_1k_rows", [&](BenchClock &clock) {
+        saveTransactionsToFile(user, makeLedger(1000));
+        const uint64_t appends = 50;
+        clock.start();
+        for (uint64_t i = 0; i < appends; i++) {
+            auto txns = loadTransactionsFromFile(user);
+            double balance = getBalance(txns) + 25.0;
+            txns.push_back({"Deposit", 25.0, balance, currentDateTime()});
+            saveTransactionsToFile(user, txns);
+        }
+        clock.stop();
+        return appends;
+    });
+
+    runner.run("statement/print_mini_statement", [&](BenchClock &clock) {
+        OutputSilencer quiet;
+        const uint64_t renders = 20000;
+        clock.start();
+        for (uint64_t i = 0; i < renders; i++) printMiniStatement(ledger);
+        clock.stop();
+        return renders;
+    });
+
+    runner.run("statement/transaction_list_last5", [&](BenchClock &clock) {
+        OutputSilencer quiet;
+        const uint64_t renders = 20000;
+        clock.start();
+        for (uint64_t i = 0; i < renders; i++) TransactionList::displayMiniStatement(ledger, 5);
+        clock.stop();
+        return renders;
+    });
+
+    std::remove(path.c_str());
+}
+
+
+static void benchLimits(BenchRunner &runner, const std::vector<Account> &accounts,
+                        const std::vector<Transaction> &txns) {
+    runner.run("limits/can_perform", [&](BenchClock &clock) {
+        Banking bank;
+        populate(bank, accounts);
+        size_t allowed = 0;
+        clock.start();
+        for (const auto &t : txns) allowed += bank.canPerformTransaction(t.accNo);
+        clock.stop();
+        return static_cast<uint64_t>(txns.size() + (allowed == 0));
+    });
+
+    // Every account is a minor, so most deposits run into the 20/day cap.
+    runner.run("limits/minor_deposit", [&](BenchClock &clock) {
+        std::vector<Account> minors = accounts;
+        for (auto &a : minors) a.age = 16;
+        Banking bank;
+        populate(bank, minors);
+        OutputSilencer quiet;
+        const size_t n = std::min<size_t>(txns.size(), 50000);
+        clock.start();
+        for (size_t i = 0; i < n; i++) bank.deposit(txns[i].accNo, txns[i].amount);
+        clock.stop();
+        return static_cast<uint64_t>(n);
+    });
+}
+
+
+// "Deposited this month" for every account: one lookup each against the
+// maintained aggregates, versus rescanning the history per account.
+static void benchAggregates(BenchRunner &runner, const std::vector<Account> &accounts,
+                            const std::vector<Transaction> &txns) {
+    const char* names[] = {"aggregates/month_deposits_lookup", "aggregates/month_deposits_scan"};
+    if (!runner.enabled(names[0]) && !runner.enabled(names[1])) return;
+
+    Banking bank;
+    populate(bank, accounts);
+    {
+        OutputSilencer quiet;
+        for (const auto &t : txns) bank.applyTransaction(t, false);
+    }
+    const std::time_t now = std::time(nullptr);
+    const int64_t month = AccountAggregates::monthKey(now);
+    const size_t queries = std::min<size_t>(accounts.size(), 1000);
+
+    double sink = 0.0;
+    runner.run(names[0], [&](BenchClock &clock) {
+        clock.start();
+        for (size_t i = 0; i < queries; i++) {
+            const AccountAggregates* agg = bank.getAggregates(accounts[i].accNo);
+            if (agg) sink += agg->inMonth(month, AGG_DEPOSIT).sum;
+        }
+        clock.stop();
+        return static_cast<uint64_t>(queries);
+    });
+
+    runner.run(names[1], [&](BenchClock &clock) {
+        clock.start();
+        for (size_t i = 0; i < queries; i++) {
+            double total = 0.0;
+            for (const auto &t : txns) {
+                if (t.type == DEPOSIT && t.accNo == accounts[i].accNo &&
+                    AccountAggregates::monthKey(t.timestamp) == month) total += t.amount;
+            }
+            sink += total;
+        }
+        clock.stop();
+        return static_cast<uint64_t>(queries);
+    });
+    if (sink < 0) std::cerr << sink;   // keep the loops from being optimized away
+}
+
+
+// What one probe adds to an operation. batch_process runs two sampled
+// scopes per transaction (process_next and the deposit, withdrawal or
+// transfer); file I/O and fsync use timed ones. The ScopedTimer is built
+// directly, so METRICS=0 builds report the same figures.
+static void benchProbes(BenchRunner &runner, size_t n) {
+    runner.run("metrics/timed_scope", [&](BenchClock &clock) {
+        clock.start();
+        for (size_t i = 0; i < n; i++) ScopedTimer timer(MetricOp::Deposit);
+        clock.stop();
+        return static_cast<uint64_t>(n);
+    });
+
+    runner.run("metrics/sampled_scope", [&](BenchClock &clock) {
+        clock.start();
+        for (size_t i = 0; i < n; i++) ScopedTimer timer(MetricOp::Deposit, true);
+        clock.stop();
+        return static_cast<uint64_t>(n);
+    });
+    Metrics::reset();
+}
+
+
+void benchBanking(BenchRunner &runner) {
+    const auto accounts = generateAccounts(runner.config().workload);
+    const auto txns = generateTransactions(runner.config().workload);
+
+    benchAccounts(runner, accounts, txns);
+    benchContainers(runner, txns);
+    benchLedger(runner);
+    benchLimits(runner, accounts, txns);
+    benchAggregates(runner, accounts, txns);
+    benchProbes(runner, txns.size());
+}
@@ -0,0 +1,94 @@
+#include "bench.h"
+#include "banking.h"
+#include "group_commit.h"
+#include <cstdio>
+#include <thread>
+
+
+static uint64_t percentileNs(std::vector<uint64_t> &samples, double q) {
+    if (samples.empty()) return 0;
+    size_t idx = static_cast<size_t>(q * static_cast<double>(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(idx), samples.end());
+    return samples[idx];
+}
+
+
+// Closed-loop clients: each thread submits one request, waits for its
+// acknowledgement and submits the next, so latency includes the window.
+static void groupCommitCase(BenchRunner &runner, const std::string &name,
+                            std::chrono::microseconds window, size_t maxBatch,
+                            const std::vector<Account> &accounts,
+                            const std::vector<Transaction> &txns) {
+    if (!runner.enabled(name)) return;
+
+    const unsigned clients = 16;
+    const size_t perClient = std::max<size_t>(1, std::min<size_t>(txns.size(), 32000) / clients);
+    const std::string walPath = runner.config().scratchDir + "/bench_group_commit.wal";
+
+    Banking bank;
+    for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+    std::remove(walPath.c_str());
+
+    GroupCommitOptions opts;
+    opts.maxWait = window;
+    opts.maxBatch = maxBatch;
+    opts.walPath = walPath;
+    opts.checkLimits = false;
+    GroupCommitter committer(bank, opts);
+    if (!committer.start()) {
+        std::cerr << name << ": " << committer.lastError() << "\n";
+        return;
+    }
+
+    std::vector<std::vector<uint64_t>> latencies(clients);
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < clients; c++) {
+        threads.emplace_back([&, c]() {
+            latencies[c].reserve(perClient);
+            for (size_t i = 0; i < perClient; i++) {
+                const Transaction &t = txns[(c * perClient + i) % txns.size()];
+                auto sent = std::chrono::steady_clock::now();
+                committer.submit(Transaction(DEPOSIT, t.accNo, 0, t.amount)).get();
+                latencies[c].push_back(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - sent).count()));
+            }
+        });
+    }
+    for (auto &t : threads) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    committer.stop();
+    std::remove(walPath.c_str());
+
+    std::vector<uint64_t> all;
+    for (auto &l : latencies) all.insert(all.end(), l.begin(), l.end());
+    GroupCommitStats stats = committer.stats();
+
+    BenchResult res;
+    res.name = name;
+    res.ops = all.size();
+    res.seconds = seconds;
+    res.extra.push_back({"window_us", static_cast<double>(window.count())});
+    res.extra.push_back({"max_batch", static_cast<double>(maxBatch)});
+    res.extra.push_back({"clients", static_cast<double>(clients)});
+    res.extra.push_back({"avg_batch", stats.batches ? static_cast<double>(stats.records) / stats.batches : 0.0});
+    res.extra.push_back({"p50_us", percentileNs(all, 0.50) / 1e3});
+    res.extra.push_back({"p99_us", percentileNs(all, 0.99) / 1e3});
+    runner.add(res);
+}
+
+
+void benchGroupCommit(BenchRunner &runner) {
+    WorkloadConfig w = runner.config().workload;
+    const auto accounts = generateAccounts(w);
+    const auto txns = generateTransactions(w);
+    if (txns.empty()) return;
+
+    // maxBatch 1 is the per-request fsync baseline.
+    groupCommitCase(runner, "group_commit/fsync_per_request", std::chrono::microseconds(0), 1, accounts, txns);
+    for (int us : {50, 200, 1000, 2000}) {
+        groupCommitCase(runner, "group_commit/window_" + std::to_string(us) + "us_batch_256",
+                        std::chrono::microseconds(us), 256, accounts, txns);
+    }
+}
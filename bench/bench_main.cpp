@@ -0,0 +1,147 @@
+#include "bench.h"
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+
+static std::string jsonEscape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+
+static std::string jsonNumber(double v) {
+    if (!std::isfinite(v)) return "null";
+    std::ostringstream ss;
+    ss << std::setprecision(10) << v;
+    return ss.str();
+}
+
+
+void BenchRunner::writeJson(std::ostream &out) const {
+    const WorkloadConfig &w = cfg.workload;
+    out << "{\n"
+        << "  \"suite\": \"banking\",\n"
+        << "  \"schema\": 1,\n"
+        << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+        << "  \"config\": {"
+        << "\"accounts\": " << w.accounts
+        << ", \"transactions\": " << w.transactions
+        << ", \"zipf_s\": " << jsonNumber(w.zipfS)
+        << ", \"seed\": " << w.seed
+        << ", \"repeat\": " << cfg.repeat << "},\n"
+        << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        double opsPerSec = r.seconds > 0 ? static_cast<double>(r.ops) / r.seconds : 0.0;
+        double nsPerOp = r.ops > 0 ? r.seconds * 1e9 / static_cast<double>(r.ops) : 0.0;
+        out << (i ? ",\n    " : "\n    ")
+            << "{\"name\": \"" << jsonEscape(r.name) << "\""
+            << ", \"ops\": " << r.ops
+            << ", \"seconds\": " << jsonNumber(r.seconds)
+            << ", \"ops_per_sec\": " << jsonNumber(opsPerSec)
+            << ", \"ns_per_op\": " << jsonNumber(nsPerOp);
+        if (r.bytes > 0 && r.seconds > 0)
+            out << ", \"bytes\": " << r.bytes
+                << ", \"mb_per_sec\": " << jsonNumber(r.bytes / r.seconds / (1024.0 * 1024.0));
+        for (const auto &kv : r.extra)
+            out << ", \"" << jsonEscape(kv.first) << "\": " << jsonNumber(kv.second);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  BankingBench [options] [--filter NAME] [--repeat N] [--out FILE]\n"
+              << "  BankingBench gen [options] --out-dir DIR\n"
+              << "Options:\n"
+              << "  --accounts N   number of accounts (default 10000)\n"
+              << "  --txns N       number of transactions (default 200000)\n"
+              << "  --zipf S       skew exponent, 0 = uniform (default 0.99)\n"
+              << "  --seed N       RNG seed (default 42)\n"
+              << "  --scratch DIR  directory for file-backed cases (default /tmp)\n"
+              << "  --ledger-rows N  rows in the statement ledger (default 10000000)\n";
+}
+
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    std::string outFile, outDir;
+    bool generateOnly = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage();
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "gen") generateOnly = true;
+        else if (arg == "--accounts") cfg.workload.accounts = std::stoul(value());
+        else if (arg == "--txns") cfg.workload.transactions = std::stoul(value());
+        else if (arg == "--zipf") cfg.workload.zipfS = std::stod(value());
+        else if (arg == "--seed") cfg.workload.seed = std::stoull(value());
+        else if (arg == "--repeat") cfg.repeat = std::stoi(value());
+        else if (arg == "--filter") cfg.filter = value();
+        else if (arg == "--scratch") cfg.scratchDir = value();
+        else if (arg == "--ledger-rows") cfg.ledgerRows = std::stoul(value());
+        else if (arg == "--out") outFile = value();
+        else if (arg == "--out-dir") outDir = value();
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (generateOnly) {
+        if (outDir.empty()) {
+            usage();
+            return 1;
+        }
+        auto accounts = generateAccounts(cfg.workload);
+        auto txns = generateTransactions(cfg.workload);
+        if (!writeAccountsFile(outDir + "/account.txt", accounts) ||
+            !writeTransactionsFile(outDir + "/transactions.txt", txns)) {
+            std::cerr << "Failed to write workload to " << outDir << "\n";
+            return 1;
+        }
+        std::cerr << "Wrote " << accounts.size() << " accounts and " << txns.size()
+                  << " transactions to " << outDir << "\n";
+        return 0;
+    }
+
+    BenchRunner runner(cfg);
+    benchBanking(runner);
+    benchReplay(runner);
+    benchGroupCommit(runner);
+    benchServer(runner);
+    benchStatement(runner);
+    benchReads(runner);
+    benchSegment(runner);
+    benchTier(runner);
+    benchStartup(runner);
+    benchNetting(runner);
+    benchReplication(runner);
+    benchPartition(runner);
+
+    if (outFile.empty()) {
+        runner.writeJson(std::cout);
+    } else {
+        std::ofstream out(outFile, std::ios::trunc);
+        runner.writeJson(out);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "bench.h"
+#include "banking.h"
+#include <cstdio>
+
+
+static const size_t NET_BATCH = 4096;
+
+
+// Queues the workload and drains it, one transaction at a time as the batch
+// command does, or a batch at a time through the netting stage. Both apply
+// the same transactions; "applied" is reported so the two can be compared.
+static void nettingCase(BenchRunner &runner, const std::string &name, const std::vector<Account> &accounts,
+                        const std::vector<Transaction> &txns, bool net) {
+    if (!runner.enabled(name)) return;
+    std::vector<BenchResult> runs;
+    for (int r = 0; r < std::max(1, runner.config().repeat); r++) {
+        Banking bank;
+        OutputSilencer quiet;
+        for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+        for (const auto &t : txns) bank.enqueueTransaction(t);
+
+        BenchClock clock;
+        uint64_t applied = 0;
+        clock.start();
+        if (net) {
+            NettedBatch batch;
+            while ((applied += bank.processNetted(batch, NET_BATCH), !batch.txns.empty())) {}
+        } else {
+            std::string msg;
+            for (size_t i = 0; i < txns.size(); i++) applied += bank.processNextTransaction(msg);
+        }
+        clock.stop();
+
+        BenchResult res;
+        res.name = name;
+        res.ops = txns.size();
+        res.seconds = clock.seconds();
+        res.extra.push_back({"applied", static_cast<double>(applied)});
+        runs.push_back(res);
+    }
+    std::sort(runs.begin(), runs.end(),
+              [](const BenchResult &a, const BenchResult &b) { return a.seconds < b.seconds; });
+    runner.add(runs[runs.size() / 2]);
+}
+
+
+void benchNetting(BenchRunner &runner) {
+    // Skew of the account choice: uniform, the default retail skew, and a
+    // settlement-style file dominated by a handful of accounts.
+    const struct { const char* suffix; double zipfS; } skews[] = {
+        {"uniform", 0.0}, {"zipf099", 0.99}, {"zipf150", 1.5},
+    };
+    for (const auto &skew : skews) {
+        const std::string serial = std::string("netting/serial_") + skew.suffix;
+        const std::string netted = std::string("netting/netted_") + skew.suffix;
+        if (!runner.enabled(serial) && !runner.enabled(netted)) continue;
+
+        WorkloadConfig w = runner.config().workload;
+        w.zipfS = skew.zipfS;
+        const auto accounts = generateAccounts(w);
+        const auto txns = generateTransactions(w);
+        nettingCase(runner, serial, accounts, txns, false);
+        nettingCase(runner, netted, accounts, txns, true);
+    }
+}
@@ -0,0 +1,211 @@
+#include "bench.h"
+#include "banking.h"
+#include "engine_server.h"
+#include "group_commit.h"
+#include "partition.h"
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+
+static const size_t MAX_PARTITION_REQUESTS = 200000;
+static const unsigned CLIENTS = 8;
+static const size_t PIPELINE = 32;
+
+
+// One engine as `serve` runs it: its own accounts, durable WAL and socket.
+struct BenchPartition {
+    Banking bank;
+    std::unique_ptr<GroupCommitter> committer;
+    std::unique_ptr<EngineServer> server;
+    std::thread loop;
+};
+
+
+// N partitions in one process, each with its own commit and epoll threads,
+// driven by CLIENTS routers that each keep PIPELINE requests in flight.
+// Transfers between accounts on different partitions run as sagas, so the
+// share of them grows as (N-1)/N. Ends with the conservation check: every
+// partition's balances plus open holds against the starting total moved
+// by the deposits and withdrawals that were accepted. The local_* cases
+// move every transfer's target onto the sender's partition first, which
+// leaves only the routing.
+static void partitionCase(BenchRunner &runner, const std::string &name, size_t partitions,
+                          const std::string &accountsFile, int64_t startCents,
+                          std::vector<WireRequest> requests, double &baseline, bool local, int firstAccNo) {
+    if (!runner.enabled(name)) return;
+    const std::string dir = runner.config().scratchDir;
+    const std::string prefix = dir + "/bench_partition_accounts";
+    const PartitionMap map = PartitionMap::hashed(partitions);
+    if (local) {
+        const int n = static_cast<int>(partitions);
+        for (WireRequest &r : requests) {
+            if (r.op != OP_TRANSFER) continue;
+            r.targetAcc -= ((r.targetAcc - r.accNo) % n + n) % n;
+            if (r.targetAcc < firstAccNo) r.targetAcc += n;
+        }
+    }
+    std::vector<PartitionTotals> split;
+    if (!splitAccountsFile(accountsFile, map, prefix, split)) {
+        std::cerr << name << ": cannot split " << accountsFile << "\n";
+        return;
+    }
+
+    std::vector<std::unique_ptr<BenchPartition>> parts;
+    std::vector<std::string> sockets;
+    bool started = true;
+    for (size_t p = 0; p < partitions && started; p++) {
+        const std::string id = std::to_string(p);
+        parts.emplace_back(new BenchPartition());
+        BenchPartition &part = *parts.back();
+        sockets.push_back(dir + "/bench_partition_" + id + ".sock");
+        {
+            OutputSilencer quiet;
+            started = part.bank.loadAccountsFromFile(prefix + "." + id);
+        }
+
+        GroupCommitOptions commitOpts;
+        commitOpts.maxWait = std::chrono::microseconds(200);
+        commitOpts.checkLimits = false;
+        commitOpts.walPath = dir + "/bench_partition_" + id + ".wal";
+        std::remove(commitOpts.walPath.c_str());
+        part.committer.reset(new GroupCommitter(part.bank, commitOpts));
+        ServerOptions serverOpts;
+        serverOpts.unixPath = sockets.back();
+        part.server.reset(new EngineServer(part.bank, part.committer.get(), serverOpts));
+        started = started && part.committer->start() && part.server->start();
+        if (started) part.loop = std::thread([&part]() { part.server->run(); });
+    }
+
+    const std::string logPath = dir + "/bench_partition.xlog";
+    std::remove(logPath.c_str());
+    TransferLog log;
+    PartitionRouter control(map, sockets, log);
+    if (!started || !log.open(logPath) || !control.recover()) {
+        std::cerr << name << ": partitions did not start " << control.lastError() << "\n";
+        started = false;
+    }
+
+    const size_t total = std::min(requests.size(), MAX_PARTITION_REQUESTS);
+    std::vector<uint64_t> done(CLIENTS, 0), cross(CLIENTS, 0), refunded(CLIENTS, 0);
+    std::vector<int64_t> movedCents(CLIENTS, 0);
+    double seconds = 0.0;
+    if (started) {
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for (unsigned c = 0; c < CLIENTS; c++) {
+            clients.emplace_back([&, c]() {
+                PartitionRouter router(map, sockets, log);
+                std::vector<WireRequest> batch;
+                std::vector<WireResponse> resps;
+                const size_t first = total * c / CLIENTS, last = total * (c + 1) / CLIENTS;
+                for (size_t i = first; i < last; i += PIPELINE) {
+                    batch.assign(requests.begin() + static_cast<std::ptrdiff_t>(i),
+                                 requests.begin() + static_cast<std::ptrdiff_t>(std::min(last, i + PIPELINE)));
+                    router.execute(batch, resps);
+                    for (size_t k = 0; k < batch.size(); k++) {
+                        if (resps[k].status != STATUS_OK) continue;
+                        int64_t cents = std::llround(batch[k].amount * 100.0);
+                        if (batch[k].op == OP_DEPOSIT) movedCents[c] += cents;
+                        else if (batch[k].op == OP_WITHDRAW) movedCents[c] -= cents;
+                    }
+                    done[c] += batch.size();
+                }
+                cross[c] = router.stats().crossTransfers;
+                refunded[c] = router.stats().refunded;
+            });
+        }
+        for (auto &t : clients) t.join();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    std::vector<PartitionTotals> after;
+    bool counted = started && control.totals(after);
+    for (auto &part : parts) {
+        if (part->loop.joinable()) {
+            part->server->stop();
+            part->loop.join();
+        }
+        if (part->committer) part->committer->stop();
+    }
+    for (size_t p = 0; p < partitions; p++) {
+        const std::string id = std::to_string(p);
+        for (const std::string &f : {prefix + "." + id, prefix + "." + id + ".agg", dir + "/bench_partition_" + id + ".wal"})
+            std::remove(f.c_str());
+    }
+    std::remove(logPath.c_str());
+    if (!counted) return;
+
+    int64_t expected = startCents;
+    for (int64_t m : movedCents) expected += m;
+    PartitionTotals sum = sumTotals(after);
+    int64_t drift = sum.balanceCents + sum.heldCents - expected;
+
+    BenchResult res;
+    res.name = name;
+    for (uint64_t d : done) res.ops += d;
+    res.seconds = seconds;
+    double rate = seconds > 0 ? static_cast<double>(res.ops) / seconds : 0.0;
+    if (partitions == 1) baseline = rate;
+    uint64_t crossTotal = 0, refundedTotal = 0;
+    for (unsigned c = 0; c < CLIENTS; c++) {
+        crossTotal += cross[c];
+        refundedTotal += refunded[c];
+    }
+    res.extra.push_back({"partitions", static_cast<double>(partitions)});
+    res.extra.push_back({"cross_transfers", static_cast<double>(crossTotal)});
+    res.extra.push_back({"refunded", static_cast<double>(refundedTotal)});
+    res.extra.push_back({"open_holds", static_cast<double>(sum.openHolds)});
+    res.extra.push_back({"conservation_drift_cents", static_cast<double>(drift)});
+    if (baseline > 0) res.extra.push_back({"speedup_vs_1", rate / baseline});
+    runner.add(res);
+    if (drift != 0) std::cerr << name << ": money not conserved, off by " << drift << " cents\n";
+}
+
+
+void benchPartition(BenchRunner &runner) {
+    const char* names[] = {
+        "partition/p1", "partition/p2", "partition/p4",
+        "partition/local_p1", "partition/local_p2", "partition/local_p4",
+    };
+    bool any = false;
+    for (const char* n : names) any = any || runner.enabled(n);
+    if (!any) return;
+
+    const WorkloadConfig &w = runner.config().workload;
+    const auto accounts = generateAccounts(w);
+    const auto txns = generateTransactions(w);
+    if (txns.empty()) return;
+
+    const std::string accountsFile = runner.config().scratchDir + "/bench_partition_all.txt";
+    int64_t startCents = 0;
+    {
+        Banking bank;
+        OutputSilencer quiet;
+        for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+        if (!bank.saveAccountsToFile(accountsFile)) return;
+        startCents = bank.totals().balanceCents;
+    }
+
+    std::vector<WireRequest> requests;
+    requests.reserve(txns.size());
+    int firstAccNo = txns.front().accNo;
+    for (size_t i = 0; i < txns.size(); i++) {
+        const Transaction &t = txns[i];
+        WireOp op = t.type == DEPOSIT ? OP_DEPOSIT : t.type == WITHDRAW ? OP_WITHDRAW : OP_TRANSFER;
+        requests.push_back(makeRequest(static_cast<uint32_t>(i), op, t.accNo, t.targetAcc, t.amount));
+        firstAccNo = std::min(firstAccNo, t.accNo);
+    }
+
+    double baseline = 0.0;
+    partitionCase(runner, "partition/p1", 1, accountsFile, startCents, requests, baseline, false, firstAccNo);
+    partitionCase(runner, "partition/p2", 2, accountsFile, startCents, requests, baseline, false, firstAccNo);
+    partitionCase(runner, "partition/p4", 4, accountsFile, startCents, requests, baseline, false, firstAccNo);
+    baseline = 0.0;
+    partitionCase(runner, "partition/local_p1", 1, accountsFile, startCents, requests, baseline, true, firstAccNo);
+    partitionCase(runner, "partition/local_p2", 2, accountsFile, startCents, requests, baseline, true, firstAccNo);
+    partitionCase(runner, "partition/local_p4", 4, accountsFile, startCents, requests, baseline, true, firstAccNo);
+
+    for (const std::string &f : {accountsFile, accountsFile + ".agg"}) std::remove(f.c_str());
+}
@@ -0,0 +1,102 @@
+#include "bench.h"
+#include "banking.h"
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+
+enum class ReadMode { None, Seqlock, Mutex, Snapshot };
+
+
+// One writer applies the workload while `readers` threads read balances of
+// the accounts it is touching. Reports writer throughput as the case's
+// ops/s, reader throughput as an extra.
+static void mixedCase(BenchRunner &runner, const std::string &name, ReadMode mode, unsigned readers,
+                      const std::vector<Account> &accounts, const std::vector<Transaction> &txns) {
+    if (!runner.enabled(name)) return;
+
+    std::vector<BenchResult> runs;
+    for (int r = 0; r < std::max(1, runner.config().repeat); r++) {
+        Banking bank;
+        for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+        const double expectedTotal = bank.snapshotBalances()->total();
+
+        std::mutex bankMutex;   // only used in ReadMode::Mutex
+        std::atomic<bool> done{false};
+        std::vector<uint64_t> reads(readers, 0);
+        uint64_t inconsistent = 0;
+
+        std::vector<std::thread> threads;
+        for (unsigned id = 0; id < readers; id++) {
+            threads.emplace_back([&, id]() {
+                uint64_t n = 0;
+                size_t i = id * 7919;
+                uint64_t torn = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    const Transaction &t = txns[i++ % txns.size()];
+                    double balance = 0.0;
+                    if (mode == ReadMode::Seqlock) {
+                        bank.readBalance(t.accNo, balance);
+                    } else if (mode == ReadMode::Mutex) {
+                        std::lock_guard<std::mutex> lock(bankMutex);
+                        if (const Account* a = bank.getAccount(t.accNo)) balance = a->balance;
+                    } else if (mode == ReadMode::Snapshot) {
+                        // Beyond summation rounding, a gap means a half-applied transfer.
+                        if (std::fabs(bank.snapshotBalances()->total() - expectedTotal) > 0.005) torn++;
+                    }
+                    n++;
+                }
+                reads[id] = n;
+                if (id == 0) inconsistent = torn;
+            });
+        }
+
+        OutputSilencer quiet;
+        auto begin = std::chrono::steady_clock::now();
+        for (const auto &t : txns) {
+            if (mode == ReadMode::Mutex) {
+                std::lock_guard<std::mutex> lock(bankMutex);
+                bank.applyTransaction(t, false);
+            } else {
+                bank.applyTransaction(t, false);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        done.store(true);
+        for (auto &t : threads) t.join();
+
+        BenchResult res;
+        res.name = name;
+        res.ops = txns.size();
+        res.seconds = seconds;
+        uint64_t totalReads = 0;
+        for (uint64_t n : reads) totalReads += n;
+        res.extra.push_back({"readers", static_cast<double>(readers)});
+        res.extra.push_back({"reads_per_sec", seconds > 0 ? totalReads / seconds : 0.0});
+        if (mode == ReadMode::Snapshot) res.extra.push_back({"inconsistent_snapshots", static_cast<double>(inconsistent)});
+        runs.push_back(res);
+    }
+    std::sort(runs.begin(), runs.end(),
+              [](const BenchResult &a, const BenchResult &b) { return a.seconds < b.seconds; });
+    runner.add(runs[runs.size() / 2]);
+}
+
+
+void benchReads(BenchRunner &runner) {
+    const WorkloadConfig &w = runner.config().workload;
+    const auto accounts = generateAccounts(w);
+    const auto txns = generateTransactions(w);
+    if (txns.empty()) return;
+
+    // Transfers only, so every consistent snapshot has the same total.
+    std::vector<Transaction> transfers;
+    for (const auto &t : txns)
+        if (t.type == TRANSFER) transfers.push_back(t);
+
+    mixedCase(runner, "reads/writer_only", ReadMode::None, 0, accounts, txns);
+    mixedCase(runner, "reads/seqlock_2_readers", ReadMode::Seqlock, 2, accounts, txns);
+    mixedCase(runner, "reads/mutex_2_readers", ReadMode::Mutex, 2, accounts, txns);
+    if (!transfers.empty())
+        mixedCase(runner, "reads/snapshot_1_reader_transfers", ReadMode::Snapshot, 1, accounts, transfers);
+}
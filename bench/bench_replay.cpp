@@ -0,0 +1,71 @@
+#include "bench.h"
+#include "banking.h"
+#include "replay.h"
+#include <cstdio>
+
+
+static void populate(Banking &bank, const std::vector<Account> &accounts) {
+    for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+}
+
+
+void benchReplay(BenchRunner &runner) {
+    const char* names[] = {
+        "replay/text_fast", "replay/text_with_messages_and_limits", "replay/binary_fast",
+        "replay/binary_fast_checkpoint_x10", "replay/binary_fast_4_threads",
+    };
+    bool any = false;
+    for (const char* n : names) any = any || runner.enabled(n);
+    if (!any) return;   // skip writing the scratch ledgers
+
+    const WorkloadConfig &w = runner.config().workload;
+    const std::string textPath = runner.config().scratchDir + "/bench_replay.txt";
+    const std::string binPath = runner.config().scratchDir + "/bench_replay.bin";
+    const std::string checkpointPath = runner.config().scratchDir + "/bench_replay.ckpt";
+    const auto accounts = generateAccounts(w);
+    if (!writeTransactionsFile(textPath, generateTransactions(w)) ||
+        !convertTextLedgerToBinary(textPath, binPath)) {
+        std::cerr << "replay: cannot write scratch ledgers\n";
+        return;
+    }
+
+    auto replayCase = [&](const std::string &name, ReplayOptions opts, const std::string &path) {
+        runner.run(name, [&](BenchClock &clock) {
+            Banking bank;
+            populate(bank, accounts);
+            ReplayEngine engine(bank, opts);
+            ReplayStats stats;
+            OutputSilencer quiet;
+            std::remove(checkpointPath.c_str());
+            clock.start();
+            engine.run(path, stats);
+            clock.stop();
+            clock.addBytes(stats.bytes);
+            return stats.records;
+        });
+    };
+
+    ReplayOptions fast;
+    fast.skipMessages = fast.skipLimits = true;
+    replayCase("replay/text_fast", fast, textPath);
+
+    ReplayOptions faithful;
+    replayCase("replay/text_with_messages_and_limits", faithful, textPath);
+
+    ReplayOptions binary = fast;
+    binary.binary = true;
+    replayCase("replay/binary_fast", binary, binPath);
+
+    ReplayOptions checkpointed = binary;
+    checkpointed.checkpointPath = checkpointPath;
+    checkpointed.checkpointEvery = std::max<size_t>(1, w.transactions / 10);
+    replayCase("replay/binary_fast_checkpoint_x10", checkpointed, binPath);
+
+    ReplayOptions parallel = binary;
+    parallel.threads = 4;
+    replayCase("replay/binary_fast_4_threads", parallel, binPath);
+
+    std::remove(textPath.c_str());
+    std::remove(binPath.c_str());
+    std::remove(checkpointPath.c_str());
+}
@@ -0,0 +1,138 @@
+#include "bench.h"
+#include "banking.h"
+#include "group_commit.h"
+#include "replication.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+
+static const size_t MAX_REPLICATION_WRITES = 200000;
+
+
+// A primary and a follower in one process, connected through a real
+// replication socket. With `inFlight` 0 the primary commits every write
+// first and the follower is timed catching up from LSN 0 (shipping and
+// apply throughput); otherwise the follower is connected throughout and
+// that many writes are kept outstanding against the primary (lag under
+// load). With `durable` both ends fsync their own WAL.
+static void replicationCase(BenchRunner &runner, const std::string &name, const std::vector<Account> &accounts,
+                            const std::vector<Transaction> &txns, size_t inFlight, bool durable) {
+    if (!runner.enabled(name)) return;
+    const std::string dir = runner.config().scratchDir;
+    const std::string replPath = dir + "/bench_replication.sock";
+    const std::string primaryWal = dir + "/bench_replication_primary.wal";
+    const std::string followerWal = dir + "/bench_replication_follower.wal";
+    std::remove(primaryWal.c_str());
+    std::remove(followerWal.c_str());
+
+    Banking primaryBank, followerBank;
+    for (const auto &a : accounts) {
+        primaryBank.createAccount(a.name, a.balance, a.age);
+        followerBank.createAccount(a.name, a.balance, a.age);
+    }
+
+    GroupCommitOptions opts;
+    opts.maxWait = std::chrono::microseconds(200);
+    opts.checkLimits = false;
+    if (durable) opts.walPath = primaryWal;
+    GroupCommitter primary(primaryBank, opts);
+    if (durable) opts.walPath = followerWal;
+    GroupCommitter standby(followerBank, opts);
+
+    LogShipper shipper(replPath);
+    if (!shipper.start("", 0)) {
+        std::cerr << name << ": " << shipper.lastError() << "\n";
+        return;
+    }
+    primary.setLogHook([&shipper](const std::string &lines, uint64_t lsn) { shipper.append(lines, lsn); });
+    if (!primary.start() || !standby.start()) {
+        std::cerr << name << ": " << primary.lastError() << standby.lastError() << "\n";
+        return;
+    }
+    ReplicaFollower follower(standby);
+    if (inFlight > 0) follower.start(replPath);
+
+    const size_t writes = std::min(txns.size(), MAX_REPLICATION_WRITES);
+    std::atomic<bool> sampling{true};
+    std::atomic<uint64_t> maxBehind{0};
+    std::thread sampler([&]() {
+        while (sampling.load()) {
+            uint64_t lsn = primary.committedLsn(), applied = standby.committedLsn();
+            if (lsn > applied && lsn - applied > maxBehind.load()) maxBehind.store(lsn - applied);
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    });
+
+    auto begin = std::chrono::steady_clock::now();
+    if (inFlight == 0) {
+        std::atomic<size_t> acked{0};
+        for (size_t i = 0; i < writes; i++) primary.submit(txns[i], [&acked](const CommitResult&) { acked++; });
+        while (acked.load() < writes) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    } else {
+        std::vector<std::future<CommitResult>> window;
+        for (size_t i = 0; i < writes; i += inFlight) {
+            window.clear();
+            for (size_t j = i; j < std::min(writes, i + inFlight); j++) window.push_back(primary.submit(txns[j]));
+            for (auto &f : window) f.get();
+        }
+    }
+    double primarySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    if (inFlight == 0) {
+        begin = std::chrono::steady_clock::now();
+        follower.start(replPath);
+    }
+
+    const uint64_t target = primary.committedLsn();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    while (standby.committedLsn() < target && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    sampling.store(false);
+    sampler.join();
+
+    ReplicaStatus s = follower.status();
+    follower.stop();
+    primary.stop();
+    standby.stop();
+    shipper.stop();
+    std::remove(primaryWal.c_str());
+    std::remove(followerWal.c_str());
+    if (standby.committedLsn() < target) {
+        std::cerr << name << ": follower stopped at LSN " << standby.committedLsn() << " of " << target << "\n";
+        return;
+    }
+
+    BenchResult res;
+    res.name = name;
+    res.ops = target;
+    res.seconds = seconds;
+    res.extra.push_back({"primary_seconds", primarySeconds});
+    res.extra.push_back({"frames", static_cast<double>(s.frames)});
+    if (inFlight > 0) {
+        res.extra.push_back({"catch_up_ms", (seconds - primarySeconds) * 1e3});
+        res.extra.push_back({"mean_lag_ms", s.meanLagMs});
+        res.extra.push_back({"max_lag_ms", s.maxLagMs});
+        res.extra.push_back({"max_behind_records", static_cast<double>(maxBehind.load())});
+    }
+    runner.add(res);
+}
+
+
+void benchReplication(BenchRunner &runner) {
+    const char* names[] = {
+        "replication/throughput", "replication/lag_d64", "replication/lag_d64_wal",
+    };
+    bool any = false;
+    for (const char* n : names) any = any || runner.enabled(n);
+    if (!any) return;
+
+    const WorkloadConfig &w = runner.config().workload;
+    const auto accounts = generateAccounts(w);
+    const auto txns = generateTransactions(w);
+    if (txns.empty()) return;
+
+    replicationCase(runner, "replication/throughput", accounts, txns, 0, false);
+    replicationCase(runner, "replication/lag_d64", accounts, txns, 64, false);
+    replicationCase(runner, "replication/lag_d64_wal", accounts, txns, 64, true);
+}
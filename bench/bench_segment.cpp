@@ -0,0 +1,192 @@
+#include "bench.h"
+#include "segment.h"
+#include "ledger_view.h"
+#include "TransactionList.h"
+#include <cstdio>
+#include <unordered_map>
+
+
+// The text cases parse every row with iostreams, so the segment suite caps
+// its ledger below the statement suite's default.
+static const size_t MAX_SEGMENT_ROWS = 2000000;
+
+
+// Workload transactions cycled out to `rows` records with running balances,
+// a few records per second.
+static std::vector<LedgerRecord> buildRecords(const BenchConfig &cfg, size_t rows) {
+    std::vector<LedgerRecord> records;
+    const auto accounts = generateAccounts(cfg.workload);
+    const auto txns = generateTransactions(cfg.workload);
+    if (txns.empty()) return records;
+
+    std::unordered_map<int, double> balance;
+    for (const auto &a : accounts) balance[a.accNo] = a.balance;
+
+    records.reserve(rows);
+    for (size_t i = 0; i < rows; i++) {
+        const Transaction &t = txns[i % txns.size()];
+        double &from = balance[t.accNo];
+        if (t.type == DEPOSIT) from += t.amount;
+        else if (t.amount <= from) from -= t.amount;
+        if (t.type == TRANSFER && t.amount <= from) balance[t.targetAcc] += t.amount;
+        LedgerRecord r = toLedgerRecord(t, from);
+        r.timestamp = 1735689600 + static_cast<int64_t>(i / 4);
+        records.push_back(r);
+    }
+    return records;
+}
+
+
+template <typename Body>
+static void runWithExtras(BenchRunner &runner, const std::string &name, Body body) {
+    if (!runner.enabled(name)) return;
+    std::vector<BenchResult> runs;
+    for (int r = 0; r < std::max(1, runner.config().repeat); r++) {
+        BenchClock clock;
+        BenchResult res;
+        res.name = name;
+        res.ops = body(clock, res);
+        res.seconds = clock.seconds();
+        res.bytes = clock.bytes();
+        runs.push_back(res);
+    }
+    std::sort(runs.begin(), runs.end(),
+              [](const BenchResult &a, const BenchResult &b) { return a.seconds < b.seconds; });
+    runner.add(runs[runs.size() / 2]);
+}
+
+
+void benchSegment(BenchRunner &runner) {
+    const char* names[] = {
+        "segment/encode", "segment/decode", "segment/scan_account_sum", "segment/scan_range_10pct",
+        "segment/binary_scan_account_sum", "segment/text_parse_sum",
+    };
+    bool any = false;
+    for (const char* n : names) any = any || runner.enabled(n);
+    if (!any) return;
+
+    const size_t rows = std::min(runner.config().ledgerRows, MAX_SEGMENT_ROWS);
+    const std::string dir = runner.config().scratchDir;
+    const std::string binPath = dir + "/bench_segment.bin";
+    const std::string segPath = dir + "/bench_segment.seg";
+    const std::string textUser = dir + "/bench_segment";          // -> bench_segment_transactions.txt
+    const std::string textPath = textUser + "_transactions.txt";
+
+    const auto records = buildRecords(runner.config(), rows);
+    if (records.empty()) return;
+    const uint64_t rawBytes = records.size() * sizeof(LedgerRecord);
+    const int accNo = records[0].accNo;
+
+    std::string error;
+    if (!writeLedgerRecords(binPath, records) || !sealLedgerSegment(binPath, segPath, &error)) {
+        std::cerr << "segment: cannot write scratch ledgers " << error << "\n";
+        return;
+    }
+    {
+        std::vector<LedgerEntry> text;
+        text.reserve(records.size());
+        for (const auto &r : records) text.push_back({get_type_as_string(r), r.amount, r.balanceAfter, get_date(r)});
+        saveTransactionsToFile(textUser, text);
+    }
+    uint64_t textBytes = 0;
+    if (std::FILE* f = std::fopen(textPath.c_str(), "rb")) {
+        std::fseek(f, 0, SEEK_END);
+        textBytes = static_cast<uint64_t>(std::ftell(f));
+        std::fclose(f);
+    }
+
+    runWithExtras(runner, "segment/encode", [&](BenchClock &clock, BenchResult &res) {
+        std::string out;
+        out.reserve(rawBytes / 2);
+        clock.start();
+        for (size_t i = 0; i < records.size(); i += SEGMENT_BLOCK_RECORDS)
+            encodeSegmentBlock(&records[i], std::min(SEGMENT_BLOCK_RECORDS, records.size() - i), out);
+        clock.stop();
+        clock.addBytes(rawBytes);
+        res.extra.push_back({"compression_ratio_vs_binary", static_cast<double>(rawBytes) / out.size()});
+        res.extra.push_back({"compression_ratio_vs_text", static_cast<double>(textBytes) / out.size()});
+        res.extra.push_back({"bytes_per_record", static_cast<double>(out.size()) / records.size()});
+        return uint64_t(records.size());
+    });
+
+    // Block decode from the mapped segment into a reused buffer.
+    runWithExtras(runner, "segment/decode", [&](BenchClock &clock, BenchResult &res) {
+        SegmentReader segment;
+        if (!segment.open(segPath)) return uint64_t(0);
+        std::vector<LedgerRecord> buf;
+        uint64_t decoded = 0;
+        clock.start();
+        for (size_t i = 0; i < segment.blockCount(); i++) {
+            if (!segment.readBlock(i, buf)) return uint64_t(0);
+            decoded += buf.size();
+        }
+        clock.stop();
+        clock.addBytes(decoded * sizeof(LedgerRecord));
+        double seconds = clock.seconds();
+        res.extra.push_back({"decode_gb_per_sec", seconds > 0 ? decoded * sizeof(LedgerRecord) / seconds / 1e9 : 0.0});
+        res.extra.push_back({"segment_bytes", static_cast<double>(segment.fileBytes())});
+        return decoded;
+    });
+
+    // Range scans: all of the segment, then the middle tenth by timestamp,
+    // which only decodes the blocks overlapping it.
+    runner.run("segment/scan_account_sum", [&](BenchClock &clock) {
+        double sum = 0.0;
+        clock.start();
+        SegmentReader segment;
+        if (!segment.open(segPath)) return uint64_t(0);
+        segment.scan(INT64_MIN, INT64_MAX, [&](const LedgerRecord &r) {
+            if (r.accNo == accNo) sum += r.amount;
+        });
+        clock.stop();
+        clock.addBytes(rawBytes);
+        if (sum < 0) std::cerr << sum;   // keep the loop
+        return uint64_t(records.size());
+    });
+
+    runner.run("segment/scan_range_10pct", [&](BenchClock &clock) {
+        const int64_t first = records.front().timestamp, span = records.back().timestamp - first;
+        const int64_t from = first + span * 45 / 100, to = first + span * 55 / 100;
+        uint64_t matched = 0;
+        double sum = 0.0;
+        clock.start();
+        SegmentReader segment;
+        if (!segment.open(segPath)) return uint64_t(0);
+        segment.scan(from, to, [&](const LedgerRecord &r) {
+            matched++;
+            sum += r.amount;
+        });
+        clock.stop();
+        if (sum < 0) std::cerr << sum;
+        return matched;
+    });
+
+    runner.run("segment/binary_scan_account_sum", [&](BenchClock &clock) {
+        double sum = 0.0;
+        clock.start();
+        MappedLedger ledger;
+        if (!ledger.open(binPath)) return uint64_t(0);
+        for (const LedgerRecord &r : ledger)
+            if (r.accNo == accNo) sum += r.amount;
+        clock.stop();
+        clock.addBytes(rawBytes);
+        if (sum < 0) std::cerr << sum;
+        return uint64_t(ledger.size());
+    });
+
+    // Today's path for a per-user text ledger: parse every row.
+    runner.run("segment/text_parse_sum", [&](BenchClock &clock) {
+        clock.start();
+        auto rowsRead = loadTransactionsFromFile(textUser);
+        double sum = 0.0;
+        for (const auto &e : rowsRead) sum += e.amount;
+        clock.stop();
+        clock.addBytes(textBytes);
+        if (sum < 0) std::cerr << sum;
+        return uint64_t(rowsRead.size());
+    });
+
+    std::remove(binPath.c_str());
+    std::remove(segPath.c_str());
+    std::remove(textPath.c_str());
+}
@@ -0,0 +1,107 @@
+#include "bench.h"
+#include "banking.h"
+#include "engine_client.h"
+#include "engine_server.h"
+#include "group_commit.h"
+#include <cstdio>
+#include <thread>
+
+
+// Each connection keeps `depth` requests in flight: it tops the pipeline
+// back up after every response, so the server always has work queued.
+static uint64_t driveConnection(const std::string &socketPath, WireOp op, size_t requests,
+                                size_t depth, const std::vector<Transaction> &txns, size_t seed) {
+    EngineClient client;
+    if (!client.connectUnix(socketPath)) return 0;
+
+    size_t sent = 0, received = 0;
+    auto sendNext = [&]() {
+        const Transaction &t = txns[(seed + sent) % txns.size()];
+        client.send(makeRequest(static_cast<uint32_t>(sent), op, t.accNo, 0, t.amount));
+        sent++;
+    };
+
+    while (sent < requests && sent < depth) sendNext();
+    if (!client.flush()) return 0;
+
+    WireResponse resp;
+    while (received < requests) {
+        if (!client.receive(resp)) break;
+        received++;
+        if (sent < requests) {
+            sendNext();
+            if (!client.flush()) break;
+        }
+    }
+    return received;
+}
+
+
+static void serverCase(BenchRunner &runner, const std::string &name, WireOp op,
+                       unsigned connections, size_t depth, size_t totalRequests,
+                       const std::vector<Account> &accounts, const std::vector<Transaction> &txns) {
+    if (!runner.enabled(name)) return;
+    const std::string socketPath = runner.config().scratchDir + "/bench_engine.sock";
+
+    Banking bank;
+    for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+
+    GroupCommitOptions commitOpts;
+    commitOpts.maxWait = std::chrono::microseconds(200);
+    commitOpts.checkLimits = false;
+    GroupCommitter committer(bank, commitOpts);
+
+    ServerOptions serverOpts;
+    serverOpts.unixPath = socketPath;
+    EngineServer server(bank, &committer, serverOpts);
+    if (!committer.start() || !server.start()) {
+        std::cerr << name << ": " << server.lastError() << committer.lastError() << "\n";
+        return;
+    }
+    std::thread loop([&]() { server.run(); });
+
+    const size_t perConnection = std::max<size_t>(1, totalRequests / connections);
+    std::vector<uint64_t> done(connections, 0);
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < connections; c++) {
+        clients.emplace_back([&, c]() {
+            done[c] = driveConnection(socketPath, op, perConnection, depth, txns, c * perConnection);
+        });
+    }
+    for (auto &t : clients) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    server.stop();
+    loop.join();
+    committer.stop();
+
+    BenchResult res;
+    res.name = name;
+    for (uint64_t d : done) res.ops += d;
+    res.seconds = seconds;
+    res.extra.push_back({"connections", static_cast<double>(connections)});
+    res.extra.push_back({"pipeline_depth", static_cast<double>(depth)});
+    runner.add(res);
+}
+
+
+void benchServer(BenchRunner &runner) {
+    const WorkloadConfig &w = runner.config().workload;
+    const auto accounts = generateAccounts(w);
+    const auto txns = generateTransactions(w);
+    if (txns.empty()) return;
+    const size_t total = std::min<size_t>(w.transactions, 200000);
+
+    for (unsigned c : {1u, 4u, 16u}) {
+        for (size_t d : {1, 16, 64}) {
+            std::string shape = "_c" + std::to_string(c) + "_d" + std::to_string(d);
+            serverCase(runner, "server/balance" + shape, OP_BALANCE, c, d, total, accounts, txns);
+        }
+    }
+    // Writes wait for the group-commit window, so depth is what hides it.
+    for (size_t d : {1, 16, 256}) {
+        std::string shape = "_c4_d" + std::to_string(d);
+        serverCase(runner, "server/deposit" + shape, OP_DEPOSIT, 4, d, total / 4, accounts, txns);
+    }
+}
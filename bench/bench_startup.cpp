@@ -0,0 +1,150 @@
+#include "bench.h"
+#include "banking.h"
+#include "ledger_history.h"
+#include "ledger_view.h"
+#include "warmup.h"
+#include <cstdio>
+
+
+// Startup cost grows with the account base, so the suite uses at least
+// this many accounts whatever --accounts says.
+static const size_t MIN_STARTUP_ACCOUNTS = 200000;
+static const size_t MAX_HISTORY_ROWS = 2000000;
+static const size_t WARM_ACCOUNTS = 20000;
+static const size_t CACHE_BYTES = size_t(256) << 20;
+
+
+struct StartupFiles {
+    std::string accounts;        // accounts file (+ .agg)
+    std::string table;           // account table (+ .aggs)
+    std::string ledger;          // binary history
+    std::string segment;         // the same history, sealed
+};
+
+
+static bool writeStartupFiles(const BenchConfig &cfg, const StartupFiles &files, int &firstAccount) {
+    WorkloadConfig w = cfg.workload;
+    w.accounts = std::max(w.accounts, MIN_STARTUP_ACCOUNTS);
+    const auto accounts = generateAccounts(w);
+    const auto txns = generateTransactions(w);
+    if (txns.empty()) return false;
+
+    Banking bank;
+    {
+        OutputSilencer quiet;
+        for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+    }
+    const size_t rows = std::min(cfg.ledgerRows, MAX_HISTORY_ROWS);
+    std::vector<LedgerRecord> history;
+    history.reserve(rows);
+    for (size_t i = 0; i < rows; i++) {
+        const Transaction &t = txns[i % txns.size()];
+        if (!bank.applyTransaction(t, false)) continue;
+        const Account* a = bank.getAccount(t.accNo);
+        LedgerRecord r = toLedgerRecord(t, a ? a->balance : 0.0);
+        r.timestamp = 1735689600 + static_cast<int64_t>(i / 4);
+        history.push_back(r);
+    }
+    firstAccount = history.empty() ? accounts[0].accNo : history.back().accNo;
+
+    return bank.saveAccountsToFile(files.accounts) && bank.saveAccountTable(files.table) &&
+           writeLedgerRecords(files.ledger, history) && sealLedgerSegment(files.ledger, files.segment);
+}
+
+
+// The request every case ends on: a deposit to the most recently active
+// account, answered with its last five records.
+static bool firstRequest(Banking &bank, int accNo, const std::vector<LedgerRecord> &recent) {
+    return bank.deposit(accNo, 1.0) && !recent.empty();
+}
+
+
+void benchStartup(BenchRunner &runner) {
+    const char* names[] = {"startup/eager_first_request", "startup/lazy_first_request", "startup/lazy_fully_warm"};
+    bool any = false;
+    for (const char* n : names) any = any || runner.enabled(n);
+    if (!any) return;
+
+    const std::string dir = runner.config().scratchDir;
+    StartupFiles files{dir + "/bench_startup_accounts.txt", dir + "/bench_startup.tbl",
+                       dir + "/bench_startup.bin", dir + "/bench_startup.seg"};
+    int accNo = 0;
+    if (!writeStartupFiles(runner.config(), files, accNo)) {
+        std::cerr << "startup: cannot write scratch files in " << dir << "\n";
+        return;
+    }
+
+    // Everything loaded before the first request: the accounts file with
+    // its aggregates, and every history record.
+    runner.run("startup/eager_first_request", [&](BenchClock &clock) {
+        OutputSilencer quiet;
+        clock.start();
+        Banking bank;
+        if (!bank.loadAccountsFromFile(files.accounts)) return uint64_t(0);
+        std::vector<LedgerRecord> all;
+        {
+            MappedLedger ledger;
+            if (!ledger.open(files.ledger)) return uint64_t(0);
+            all.assign(ledger.begin(), ledger.end());
+        }
+        std::vector<LedgerRecord> recent;
+        for (auto r = all.rbegin(); r != all.rend() && recent.size() < 5; ++r)
+            if (r->accNo == accNo || (r->type == TRANSFER && r->targetAcc == accNo)) recent.push_back(*r);
+        bool ok = firstRequest(bank, accNo, recent);
+        clock.stop();
+        return uint64_t(ok);
+    });
+
+    // Map the table, read the segment footer, then serve.
+    runner.run("startup/lazy_first_request", [&](BenchClock &clock) {
+        clock.start();
+        Banking bank;
+        LedgerHistory history;
+        if (!bank.openAccountTable(files.table, CACHE_BYTES) || !history.open({files.segment})) return uint64_t(0);
+        std::vector<LedgerRecord> recent;
+        history.lastRecords(accNo, 5, recent);
+        bool ok = firstRequest(bank, accNo, recent);
+        clock.stop();
+        return uint64_t(ok);
+    });
+
+    // Lazy start, the first request, and a background warm-up of the most
+    // recently active accounts running to completion.
+    if (runner.enabled("startup/lazy_fully_warm")) {
+        std::vector<BenchResult> runs;
+        for (int r = 0; r < std::max(1, runner.config().repeat); r++) {
+            auto started = std::chrono::steady_clock::now();
+            Banking bank;
+            LedgerHistory history;
+            std::mutex bankMutex;
+            if (!bank.openAccountTable(files.table, CACHE_BYTES) || !history.open({files.segment})) return;
+            AccountWarmer warmer(bank, bankMutex);
+            warmer.start(history, WARM_ACCOUNTS);
+            std::vector<LedgerRecord> recent;
+            history.lastRecords(accNo, 5, recent);
+            {
+                std::lock_guard<std::mutex> lock(bankMutex);
+                firstRequest(bank, accNo, recent);
+            }
+            double firstMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            warmer.wait();
+            double warmSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+            BenchResult res;
+            res.name = "startup/lazy_fully_warm";
+            res.ops = warmer.warmed();
+            res.seconds = warmSeconds;
+            res.extra.push_back({"first_request_ms", firstMs});
+            res.extra.push_back({"warmed_accounts", static_cast<double>(warmer.warmed())});
+            res.extra.push_back({"blocks_decoded", static_cast<double>(history.blocksDecoded())});
+            runs.push_back(res);
+        }
+        std::sort(runs.begin(), runs.end(),
+                  [](const BenchResult &a, const BenchResult &b) { return a.seconds < b.seconds; });
+        runner.add(runs[runs.size() / 2]);
+    }
+
+    for (const std::string &f : {files.accounts, files.accounts + ".agg", files.table, files.table + ".aggs",
+                                 files.ledger, files.segment})
+        std::remove(f.c_str());
+}
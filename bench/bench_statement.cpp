@@ -0,0 +1,132 @@
+#include "bench.h"
+#include "ledger_view.h"
+#include "TransactionList.h"
+#include <cstdio>
+
+
+// The path callers had before ledger views: read every binary record and
+// build a vector of string-bearing rows just to show the last few.
+static std::vector<LedgerEntry> materialize(const std::string &path) {
+    std::vector<LedgerEntry> rows;
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) return rows;
+    std::vector<LedgerRecord> buf(64 * 1024);
+    size_t got;
+    while ((got = std::fread(buf.data(), sizeof(LedgerRecord), buf.size(), in)) > 0) {
+        for (size_t i = 0; i < got; i++) {
+            const LedgerRecord &r = buf[i];
+            rows.push_back({get_type_as_string(r), r.amount, r.balanceAfter, get_date(r)});
+        }
+    }
+    std::fclose(in);
+    return rows;
+}
+
+
+void benchStatement(BenchRunner &runner) {
+    const char* names[] = {
+        "statement/vector_materialize_last5", "statement/vector_resident_last5",
+        "statement/mmap_last5", "statement/mmap_account_last5", "statement/columns_last5",
+    };
+    bool any = false;
+    for (const char* n : names) any = any || runner.enabled(n);
+    if (!any) return;   // skip writing the scratch ledger
+
+    const size_t rows = runner.config().ledgerRows;
+    const std::string path = runner.config().scratchDir + "/bench_statement.bin";
+    const auto txns = generateTransactions(runner.config().workload);
+    if (txns.empty()) return;
+
+    // Cycle the workload stream out to `rows` records, one second apart.
+    {
+        std::vector<LedgerRecord> chunk;
+        chunk.reserve(64 * 1024);
+        bool append = false;
+        for (size_t i = 0; i < rows; i++) {
+            LedgerRecord r = toLedgerRecord(txns[i % txns.size()], 1000.0 + (i % 997));
+            r.timestamp = 1735689600 + static_cast<int64_t>(i);
+            chunk.push_back(r);
+            if (chunk.size() == chunk.capacity() || i + 1 == rows) {
+                if (!writeLedgerRecords(path, chunk, append)) {
+                    std::cerr << "statement: cannot write " << path << "\n";
+                    return;
+                }
+                append = true;
+                chunk.clear();
+            }
+        }
+    }
+    const uint64_t ledgerBytes = rows * sizeof(LedgerRecord);
+
+    runner.run("statement/vector_materialize_last5", [&](BenchClock &clock) {
+        OutputSilencer quiet;
+        clock.start();
+        auto ledger = materialize(path);
+        TransactionList::displayMiniStatement(ledger, 5);
+        clock.stop();
+        clock.addBytes(ledgerBytes);
+        return uint64_t(1);
+    });
+
+    if (runner.enabled("statement/vector_resident_last5")) {
+        const auto ledger = materialize(path);
+        runner.run("statement/vector_resident_last5", [&](BenchClock &clock) {
+            OutputSilencer quiet;
+            const uint64_t renders = 20000;
+            clock.start();
+            for (uint64_t i = 0; i < renders; i++) TransactionList::displayMiniStatement(ledger, 5);
+            clock.stop();
+            return renders;
+        });
+    }
+
+    // Open, map and render each time, as a one-shot CLI statement would.
+    runner.run("statement/mmap_last5", [&](BenchClock &clock) {
+        OutputSilencer quiet;
+        const uint64_t renders = 20000;
+        clock.start();
+        for (uint64_t i = 0; i < renders; i++) {
+            MappedLedger ledger;
+            if (!ledger.open(path)) return uint64_t(0);
+            TransactionList::displayMiniStatement(ledger, 5);
+        }
+        clock.stop();
+        return renders;
+    });
+
+    runner.run("statement/mmap_account_last5", [&](BenchClock &clock) {
+        MappedLedger ledger;
+        if (!ledger.open(path) || ledger.size() == 0) return uint64_t(0);
+        const int accNo = ledger[0].accNo;
+        OutputSilencer quiet;
+        const uint64_t renders = 2000;
+        clock.start();
+        for (uint64_t i = 0; i < renders; i++) {
+            TransactionList::displayMiniStatement(ledger, 5,
+                [accNo](const LedgerRecord &r) { return r.accNo == accNo; });
+        }
+        clock.stop();
+        return renders;
+    });
+
+    if (runner.enabled("statement/columns_last5")) {
+        LedgerColumns columns;
+        {
+            MappedLedger ledger;
+            if (ledger.open(path)) {
+                columns.reserve(ledger.size());
+                for (const LedgerRecord &r : ledger) columns.append(r);
+            }
+        }
+        runner.run("statement/columns_last5", [&](BenchClock &clock) {
+            OutputSilencer quiet;
+            const uint64_t renders = 20000;
+            clock.start();
+            for (uint64_t i = 0; i < renders; i++) TransactionList::displayMiniStatement(columns, 5);
+            clock.stop();
+            return renders;
+        });
+    }
+
+    std::remove(path.c_str());
+}
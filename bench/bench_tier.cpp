@@ -0,0 +1,85 @@
+#include "bench.h"
+#include "banking.h"
+#include <cstdint>
+#include <cstdio>
+
+
+// Applies the workload with at most `budget` bytes of accounts resident,
+// starting cold from a freshly written table each run; with `tiered` off,
+// every account is held in memory as before.
+static void tierCase(BenchRunner &runner, const std::string &name, const std::string &table,
+                     const std::vector<Account> &accounts, const std::vector<Transaction> &txns,
+                     size_t budget, bool tiered) {
+    if (!runner.enabled(name)) return;
+    std::vector<BenchResult> runs;
+    for (int r = 0; r < std::max(1, runner.config().repeat); r++) {
+        if (!writeAccountTable(table, accounts)) {
+            std::cerr << "tier: cannot write " << table << "\n";
+            return;
+        }
+        Banking bank;
+        if (tiered && !bank.openAccountTable(table, budget)) return;
+        if (!tiered) for (const auto &a : accounts) bank.createAccount(a.name, a.balance, a.age);
+
+        BenchClock clock;
+        clock.start();
+        uint64_t applied = 0;
+        for (const auto &t : txns) applied += bank.applyTransaction(t, false);
+        clock.stop();
+
+        TierStats s = bank.tierStats();
+        BenchResult res;
+        res.name = name;
+        res.ops = txns.size();
+        res.seconds = clock.seconds();
+        res.extra.push_back({"applied", static_cast<double>(applied)});
+        if (tiered) {
+            res.extra.push_back({"budget_kb", budget / 1024.0});
+            res.extra.push_back({"resident_kb", s.residentBytes / 1024.0});
+            res.extra.push_back({"hit_rate", s.hitRate()});
+            res.extra.push_back({"misses", static_cast<double>(s.misses)});
+            res.extra.push_back({"evictions", static_cast<double>(s.evictions)});
+            res.extra.push_back({"writebacks", static_cast<double>(s.writebacks)});
+        }
+        runs.push_back(res);
+    }
+    std::sort(runs.begin(), runs.end(),
+              [](const BenchResult &a, const BenchResult &b) { return a.seconds < b.seconds; });
+    runner.add(runs[runs.size() / 2]);
+}
+
+
+void benchTier(BenchRunner &runner) {
+    const char* names[] = {
+        "tier/all_resident", "tier/cache_100pct", "tier/cache_25pct", "tier/cache_5pct", "tier/cache_1pct",
+    };
+    bool any = false;
+    for (const char* n : names) any = any || runner.enabled(n);
+    if (!any) return;
+
+    // createAccount numbers accounts from 1001, as the workload does.
+    const auto accounts = generateAccounts(runner.config().workload);
+    const auto txns = generateTransactions(runner.config().workload);
+    const std::string table = runner.config().scratchDir + "/bench_tier.tbl";
+
+    // Footprint of the whole account base once every account has been
+    // touched: the budget the percentages are taken of.
+    size_t fullBytes = 0;
+    {
+        if (!writeAccountTable(table, accounts)) return;
+        Banking bank;
+        if (!bank.openAccountTable(table, SIZE_MAX)) return;
+        for (const auto &t : txns) bank.applyTransaction(t, false);
+        for (const auto &a : accounts) bank.getAccount(a.accNo);
+        fullBytes = bank.tierStats().residentBytes;
+    }
+
+    tierCase(runner, "tier/all_resident", table, accounts, txns, 0, false);
+    tierCase(runner, "tier/cache_100pct", table, accounts, txns, fullBytes, true);
+    tierCase(runner, "tier/cache_25pct", table, accounts, txns, fullBytes / 4, true);
+    tierCase(runner, "tier/cache_5pct", table, accounts, txns, fullBytes / 20, true);
+    tierCase(runner, "tier/cache_1pct", table, accounts, txns, fullBytes / 100, true);
+
+    std::remove(table.c_str());
+    std::remove((table + ".aggs").c_str());
+}
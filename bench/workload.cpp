@@ -0,0 +1,106 @@
+#include "workload.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+
+
+ZipfGenerator::ZipfGenerator(size_t n, double s, uint64_t seed)
+    : cdf(n), rng(seed), uniform(0.0, 1.0) {
+    double sum = 0.0;
+    for (size_t k = 0; k < n; k++) {
+        sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+        cdf[k] = sum;
+    }
+    for (auto &c : cdf) c /= sum;
+}
+
+
+size_t ZipfGenerator::next() {
+    double u = uniform(rng);
+    auto it = std::lower_bound(cdf.begin(), cdf.end(), u);
+    if (it == cdf.end()) return cdf.size() - 1;
+    return static_cast<size_t>(it - cdf.begin());
+}
+
+
+static double roundCents(double v) {
+    return std::round(v * 100.0) / 100.0;
+}
+
+
+std::vector<Account> generateAccounts(const WorkloadConfig &cfg) {
+    std::mt19937_64 rng(cfg.seed);
+    std::lognormal_distribution<double> balance(8.5, 1.2);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<int> adultAge(18, 85);
+    std::uniform_int_distribution<int> minorAge(10, 17);
+
+    std::vector<Account> accounts;
+    accounts.reserve(cfg.accounts);
+    for (size_t i = 0; i < cfg.accounts; i++) {
+        int accNo = cfg.firstAccNo + static_cast<int>(i);
+        bool minor = coin(rng) < cfg.minorFraction;
+        int age = minor ? minorAge(rng) : adultAge(rng);
+        accounts.emplace_back(accNo, "Customer" + std::to_string(accNo),
+                              roundCents(balance(rng)), age);
+    }
+    return accounts;
+}
+
+
+std::vector<Transaction> generateTransactions(const WorkloadConfig &cfg) {
+    std::vector<Transaction> txns;
+    if (cfg.accounts == 0) return txns;
+
+    std::mt19937_64 rng(cfg.seed ^ 0x9e3779b97f4a7c15ULL);
+    ZipfGenerator zipf(cfg.accounts, cfg.zipfS, cfg.seed + 1);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::lognormal_distribution<double> amount(4.0, 1.0);
+
+    std::vector<int> rankToAcc(cfg.accounts);
+    std::iota(rankToAcc.begin(), rankToAcc.end(), cfg.firstAccNo);
+    std::shuffle(rankToAcc.begin(), rankToAcc.end(), rng);
+
+    txns.reserve(cfg.transactions);
+    for (size_t i = 0; i < cfg.transactions; i++) {
+        int acc = rankToAcc[zipf.next()];
+        double amt = std::max(0.01, roundCents(amount(rng)));
+        double pick = coin(rng);
+
+        if (pick < cfg.depositMix) {
+            txns.emplace_back(DEPOSIT, acc, 0, amt);
+        } else if (pick < cfg.depositMix + cfg.withdrawMix || cfg.accounts < 2) {
+            txns.emplace_back(WITHDRAW, acc, 0, amt);
+        } else {
+            int target = acc;
+            while (target == acc) target = rankToAcc[zipf.next()];
+            txns.emplace_back(TRANSFER, acc, target, amt);
+        }
+    }
+    return txns;
+}
+
+
+bool writeAccountsFile(const std::string &path, const std::vector<Account> &accounts) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) return false;
+    file << std::fixed << std::setprecision(2);
+    for (const auto &a : accounts)
+        file << a.accNo << '|' << a.name << '|' << a.balance << '|' << a.age << '\n';
+    return static_cast<bool>(file);
+}
+
+
+bool writeTransactionsFile(const std::string &path, const std::vector<Transaction> &txns) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) return false;
+    file << std::fixed << std::setprecision(2);
+    for (const auto &t : txns) {
+        file << typeToStr(t.type) << '|' << t.accNo << '|';
+        if (t.type == TRANSFER) file << t.targetAcc << '|';
+        file << t.amount << '\n';
+    }
+    return static_cast<bool>(file);
+}
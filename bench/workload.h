@@ -0,0 +1,49 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "account.h"
+#include "transaction.h"
+
+
+// Shape of a synthetic workload. The same config and seed always produce
+// the same accounts and transaction stream.
+struct WorkloadConfig {
+    size_t accounts = 10000;
+    size_t transactions = 200000;
+    double zipfS = 0.99;           // 0 = uniform, ~1 = typical retail skew
+    double depositMix = 0.40;
+    double withdrawMix = 0.35;     // remainder are transfers
+    double minorFraction = 0.05;   // accounts subject to the daily limit
+    uint64_t seed = 42;
+    int firstAccNo = 1001;
+};
+
+
+// Samples ranks 0..n-1 with P(k) proportional to 1/(k+1)^s.
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t n, double s, uint64_t seed);
+    size_t next();
+
+private:
+    std::vector<double> cdf;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> uniform;
+};
+
+
+std::vector<Account> generateAccounts(const WorkloadConfig &cfg);
+
+// Hot ranks are scattered across the account range so skew does not line
+// up with insertion order.
+std::vector<Transaction> generateTransactions(const WorkloadConfig &cfg);
+
+// Writers use the data/account.txt and data/transactions.txt formats.
+bool writeAccountsFile(const std::string &path, const std::vector<Account> &accounts);
+bool writeTransactionsFile(const std::string &path, const std::vector<Transaction> &txns);
+
+#endif // WORKLOAD_H
@@ -3,10 +3,13 @@
 
 
 
+#include <ctime>
 #include <iostream>
+#include <iterator>
 #include <vector>
 #include <iomanip>
 #include <string>
+#include <sstream>
 #include <type_traits>
 
 
@@ -95,45 +98,36 @@ struct has_date : std::false_type {};
 template <typename T>
 struct has_date<T, typename std::enable_if<!std::is_same<decltype(std::declval<T>().date), void>::value, void>::type> : std::true_type {};
 
+template <typename, typename = void>
+struct has_timestamp : std::false_type {};
+template <typename T>
+struct has_timestamp<T, typename std::enable_if<!std::is_same<decltype(std::declval<T>().timestamp), void>::value, void>::type> : std::true_type {};
+
 template <typename, typename = void>
 struct has_balanceAfter : std::false_type {};
 template <typename T>
 struct has_balanceAfter<T, typename std::enable_if<!std::is_same<decltype(std::declval<T>().balanceAfter), void>::value, void>::type> : std::true_type {};
 
 
+template <typename U>
+struct has_typeToStr {
+    template <typename V>
+    static auto test(int) -> decltype(typeToStr(std::declval<V>()), std::true_type());
+    template <typename>
+    static std::false_type test(...);
+    static constexpr bool value = decltype(test<U>(0))::value;
+};
+
 template <typename T>
 std::string get_type_as_string(const T& tr) {
     if constexpr (std::is_same<decltype(tr.type), std::string>::value) {
         return tr.type;
+    } else if constexpr (has_typeToStr<decltype(tr.type)>::value) {
+        return typeToStr(tr.type);
     } else {
-        using FnType = std::string(*)(decltype(tr.type));
-        #if __cplusplus >= 201103L
-        template <typename U>
-        struct has_typeToStr {
-            template <typename V>
-            static auto test(int) -> decltype(typeToStr(std::declval<V>()), std::true_type());
-            template <typename>
-            static std::false_type test(...);
-            static constexpr bool value = decltype(test<U>(0))::value;
-        };
-        #else
-        struct has_typeToStr { static const bool value = false; };
-        #endif
-
-        
-        #if __cplusplus >= 201103L
-        if constexpr (has_typeToStr<decltype(tr.type)>::value) {
-            return typeToStr(tr.type);
-        } else {
-            std::ostringstream oss;
-            oss << tr.type;
-            return oss.str();
-        }
-        #else
         std::ostringstream oss;
         oss << tr.type;
         return oss.str();
-        #endif
     }
 }
 
@@ -164,10 +158,18 @@ double get_amount(const T& tr) {
     else return 0.0;
 }
 
-// date 
+// date (binary records carry an epoch timestamp instead)
 template <typename T>
 std::string get_date(const T& tr) {
     if constexpr (has_date<T>::value) return tr.date;
+    else if constexpr (has_timestamp<T>::value) {
+        std::time_t ts = static_cast<std::time_t>(tr.timestamp);
+        std::tm tm{};
+        char buf[32];
+        localtime_r(&ts, &tm);
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+        return buf;
+    }
     else return std::string("");
 }
 
@@ -179,16 +181,31 @@ double get_balanceAfter(const T& tr) {
 }
 
 // ----------------- TransactionList -----------------
+// Works on any ledger view with bidirectional begin()/end(): a std::vector,
+// an iterator range, a MappedLedger or LedgerColumns (ledger_view.h). Rows
+// are read in place from the newest end, so only the N printed rows are
+// touched.
 class TransactionList {
 public:
-    template <typename Tx>
-    static void displayMiniStatement(const std::vector<Tx>& transactions, size_t N = 5) {
-        if (transactions.empty()) {
+    template <typename View>
+    static void displayMiniStatement(const View& transactions, size_t N = 5) {
+        displayMiniStatement(transactions, N, [](const auto&) { return true; });
+    }
+
+    // Last N rows for which `keep(row)` holds, newest first.
+    template <typename View, typename Pred>
+    static void displayMiniStatement(const View& transactions, size_t N, Pred keep) {
+        using std::begin;
+        using std::end;
+        auto first = begin(transactions);
+        auto last = end(transactions);
+        if (first == last) {
             std::cout << "No transactions found.\n";
             return;
         }
 
-        bool hasDate = has_date<Tx>::value;
+        using Tx = typename std::decay<decltype(*first)>::type;
+        bool hasDate = has_date<Tx>::value || has_timestamp<Tx>::value;
         bool hasBalAfter = has_balanceAfter<Tx>::value;
 
         // header
@@ -207,15 +224,19 @@ public:
         std::cout << std::string((width>0?width:50), '-') << '\n';
 
         size_t count = 0;
-        for (auto it = transactions.rbegin(); it != transactions.rend() && count < N; ++it, ++count) {
+        for (auto it = last; it != first && count < N;) {
+            --it;
+            const auto& tx = *it;
+            if (!keep(tx)) continue;
+            ++count;
             if (hasDate) {
-                std::cout << std::left << std::setw(20) << get_date(*it);
+                std::cout << std::left << std::setw(20) << get_date(tx);
             }
-            std::cout << std::left << std::setw(12) << get_type_as_string(*it)
-                      << std::setw(8) << get_accNo(*it)
-                      << std::setw(8) << get_targetAcc(*it)
-                      << std::setw(12) << std::fixed << std::setprecision(2) << get_amount(*it);
-            if (hasBalAfter) std::cout << std::setw(12) << std::fixed << std::setprecision(2) << get_balanceAfter(*it);
+            std::cout << std::left << std::setw(12) << get_type_as_string(tx)
+                      << std::setw(8) << get_accNo(tx)
+                      << std::setw(8) << get_targetAcc(tx)
+                      << std::setw(12) << std::fixed << std::setprecision(2) << get_amount(tx);
+            if (hasBalAfter) std::cout << std::setw(12) << std::fixed << std::setprecision(2) << get_balanceAfter(tx);
             std::cout << '\n';
         }
     }
@@ -4,6 +4,7 @@
 #include <string>
 #include <iostream>
 #include <iomanip>
+#include "aggregates.h"
 
 struct Account {
     int accNo;               
@@ -11,6 +12,7 @@ struct Account {
     double balance;          
     int age;                 
     int transactionCount;    
+    AccountAggregates aggregates;   // maintained by Banking on apply/undo
 
     
     Account(int a = 0, const std::string &n = "", double b = 0.0, int ag = 18)
@@ -0,0 +1,194 @@
+#ifndef ACCOUNT_TIER_H
+#define ACCOUNT_TIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "account.h"
+
+
+// On-disk account table, mapped read-write:
+//
+//   AccountTableHeader | AccountTableRow... (ascending accNo) | name bytes
+//
+// Aggregates live beside it in "<table>.aggs", AccountAggregates::encode
+// blobs that each row points into. Writing an account back updates its row
+// in place and appends a fresh blob; the file is compacted whenever the
+// table is rewritten.
+
+struct AccountTableHeader {
+    char magic[8];
+    uint64_t rows;
+    uint64_t liveRows;               // rows not marked deleted
+    uint64_t nameBytes;
+    uint64_t appliedLsn;             // last WAL record the rows reflect
+};
+static_assert(sizeof(AccountTableHeader) == 40, "AccountTableHeader layout is part of the file format");
+
+struct AccountTableRow {
+    int32_t accNo;
+    int32_t age;
+    int32_t transactionCount;
+    uint32_t flags;                  // ROW_DELETED
+    uint64_t balanceBits;            // the double's bit pattern, stored atomically
+    uint64_t nameOffset;             // into the name bytes
+    uint32_t nameBytes;
+    uint32_t aggBytes;               // 0 = no aggregates
+    uint64_t aggOffset;              // into "<table>.aggs"
+};
+static_assert(sizeof(AccountTableRow) == 48, "AccountTableRow layout is part of the file format");
+
+static const uint32_t ROW_DELETED = 1;
+
+// Writes a fresh table (and its .aggs file) holding `accounts`.
+bool writeAccountTable(const std::string &path, std::vector<Account> accounts, uint64_t appliedLsn = 0);
+
+
+struct TierStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;             // cold accounts faulted in from the table
+    uint64_t evictions = 0;
+    uint64_t writebacks = 0;         // evictions or flushes of a changed account
+    uint64_t checkpoints = 0;
+    uint64_t prefetched = 0;         // faulted in ahead of use by prefetch()
+    size_t residentAccounts = 0;
+    size_t residentBytes = 0;
+    size_t budgetBytes = 0;
+
+    double hitRate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+};
+
+
+// Accounts kept resident up to a memory budget, the rest served from the
+// account table. find() faults a cold account in; nothing is evicted until
+// trim(), so pointers it hands out stay valid until the caller reaches a
+// point where it holds none. Eviction is CLOCK: find() sets an entry's
+// reference bit and the hand clears it, evicting entries that have not been
+// touched since its last pass.
+//
+// Accounts created after the table was written have no row and stay
+// resident until the table is rewritten. Single writer; only
+// readColdBalance() may be called from other threads.
+class AccountTier {
+public:
+    AccountTier() = default;
+    ~AccountTier();
+    AccountTier(const AccountTier&) = delete;
+    AccountTier& operator=(const AccountTier&) = delete;
+
+    // Finishes an interrupted checkpoint first, if "<table>.redo" is left.
+    bool open(const std::string &path, size_t budgetBytes);
+    void close();
+
+    // Writes every changed resident account to the table as of WAL record
+    // `lsn`, along with `escrow` for "<table>.escrow", all or nothing: the
+    // row images go to "<table>.redo" and are synced before any row is
+    // touched, and the redo file is removed once the table and its
+    // appliedLsn are synced.
+    bool checkpoint(uint64_t lsn, const std::string &escrow);
+    uint64_t appliedLsn() const { return header ? header->appliedLsn : 0; }
+
+    // While set, trim() never evicts a changed account and close() leaves
+    // them unwritten, so the rows only move at checkpoints and always match
+    // appliedLsn(). checkpointDue() then says the budget is exceeded by
+    // changes waiting for one.
+    void setHoldDirty(bool hold) { holdDirty = hold; }
+    bool checkpointDue() const { return heldBytes > 0 && residentBytes > budget; }
+
+    Account* find(int accNo);
+    // Faults accNo in ahead of use, leaving the hit/miss counters alone;
+    // false once the budget is used up. Prefetched entries start
+    // unreferenced, so they are the first to go if real traffic needs room.
+    bool prefetch(int accNo);
+    Account* insert(const Account &a);
+    bool erase(int accNo);
+    size_t size() const { return liveRows + unbacked; }
+    int maxAccNo() const;
+
+    // The row's balance and age, without faulting the account in.
+    bool readColdBalance(int accNo, double &balance) const;
+    bool coldAge(int accNo, int &age) const;
+
+    // The caller changed an account (or every resident one) in place.
+    void markDirty(int accNo);
+    void markAllDirty();
+
+    // Evicts until within budget; `evicted` gets the account numbers.
+    void trim(std::vector<int> &evicted);
+
+    // fn(const Account&) for every account: rows in accNo order (the
+    // resident copy where there is one), then accounts without a row.
+    // Aggregates are only read for cold rows when `withAggregates` is set.
+    template <typename Fn>
+    void forEach(Fn fn, bool withAggregates) const {
+        Account cold;
+        for (uint64_t i = 0; i < rowCount; i++) {
+            if (rows[i].flags & ROW_DELETED) continue;
+            auto it = resident.find(rows[i].accNo);
+            if (it != resident.end()) {
+                fn(static_cast<const Account&>(slots[it->second]->account));
+            } else if (loadRow(rows[i], cold, withAggregates)) {
+                fn(static_cast<const Account&>(cold));
+            }
+        }
+        for (const auto &e : slots)
+            if (e && e->row < 0) fn(static_cast<const Account&>(e->account));
+    }
+
+    template <typename Fn>
+    void forEachResident(Fn fn) const {
+        for (const auto &e : slots)
+            if (e) fn(static_cast<const Account&>(e->account));
+    }
+
+    TierStats stats() const;
+    const std::string& lastError() const { return error; }
+
+private:
+    struct Entry {
+        Account account;
+        int64_t row = -1;            // -1: no row in the table yet
+        size_t bytes = 0;            // footprint charged against the budget
+        bool referenced = true;
+        bool dirty = false;
+    };
+
+    std::string path;
+    int fd = -1;
+    int aggFd = -1;
+    uint64_t aggEnd = 0;
+    uint8_t* base = nullptr;
+    size_t mappedBytes = 0;
+    AccountTableHeader* header = nullptr;
+    AccountTableRow* rows = nullptr;
+    uint64_t rowCount = 0;
+    const char* names = nullptr;
+    uint64_t liveRows = 0;
+    size_t unbacked = 0;
+
+    std::vector<std::unique_ptr<Entry>> slots;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<int, uint32_t> resident;     // accNo -> slot
+    size_t hand = 0;
+    size_t budget = 0;
+    size_t residentBytes = 0;
+    bool holdDirty = false;
+    size_t heldBytes = 0;                           // changed entries trim() had to keep
+    TierStats counters;
+    std::string error;
+
+    int64_t findRow(int accNo) const;
+    bool loadRow(const AccountTableRow &row, Account &out, bool withAggregates) const;
+    bool storeRow(AccountTableRow &row, int32_t age, int32_t transactionCount, uint64_t balanceBits,
+                  const char* agg, size_t aggBytes);
+    bool writeBack(Entry &e);
+    bool flush();
+    bool applyRedo(const std::string &redo);
+    uint32_t place(std::unique_ptr<Entry> e);
+    void recharge(Entry &e);
+};
+
+#endif // ACCOUNT_TIER_H
@@ -0,0 +1,76 @@
+#ifndef AGGREGATES_H
+#define AGGREGATES_H
+
+#include <cstdint>
+#include <ctime>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+
+// What an amount did to the account it is recorded against. A transfer
+// counts as TRANSFER_OUT on the sender and TRANSFER_IN on the receiver.
+enum AggregateSlot { AGG_DEPOSIT, AGG_WITHDRAW, AGG_TRANSFER_OUT, AGG_TRANSFER_IN, AGG_SLOTS };
+
+
+struct TypeTotals {
+    uint64_t count = 0;
+    double sum = 0.0;
+};
+
+
+struct AggregateBucket {
+    int64_t key;                      // dayKey() or monthKey()
+    TypeTotals slots[AGG_SLOTS];
+};
+
+
+// Per-account counters kept up to date as transactions are applied and
+// undone, so "deposited this month" or "transactions today" are lookups
+// instead of history scans. Days and months are UTC. Only the most recent
+// DAYS_KEPT days and MONTHS_KEPT months are bucketed; lifetime totals cover
+// everything.
+class AccountAggregates {
+public:
+    static const int64_t DAYS_KEPT = 35;
+    static const int64_t MONTHS_KEPT = 13;
+
+    static int64_t dayKey(std::time_t ts);     // days since the epoch
+    static int64_t monthKey(std::time_t ts);   // year * 12 + month - 1
+
+    void add(AggregateSlot slot, double amount, std::time_t when) { update(slot, amount, when, 1); }
+    void remove(AggregateSlot slot, double amount, std::time_t when) { update(slot, amount, when, -1); }
+
+    const TypeTotals& total(AggregateSlot slot) const { return lifetime[slot]; }
+    TypeTotals onDay(int64_t day, AggregateSlot slot) const;
+    TypeTotals inMonth(int64_t month, AggregateSlot slot) const;
+    uint64_t transactionCount() const;         // lifetime, all slots
+    uint64_t countOnDay(int64_t day) const;    // all slots
+    uint64_t countInMonth(int64_t month) const;
+
+    const std::vector<AggregateBucket>& days() const { return daily; }
+    const std::vector<AggregateBucket>& months() const { return monthly; }
+    bool empty() const;
+
+    // One line per account: "accNo L c s ... [D key c s ...]... [M key c s ...]...".
+    void write(std::ostream &out, int accNo) const;
+    static bool parse(const std::string &line, int &accNo, AccountAggregates &out);
+    // Fixed-layout binary form (host byte order) for the account table.
+    void encode(std::string &out) const;
+    static bool decode(const char* data, size_t bytes, AccountAggregates &out);
+
+private:
+    TypeTotals lifetime[AGG_SLOTS];
+    std::vector<AggregateBucket> daily;        // ascending by key
+    std::vector<AggregateBucket> monthly;
+    int64_t cachedDay = -1;                    // dayKey() of the last update
+    int64_t cachedMonth = 0;                   // monthKey() of that day
+
+    void update(AggregateSlot slot, double amount, std::time_t when, int sign);
+};
+
+
+// Human-readable summary for the CLI and the server's AGGREGATES op.
+std::string describeAggregates(const AccountAggregates &agg, std::time_t now);
+
+#endif // AGGREGATES_H
@@ -0,0 +1,87 @@
+#ifndef BALANCE_TABLE_H
+#define BALANCE_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+// Every balance at one instant, sorted by account number.
+struct BalanceSnapshot {
+    uint64_t version = 0;                         // write sections committed before it
+    std::vector<std::pair<int, double>> balances;
+
+    bool find(int accNo, double &balance) const;
+    double total() const;
+};
+
+
+// Balances published for lock-free readers. The single writer (whoever is
+// mutating Banking) brackets each transaction with beginWrite()/endWrite(),
+// a seqlock: readers copy what they need and retry if a write section
+// overlapped, so a multi-account read always sees whole transactions and
+// never makes the writer wait.
+//
+// Accounts live in an open-addressing table of atomics. When it grows the
+// old table is retired but kept until destruction, since a reader may still
+// be probing it.
+class BalanceTable {
+public:
+    BalanceTable();
+    ~BalanceTable();
+    BalanceTable(const BalanceTable&) = delete;
+    BalanceTable& operator=(const BalanceTable&) = delete;
+
+    // Writer side.
+    void beginWrite();
+    void set(int accNo, double balance);
+    void erase(int accNo);
+    void endWrite();
+
+    // Reader side, any thread.
+    bool read(int accNo, double &balance) const;
+    // All or nothing: false if any account is missing.
+    bool readMany(const int* accNos, size_t n, double* balances, uint64_t* version = nullptr) const;
+    // Point-in-time copy of every balance. Under constant writes the
+    // optimistic copy keeps getting invalidated, so after a few attempts the
+    // request is handed to the writer, which copies at its next endWrite().
+    std::shared_ptr<const BalanceSnapshot> snapshot() const;
+
+    uint64_t version() const { return seq.load(std::memory_order_acquire) / 2; }
+    uint64_t readRetries() const { return retries.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<int32_t> key;
+        std::atomic<uint64_t> bits;               // the double's bit pattern
+    };
+
+    struct Table {
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+        explicit Table(size_t capacity);
+    };
+
+    std::atomic<uint64_t> seq{0};                 // odd while a write is in progress
+    std::atomic<Table*> current{nullptr};
+    std::vector<std::unique_ptr<Table>> tables;   // current and retired
+    size_t live = 0;
+    size_t used = 0;                              // live + tombstones
+
+    mutable std::atomic<uint64_t> retries{0};
+    mutable std::atomic<uint64_t> snapshotRequests{0};
+    std::atomic<uint64_t> snapshotsServed{0};
+    mutable std::mutex handoffMutex;              // guards `served` only
+    std::shared_ptr<const BalanceSnapshot> served;
+
+    Slot* findForWrite(int accNo, Slot** freeSlot);
+    void grow();
+    bool tryCopy(BalanceSnapshot &out) const;
+    void serveSnapshot();
+};
+
+#endif // BALANCE_TABLE_H
@@ -2,16 +2,42 @@
 #define BANKING_H
 
 #include "account.h"
+#include "account_tier.h"
+#include "balance_table.h"
 #include "transaction.h"
 #include "queue.h"
 #include "stack.h"
+#include <cstdint>
+#include <ctime>
+#include <iosfwd>
+#include <memory>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 
 using TransactionQueue = Queue<Transaction>;
 using TransactionStack = Stack<Transaction>;
 
+
+// One batch taken off the pending queue by Banking::processNetted(), in
+// queue order, with each transaction's outcome.
+struct NettedBatch {
+    std::vector<Transaction> txns;
+    std::vector<char> applied;
+    std::vector<double> balances;        // sender's balance right after each
+};
+
+// What one partition holds, for the conservation check across partitions
+// (see partition.h). Sums are in whole cents so they add up exactly.
+struct PartitionTotals {
+    size_t accounts = 0;
+    int64_t balanceCents = 0;
+    size_t openHolds = 0;
+    int64_t heldCents = 0;               // taken by HOLD, not yet settled or refunded
+    int lastTransferId = 0;              // highest transfer id any leg has used
+};
+
 class Banking {
 private:
     std::vector<Account> accounts;       // List of all accounts
@@ -20,28 +46,173 @@ private:
     TransactionStack undoStack;          // For redo functionality
     int nextAccountNumber = 1001;        // Auto-incrementing account number
 
+    std::unordered_map<int, size_t> accountIndex;                    // accNo -> position in accounts
+    std::unordered_map<int, int> accountAges;                        // for the minor daily limit
+    std::unordered_map<int, std::vector<std::time_t>> minorTxnTimes; // minors' recent transactions
+    BalanceTable published;                                          // balances for lock-free readers
+    std::unique_ptr<AccountTier> tier;                               // replaces `accounts` when set
+    std::vector<int> evicted;
+
+    // applyNetted() scratch, kept between batches for its allocations.
+    struct NetSlot {
+        Account* account;                // nullptr: no such account
+        double balance;                  // running balance through the batch
+        bool minor;
+        bool touched;
+    };
+    std::unordered_map<int, uint32_t> netIndex;
+    std::vector<NetSlot> netSlots;
+
+    // Legs of transfers between partitions, by transfer id: the holds taken
+    // out of this partition's accounts and the transfers paid into them.
+    // Finished ids are kept so a repeated leg is recognised.
+    enum HoldState : uint8_t { HOLD_OPEN, HOLD_SETTLED, HOLD_REFUNDED };
+    struct EscrowHold {
+        int accNo;
+        double amount;
+        std::time_t timestamp;           // the HOLD's, to take its aggregates back out
+        HoldState state;
+    };
+    std::unordered_map<int, EscrowHold> holds;
+    std::unordered_map<int, int> credits;    // transfer id -> account credited
+    int lastTransferId = 0;
+    uint64_t appliedWalLsn = 0;              // last WAL record the loaded snapshot covers
+    bool deferring = false;                  // see deferPublishing()
+    std::vector<int> deferred;               // accounts changed since it began
+
     
     Account* findAccount(int accNo);
+    void rebuildIndex();
+    void publish(const Account* a, const Account* b = nullptr);
+    void publishAll();
+    void trimTier();
+    void addLoadedAccount(int accNo, const std::string &name, double balance, int age);
+    void setAccountAge(int accNo, int age);
+    int accountAge(int accNo) const;
+    uint32_t netSlot(int accNo);
+    size_t cleanupOldTransactions(int accNo);
+    bool canRecordTransaction(int accNo);
+
+    // `record` adds the transaction to the accounts' aggregates on success;
+    // undo applies the inverse with it off and removes the original instead.
+    bool applyDeposit(const Transaction &t, bool checkLimits, bool record);
+    bool applyWithdraw(const Transaction &t, bool checkLimits, bool record);
+    bool applyTransfer(const Transaction &t, bool checkLimits, bool record);
+    bool applyMetered(const Transaction &t, bool record);
+    Transaction dequeueTransaction();
+    bool applyEscrowLeg(const Transaction &t, bool checkLimits);
+    bool revertEscrowLeg(const Transaction &t);
+    void writeEscrow(std::ostream &out) const;
+    bool parseEscrowLine(const std::string &line);
+    bool saveEscrowToFile(const std::string &filename) const;
+    bool loadEscrowFromFile(const std::string &filename);
+
+    // fn(const Account&) for every account, resident or not.
+    template <typename Fn>
+    void forEachAccount(Fn fn, bool withAggregates = true) const {
+        if (tier) tier->forEach(fn, withAggregates);
+        else for (const auto &a : accounts) fn(a);
+    }
+
+    friend class ReplayEngine;
 
 public:
     
     Account* createAccount(const std::string &name, double balance, int age = 18);
     bool deleteAccount(int accNo);
     void displayAllAccounts() const;
+    const Account* getAccount(int accNo) const;
+    size_t accountCount() const;
+    const AccountAggregates* getAggregates(int accNo) const;
 
-    
+    // Safe from any thread while another thread is applying transactions:
+    // readers never block the writer and always see whole transactions.
+    // With an account table open, accounts that are not resident are read
+    // from their rows and the snapshot covers resident accounts only.
+    bool readBalance(int accNo, double &balance) const;
+    bool readBalances(const std::vector<int> &accNos, std::vector<double> &balances) const;
+    std::shared_ptr<const BalanceSnapshot> snapshotBalances() const;
+    // While on, changed balances are held back from readers; turning it off
+    // publishes them in one write section. GroupCommitter holds a batch
+    // back until its WAL write is durable, so no reader sees a balance that
+    // a failed fsync or a crash could take back.
+    void deferPublishing(bool on);
+
+    // Accounts file, plus "<filename>.agg" holding the aggregates. The file
+    // also carries the snapshot's WAL LSN and the escrow holds and credits
+    // on '#' lines, and is replaced atomically.
     bool saveAccountsToFile(const std::string &filename);
     bool loadAccountsFromFile(const std::string &filename);
+    bool saveAggregatesToFile(const std::string &filename) const;
+    bool loadAggregatesFromFile(const std::string &filename);
+
+    // Serve accounts from an account table instead of holding them all:
+    // at most `budgetBytes` of them stay resident, the rest are faulted in
+    // on first use and evicted (written back to the table) when cold.
+    // Replaces any accounts already loaded.
+    bool openAccountTable(const std::string &path, size_t budgetBytes);
+    // Checkpoints every changed account and the escrow state into the
+    // table as of appliedLsn(); see AccountTier::checkpoint.
+    bool flushAccountTable();
+    // With a WAL, changed accounts must stay resident until a checkpoint:
+    // a row written back early would be applied again by recovery.
+    // tableCheckpointDue() says the budget is exhausted by such accounts.
+    void holdTableChanges(bool hold);
+    bool tableCheckpointDue() const;
+    // Writes every account to a fresh table, e.g. to build one from an
+    // accounts file. Not for the table currently open.
+    bool saveAccountTable(const std::string &path) const;
+    bool tiered() const { return tier != nullptr; }
+    // The last WAL record reflected in the snapshot that was loaded, or that
+    // the next save or flush will record; recovery skips up to it.
+    uint64_t appliedLsn() const { return appliedWalLsn; }
+    void setAppliedLsn(uint64_t lsn) { appliedWalLsn = lsn; }
+    // Loads an account from the table ahead of its first request; false
+    // when there is no table or no room left in the budget.
+    bool prefetchAccount(int accNo);
+    TierStats tierStats() const;
 
     
     bool deposit(int accNo, double amount);
     bool withdraw(int accNo, double amount);
     bool transfer(int fromAcc, int toAcc, double amount);
 
+    // Applies one transaction without building a status message or touching
+    // the undo history. Used by replay and other bulk paths.
+    bool applyTransaction(const Transaction &t, bool checkLimits = true);
+
+    // Reverses a transaction applied earlier: the inverse balance change,
+    // and its counts and sums come back out of the aggregates.
+    bool revertTransaction(const Transaction &t, bool checkLimits = false);
+
+    // Makes a transaction applied through applyTransaction() undoable, once
+    // the caller has decided it is final (e.g. after it is durable). Escrow
+    // legs are never undoable; the router settles or refunds them instead.
+    void recordCompleted(const Transaction &t);
+
+    // Escrow legs, applied through applyTransaction() like any other
+    // transaction: HOLD takes the amount out of an account, CREDIT pays it
+    // into one (on the other partition), SETTLE closes the hold once the
+    // credit is durable and REFUND pays it back instead. A leg repeated with
+    // the same transfer id succeeds without changing anything again.
+    PartitionTotals totals() const;
+
+    // Applies n transactions in order with exactly the outcome, one by one,
+    // that applyTransaction() would give each, but looks every account up
+    // once, carries its balance through the batch and writes and publishes
+    // it once at the end. Fills applied[i] and balances[i] (the sender's
+    // balance right after txns[i]); returns how many were applied.
+    size_t applyNetted(const Transaction* txns, size_t n, std::vector<char> &applied,
+                       std::vector<double> &balances, bool checkLimits = true);
+
     
     bool enqueueTransaction(const Transaction &t);
     bool processNextTransaction(std::string &outMsg);
-    void processAllTransactions();
+    // Takes up to maxBatch transactions off the queue and applies them with
+    // applyNetted(); the applied ones become undoable one at a time, just as
+    // if processNextTransaction() had run on each. Returns how many applied.
+    size_t processNetted(NettedBatch &batch, size_t maxBatch = 4096);
+    void processAllTransactions(bool net = false);
     bool undoLast(std::string &outMsg);
     bool redoLast(std::string &outMsg);
 
@@ -52,4 +223,16 @@ public:
     bool canPerformTransaction(int accNo) const; 
 };
 
+
+// Status line for a processed transaction, e.g. "Deposited 100 to Acc 1001".
+std::string describeTransaction(const Transaction &t, bool success);
+
+// The transaction that undoes `t` (a withdrawal for a deposit, the reverse
+// transfer for a transfer).
+Transaction inverseOf(const Transaction &t);
+
+// Adds (sign 1) or removes (sign -1) an applied transaction from the
+// transaction counts and aggregates of the accounts it touched.
+void recordAggregates(const Transaction &t, Account* from, Account* to, int sign);
+
 #endif // BANKING_H
@@ -0,0 +1,89 @@
+#ifndef DURABLE_H
+#define DURABLE_H
+
+#include <cstdio>
+#include <string>
+#include "metrics.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// Flushes a file that has already been written and closed to stable storage.
+// ofstream gives no access to the descriptor, so the file is reopened here.
+inline bool syncFile(const std::string &path) {
+    METRICS_SCOPE(timer, MetricOp::Fsync);
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_RDWR);
+    if (fd < 0) { METRICS_SET_OK(timer, false); return false; }
+    bool ok = _commit(fd) == 0;
+    _close(fd);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { METRICS_SET_OK(timer, false); return false; }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+#endif
+    METRICS_SET_OK(timer, ok);
+    return ok;
+}
+
+
+// Flushes an already-open descriptor; data-only where the platform allows.
+inline bool syncFd(int fd) {
+    METRICS_SCOPE(timer, MetricOp::Fsync);
+#ifdef _WIN32
+    bool ok = _commit(fd) == 0;
+#elif defined(__linux__)
+    bool ok = ::fdatasync(fd) == 0;
+#else
+    bool ok = ::fsync(fd) == 0;
+#endif
+    METRICS_SET_OK(timer, ok);
+    return ok;
+}
+
+
+// Syncs the directory holding `path`, which makes a rename or unlink of it
+// durable.
+inline bool syncParentDir(const std::string &path) {
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+
+// Renames a file that has already been written and synced over `to`, so
+// readers see either the old file or the new one, even after a crash.
+inline bool replaceFile(const std::string &from, const std::string &to) {
+#ifdef _WIN32
+    std::remove(to.c_str());
+#endif
+    return std::rename(from.c_str(), to.c_str()) == 0 && syncParentDir(to);
+}
+
+
+// Cuts a partially written tail off a log after a failed append.
+inline bool truncateFd(int fd, long long size) {
+#ifdef _WIN32
+    return _chsize_s(fd, size) == 0;
+#else
+    return ::ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+#endif // DURABLE_H
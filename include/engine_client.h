@@ -0,0 +1,43 @@
+#ifndef ENGINE_CLIENT_H
+#define ENGINE_CLIENT_H
+
+#include <string>
+#include <vector>
+#include "protocol.h"
+
+
+// Blocking client for EngineServer. send() only buffers; flush() writes
+// everything buffered, so a caller can pipeline many requests per syscall
+// and collect the responses with receive().
+class EngineClient {
+public:
+    EngineClient() = default;
+    ~EngineClient();
+    EngineClient(const EngineClient&) = delete;
+    EngineClient& operator=(const EngineClient&) = delete;
+
+    bool connectUnix(const std::string &path);
+    bool connectTcp(const std::string &host, int port);
+    void close();
+    bool connected() const { return fd >= 0; }
+
+    void send(const WireRequest &req);
+    bool flush();
+    bool receive(WireResponse &resp, std::string* payload = nullptr);
+
+    // One request, one response; only valid with nothing else in flight.
+    bool call(const WireRequest &req, WireResponse &resp, std::string* payload = nullptr);
+
+private:
+    int fd = -1;
+    std::string outBuf;
+    std::vector<char> inBuf;
+    size_t inPos = 0;
+
+    bool readAtLeast(size_t n);
+};
+
+
+WireRequest makeRequest(uint32_t requestId, WireOp op, int accNo = 0, int targetAcc = 0, double amount = 0.0);
+
+#endif // ENGINE_CLIENT_H
@@ -0,0 +1,119 @@
+#ifndef ENGINE_SERVER_H
+#define ENGINE_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "banking.h"
+#include "group_commit.h"
+#include "ledger_history.h"
+#include "protocol.h"
+
+
+struct ServerOptions {
+    std::string unixPath;            // empty = no Unix socket
+    int tcpPort = 0;                 // 0 = no TCP listener
+    std::string tcpHost = "127.0.0.1";
+    bool readOnly = false;           // reject writes with STATUS_READ_ONLY
+    bool checkLimits = true;         // only used when there is no GroupCommitter
+};
+
+
+// Single-threaded epoll loop serving the binary protocol over Unix and TCP
+// sockets. Reads are answered inline. Writes go to the GroupCommitter when
+// one is given and are answered when it acknowledges them; the commit
+// thread hands completions back through an eventfd. Reads that need the
+// commit thread's bank lock (aggregates, totals) run on a reader thread and
+// come back the same way, so a checkpoint holding that lock stalls only
+// them. Without a committer, everything is answered inline and writes are
+// not durable.
+class EngineServer {
+public:
+    EngineServer(Banking &bank, GroupCommitter* committer, const ServerOptions &opts);
+    ~EngineServer();
+
+    bool start();                    // bind, listen and set up epoll
+    void run();                      // serve until stop()
+    void stop();                     // safe from other threads and signal handlers
+
+    void setReadOnly(bool value) { readOnly.store(value, std::memory_order_relaxed); }
+    // Sealed segments answering OP_HISTORY; must outlive the server.
+    void setHistory(const LedgerHistory* h) { history = h; }
+    // Runs on OP_PROMOTE; when it returns true the server starts taking
+    // writes. Without one, OP_PROMOTE is rejected.
+    void setPromoteHandler(std::function<bool()> fn) { promote = std::move(fn); }
+    const std::string& lastError() const { return error; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::vector<char> in;
+        std::string out;
+        size_t outPos = 0;
+        bool wantWrite = false;
+    };
+
+    struct Completion {
+        uint64_t connId;
+        WireResponse response;
+        std::string payload;
+    };
+
+    // Fills in the response and its payload; runs under the bank lock.
+    using LockedRead = std::function<void(WireResponse&, std::string&)>;
+
+    struct PendingRead {
+        uint64_t connId;
+        WireResponse response;
+        LockedRead read;
+    };
+
+    Banking &bank;
+    GroupCommitter* committer;
+    const LedgerHistory* history = nullptr;
+    std::function<bool()> promote;
+    ServerOptions opts;
+    std::atomic<bool> readOnly;
+    std::string error;
+
+    int epollFd = -1;
+    int wakeFd = -1;                 // eventfd: stop requests and completions
+    int unixFd = -1;
+    int tcpFd = -1;
+    std::atomic<bool> stopping{false};
+
+    uint64_t nextConnId = 1;                    // 0 and the top ids tag non-connection fds
+    std::unordered_map<uint64_t, Connection> connections;
+
+    std::mutex completionMutex;
+    std::vector<Completion> completions;
+
+    std::thread reader;                         // only with a committer
+    std::mutex readMutex;
+    std::condition_variable readCv;
+    std::vector<PendingRead> reads;
+    bool readerStopping = false;
+
+    bool listenUnix();
+    bool listenTcp();
+    void acceptAll(int listenFd);
+    void onReadable(uint64_t connId);
+    void onWritable(uint64_t connId);
+    void handleRequest(uint64_t connId, Connection &conn, const WireRequest &req);
+    void queueResponse(Connection &conn, const WireResponse &resp, const std::string &payload = "");
+    void flush(uint64_t connId, Connection &conn);
+    void complete(uint64_t connId, const WireResponse &resp, std::string payload = "");
+    void drainCompletions();
+    void readLocked(uint64_t connId, Connection &conn, const WireResponse &resp, LockedRead read);
+    void runReader();
+    void closeConnection(uint64_t connId);
+    void updateInterest(Connection &conn, uint64_t connId);
+};
+
+#endif // ENGINE_SERVER_H
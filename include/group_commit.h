@@ -0,0 +1,129 @@
+#ifndef GROUP_COMMIT_H
+#define GROUP_COMMIT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "banking.h"
+
+
+struct GroupCommitOptions {
+    std::chrono::microseconds maxWait{1000};  // how long the first request of a batch may wait
+    size_t maxBatch = 256;                    // commit as soon as this many are pending
+    std::string walPath;                      // transactions.txt-format log; empty = not durable
+    bool checkLimits = true;
+    bool net = false;                         // apply each batch with Banking::applyNetted()
+    uint64_t startLsn = 0;                    // LSN of the last record before this run's first
+    bool undoHistory = false;                 // make committed transactions undoable (unbounded)
+};
+
+
+struct CommitResult {
+    bool ok = false;          // applied and durable
+    double balance = 0.0;     // balance of t.accNo after the batch applied it
+    uint64_t lsn = 0;         // position of the record in the log, 1-based; 0 if rejected
+};
+
+
+struct GroupCommitStats {
+    uint64_t batches = 0;
+    uint64_t records = 0;     // records submitted
+    uint64_t committed = 0;   // records applied and logged
+    uint64_t walFailures = 0;
+    uint64_t replicated = 0;  // records taken from a primary's log
+    uint64_t diverged = 0;    // replicated records this engine rejected
+};
+
+
+// Coalesces concurrently submitted transactions into batches. Each batch is
+// applied to the Banking instance, appended to the WAL with one write and
+// one fsync, and only then published to lock-free readers and acknowledged
+// request by request. A failed WAL
+// write rolls the batch back and fails every request in it. With an account
+// table, the batch that fills its budget with changes checkpoints the table
+// and restarts the WAL after it.
+class GroupCommitter {
+public:
+    using Callback = std::function<void(const CommitResult&)>;
+    // Sees every durable batch as the WAL lines it appended and the LSN of
+    // the last one, in LSN order, on whichever thread committed it.
+    using LogHook = std::function<void(const std::string &walLines, uint64_t lastLsn)>;
+
+    GroupCommitter(Banking &bank, const GroupCommitOptions &opts);
+    ~GroupCommitter();
+
+    bool start();
+    void stop();                              // commits what is pending, then joins
+
+    // `done` runs on the commit thread once the request is durable.
+    void submit(const Transaction &t, Callback done);
+    std::future<CommitResult> submit(const Transaction &t);
+
+    // Set before start().
+    void setLogHook(LogHook hook) { logHook = std::move(hook); }
+
+    // Applies records shipped from a primary's WAL, without limit checks as
+    // recovery does, and logs them here under the same LSNs. Every line takes
+    // an LSN even if this engine rejects it, so the logs stay aligned. False,
+    // with nothing applied, if the WAL write fails.
+    bool applyReplicated(const std::string &walLines);
+
+    // Held by the commit thread while it mutates `bank`; other threads take
+    // it to read consistent balances.
+    std::mutex& bankMutex() { return stateMutex; }
+
+    GroupCommitStats stats() const;
+    uint64_t committedLsn() const { return lsn.load(std::memory_order_acquire); }
+    std::string lastError() const;
+
+private:
+    struct Pending {
+        Transaction t;
+        Callback done;
+    };
+
+    Banking &bank;
+    GroupCommitOptions opts;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::vector<Pending> pending;
+    bool stopping = false;
+    bool running = false;
+
+    mutable std::mutex stateMutex;           // also guards `error`
+    std::mutex logMutex;                      // one WAL append at a time
+    LogHook logHook;
+    std::thread worker;
+    std::FILE* wal = nullptr;
+    std::string error;
+
+    std::atomic<uint64_t> lsn{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> committed{0};
+    std::atomic<uint64_t> walFailures{0};
+    std::atomic<uint64_t> replicated{0};
+    std::atomic<uint64_t> diverged{0};
+
+    void run();
+    void commitBatch(std::vector<Pending> &batch, std::string &walBuffer);
+    bool appendWal(const std::string &walBuffer);
+    void checkpointTable(uint64_t at);
+};
+
+
+// Replaces the WAL at `path` with one holding only its "#lsn" header, so
+// the next record is lsn + 1. Used once a snapshot covers everything up to
+// lsn; the new file is synced before it is renamed into place.
+bool resetWal(const std::string &path, uint64_t lsn);
+
+#endif // GROUP_COMMIT_H
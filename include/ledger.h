@@ -0,0 +1,53 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "transaction.h"
+
+
+// One row of a per-user ledger file ("<username>_transactions.txt").
+// Named apart from the engine's Transaction (transaction.h) so both can be
+// used from the same translation unit.
+struct LedgerEntry {
+    std::string type;
+    double amount;
+    double balanceAfter;
+    std::string date;
+};
+
+
+std::string currentDateTime();
+
+void saveTransactionsToFile(const std::string& username, const std::vector<LedgerEntry>& transactions);
+std::vector<LedgerEntry> loadTransactionsFromFile(const std::string& username);
+
+double getBalance(const std::vector<LedgerEntry>& transactions);
+void printMiniStatement(const std::vector<LedgerEntry>& transactions);
+
+
+// Fixed-width binary form of an engine transaction, 40 bytes in host byte
+// order. Used for binary ledgers that are replayed or scanned in bulk.
+struct LedgerRecord {
+    int64_t timestamp;
+    int32_t accNo;
+    int32_t targetAcc;
+    double amount;
+    double balanceAfter;
+    uint8_t type;          // TransactionType
+    uint8_t reserved[7];
+};
+static_assert(sizeof(LedgerRecord) == 40, "LedgerRecord layout is part of the file format");
+
+// LedgerRecord::type as the enum; a byte that names no type is UNKNOWN.
+inline TransactionType ledgerType(uint8_t type) {
+    return type <= REFUND ? static_cast<TransactionType>(type) : UNKNOWN;
+}
+
+LedgerRecord toLedgerRecord(const Transaction& t, double balanceAfter = 0.0);
+Transaction fromLedgerRecord(const LedgerRecord& r);
+
+bool writeLedgerRecords(const std::string& path, const std::vector<LedgerRecord>& records, bool append = false);
+
+#endif // LEDGER_H
@@ -0,0 +1,50 @@
+#ifndef LEDGER_HISTORY_H
+#define LEDGER_HISTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "segment.h"
+
+
+// Account history served from sealed ledger segments. open() reads only
+// each segment's footer and block index; blocks are decoded the first time
+// a query reaches them, newest first, so recent history is cheap and a
+// cold start does no history work at all. Queries are const and safe from
+// any thread.
+class LedgerHistory {
+public:
+    // Oldest segment first.
+    bool open(const std::vector<std::string> &segmentPaths);
+    void close();
+
+    size_t segmentCount() const { return segments.size(); }
+    uint64_t records() const;
+    uint64_t blocksDecoded() const { return decoded.load(std::memory_order_relaxed); }
+
+    // The last `n` records that touched accNo, as sender or transfer
+    // target, oldest first.
+    bool lastRecords(int accNo, size_t n, std::vector<LedgerRecord> &out) const;
+    // Distinct accounts in the newest records, most recently active first.
+    bool recentAccounts(size_t limit, std::vector<int> &out) const;
+
+    const std::string& lastError() const { return error; }
+
+private:
+    std::vector<std::unique_ptr<SegmentReader>> segments;
+    mutable std::atomic<uint64_t> decoded{0};
+    std::string error;
+
+    // Calls fn(record) newest first until it returns false.
+    template <typename Fn>
+    bool walkBackward(Fn fn) const;
+};
+
+
+// One line per record, for the CLI and the server's HISTORY op.
+std::string describeHistory(const std::vector<LedgerRecord> &records);
+
+#endif // LEDGER_HISTORY_H
@@ -0,0 +1,128 @@
+#ifndef LEDGER_VIEW_H
+#define LEDGER_VIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "ledger.h"
+#include "transaction.h"
+#include "TransactionList.h"
+
+
+// Views that TransactionList can render without first copying the ledger
+// into a std::vector of string-bearing rows.
+
+
+// Any pair of bidirectional iterators, e.g. a slice of a larger container.
+template <typename It>
+struct LedgerRange {
+    It first;
+    It last;
+
+    It begin() const { return first; }
+    It end() const { return last; }
+};
+
+template <typename It>
+LedgerRange<It> makeLedgerRange(It first, It last) {
+    return LedgerRange<It>{first, last};
+}
+
+
+// Read-only mmap of a binary ledger (LedgerRecord rows). Pages are faulted
+// in on access, so a last-N statement only reads the tail of the file. A
+// trailing partial record is ignored.
+class MappedLedger {
+public:
+    MappedLedger() = default;
+    ~MappedLedger();
+    MappedLedger(const MappedLedger&) = delete;
+    MappedLedger& operator=(const MappedLedger&) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return fd >= 0; }
+
+    const LedgerRecord* begin() const { return records; }
+    const LedgerRecord* end() const { return records + count; }
+    size_t size() const { return count; }
+    const LedgerRecord& operator[](size_t i) const { return records[i]; }
+
+    const std::string& lastError() const { return error; }
+
+private:
+    int fd = -1;
+    void* base = nullptr;
+    size_t mappedBytes = 0;
+    const LedgerRecord* records = nullptr;
+    size_t count = 0;
+    std::string error;
+};
+
+
+// Struct-of-arrays ledger: one column per field, so scans that touch only
+// accNo or amount stream through a single dense array.
+class LedgerColumns {
+public:
+    // Rows are assembled from the columns on access; nothing is stored.
+    struct Row {
+        TransactionType type;
+        int accNo;
+        int targetAcc;
+        double amount;
+        double balanceAfter;
+        int64_t timestamp;
+    };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Row;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Row;
+
+        const_iterator() = default;
+        const_iterator(const LedgerColumns* cols, size_t pos) : cols(cols), pos(pos) {}
+
+        Row operator*() const { return (*cols)[pos]; }
+        const_iterator& operator++() { ++pos; return *this; }
+        const_iterator& operator--() { --pos; return *this; }
+        const_iterator operator++(int) { const_iterator old = *this; ++pos; return old; }
+        const_iterator operator--(int) { const_iterator old = *this; --pos; return old; }
+        bool operator==(const const_iterator &o) const { return pos == o.pos; }
+        bool operator!=(const const_iterator &o) const { return pos != o.pos; }
+
+    private:
+        const LedgerColumns* cols = nullptr;
+        size_t pos = 0;
+    };
+
+    std::vector<int64_t> timestamps;
+    std::vector<int32_t> accNos;
+    std::vector<int32_t> targetAccs;
+    std::vector<double> amounts;
+    std::vector<double> balances;
+    std::vector<uint8_t> types;
+
+    void reserve(size_t n);
+    void append(const LedgerRecord &r);
+    size_t size() const { return accNos.size(); }
+
+    Row operator[](size_t i) const {
+        return Row{ledgerType(types[i]), accNos[i], targetAccs[i], amounts[i], balances[i], timestamps[i]};
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+};
+
+
+// LedgerRecord stores its type as a raw byte; render it like the enum.
+inline std::string get_type_as_string(const LedgerRecord& r) {
+    return typeToStr(ledgerType(r.type));
+}
+
+#endif // LEDGER_VIEW_H
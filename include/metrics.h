@@ -0,0 +1,152 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Operations tracked by the engine. Keep metricOpName() in sync.
+enum class MetricOp {
+    Deposit,
+    Withdraw,
+    Transfer,
+    ProcessNext,
+    ProcessNetted,
+    LoadAccounts,
+    SaveAccounts,
+    LoadLedger,
+    SaveLedger,
+    Fsync,
+    GroupCommit,
+    ReplicationLag,   // primary commit to follower apply, per shipped batch
+    CrossTransfer,    // router: a transfer between partitions, hold to settle
+    Count
+};
+
+const char* metricOpName(MetricOp op);
+
+
+// HDR-style log-linear histogram over nanoseconds: values are bucketed by
+// their highest set bit and then split into SUB_BUCKETS linear slots, which
+// keeps relative error under 1/SUB_BUCKETS at every magnitude.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int MAJOR_BUCKETS = 64 - SUB_BITS + 1;
+    static constexpr int BUCKETS = MAJOR_BUCKETS * SUB_BUCKETS;
+
+    void record(uint64_t ns);
+    void mergeInto(std::array<uint64_t, BUCKETS> &out) const;
+    void absorb(const LatencyHistogram &other);    // owner or lock holder only
+    void reset();
+
+    static int bucketFor(uint64_t ns);
+    static uint64_t bucketUpperBound(int bucket);
+
+private:
+    // Written only by the owning thread; relaxed atomics let the reader
+    // merge without tearing or taking a lock on the hot path.
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+};
+
+
+// Per-thread block of counters. When its thread exits, a shard is folded
+// into one kept for exited threads and freed, so a reader still sees what
+// they recorded.
+struct MetricsShard {
+    static constexpr size_t OPS = static_cast<size_t>(MetricOp::Count);
+
+    std::array<std::atomic<uint64_t>, OPS> calls{};
+    std::array<std::atomic<uint64_t>, OPS> failures{};
+    std::array<std::atomic<uint64_t>, OPS> timed{};      // calls with a latency
+    std::array<std::atomic<uint64_t>, OPS> totalNs{};
+    std::array<std::atomic<uint64_t>, OPS> maxNs{};
+    std::array<LatencyHistogram, OPS> latency;
+    std::atomic<uint64_t> limitRejections{0};
+};
+
+
+class Metrics {
+public:
+    // Sampled timers read the clock for one call in SAMPLE_EVERY; two
+    // clock reads would otherwise cost more than a deposit.
+    static constexpr uint64_t SAMPLE_EVERY = 16;
+
+    static void record(MetricOp op, uint64_t ns, bool ok = true);
+    // record() in two halves, for ScopedTimer: countCall() says whether to
+    // time the call, finishCall() takes its outcome and latency.
+    static bool countCall(MetricOp op, bool sampled);
+    static void finishCall(MetricOp op, bool ok, bool timed, uint64_t ns);
+    static void limitRejected();
+
+    // Queue depth is a single shared gauge; it is updated by whichever
+    // thread owns the queue, so plain relaxed stores are enough.
+    static void queueDepth(size_t depth);
+    // Records a follower has yet to apply, as of the primary's last frame.
+    static void replicaBehind(uint64_t records);
+
+    // Merges every shard into a plain-text report, one metric per line.
+    static std::string snapshot();
+    static void reset();
+
+private:
+    static MetricsShard& local();
+};
+
+
+// Counts the enclosing scope and records how it went on destruction. A
+// sampled timer only times one call in Metrics::SAMPLE_EVERY.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(MetricOp op, bool sampled = false)
+        : op(op), ok(true), timed(Metrics::countCall(op, sampled)) {
+        if (timed) start = std::chrono::steady_clock::now();
+    }
+
+    ~ScopedTimer() {
+        uint64_t ns = 0;
+        if (timed)
+            ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        Metrics::finishCall(op, ok, timed, ns);
+    }
+
+    void setOk(bool value) { ok = value; }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    MetricOp op;
+    bool ok;
+    bool timed;
+    std::chrono::steady_clock::time_point start;
+};
+
+
+// Build with -DBANKING_NO_METRICS to compile every probe out.
+#ifdef BANKING_NO_METRICS
+#define METRICS_SCOPE(var, op)
+#define METRICS_SAMPLED_SCOPE(var, op)
+#define METRICS_SET_OK(var, ok)
+#define METRICS_LIMIT_REJECTED()
+#define METRICS_QUEUE_DEPTH(depth)
+#define METRICS_REPLICATION_LAG(ns)
+#define METRICS_REPLICA_BEHIND(records)
+#define METRICS_CROSS_TRANSFER(ns, ok)
+#else
+#define METRICS_SCOPE(var, op) ScopedTimer var(op)
+#define METRICS_SAMPLED_SCOPE(var, op) ScopedTimer var(op, true)
+#define METRICS_SET_OK(var, ok) var.setOk(ok)
+#define METRICS_LIMIT_REJECTED() Metrics::limitRejected()
+#define METRICS_QUEUE_DEPTH(depth) Metrics::queueDepth(depth)
+#define METRICS_REPLICATION_LAG(ns) Metrics::record(MetricOp::ReplicationLag, ns)
+#define METRICS_REPLICA_BEHIND(records) Metrics::replicaBehind(records)
+#define METRICS_CROSS_TRANSFER(ns, ok) Metrics::record(MetricOp::CrossTransfer, ns, ok)
+#endif
+
+#endif // METRICS_H
@@ -0,0 +1,215 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "banking.h"
+#include "engine_client.h"
+#include "protocol.h"
+
+
+// Partitioned deployment: accounts are split by accNo across N engine
+// processes, each a plain `serve` over its own accounts file and WAL, and a
+// router sends every single-account request to the partition that owns the
+// account. A transfer between partitions runs as a saga of escrow legs,
+// each logged in the WAL of the partition it runs on:
+//
+//   HOLD    the sender's partition takes the amount out of the sender
+//   CREDIT  the receiver's partition pays it into the receiver
+//   SETTLE  the sender's partition closes the hold
+//   REFUND  instead of SETTLE when the credit is refused
+//
+// Every leg carries the transfer id and may be repeated, so a router that
+// stops part way re-drives its unfinished transfers from its TransferLog.
+// Account numbers are kept when accounts are split; partitions do not
+// create accounts.
+
+class PartitionMap {
+public:
+    PartitionMap() = default;                        // one partition
+
+    // "hash:N" (accNo mod N) or "range:B1,B2,..." (partition 0 owns
+    // accounts below B1, partition i those from Bi up to B(i+1)).
+    static bool parse(const std::string &spec, PartitionMap &out);
+    static PartitionMap hashed(size_t partitions);
+
+    size_t count() const { return bounds.empty() ? partitions : bounds.size() + 1; }
+    size_t owner(int accNo) const {
+        if (bounds.empty()) return static_cast<unsigned>(accNo) % partitions;
+        size_t p = 0;
+        while (p < bounds.size() && accNo >= bounds[p]) p++;
+        return p;
+    }
+    std::string describe() const;
+
+private:
+    size_t partitions = 1;
+    std::vector<int> bounds;                         // ascending; empty = hashed
+};
+
+
+// Writes "<prefix>.<i>" (and "<prefix>.<i>.agg") for every partition with
+// its lines of the accounts file and its aggregates. `totals` gets each
+// partition's account count and balance.
+bool splitAccountsFile(const std::string &path, const PartitionMap &map, const std::string &prefix,
+                       std::vector<PartitionTotals> &totals, std::string* error = nullptr);
+
+// OP_TOTALS payload: "key value" lines.
+std::string describeTotals(const PartitionTotals &t);
+bool parseTotals(const std::string &text, PartitionTotals &out);
+
+// Sums the partitions' totals. Balances plus open holds stay equal to what
+// the accounts held when they were split, moved only by deposits and
+// withdrawals. A transfer between its CREDIT and its SETTLE is counted on
+// both sides, so while holds are open the sum may be high by up to
+// heldCents and no more.
+PartitionTotals sumTotals(const std::vector<PartitionTotals> &parts);
+
+
+struct PendingTransfer {
+    int id = 0;
+    int from = 0;
+    int to = 0;
+    double amount = 0.0;
+};
+
+
+// The routers' record of transfers between partitions, and the source of
+// their ids, shared by every PartitionRouter in a process. A transfer's
+// "B id from to amount" line is synced before its HOLD is sent. The "D id"
+// line that finishes a settled transfer need not be, since the partitions
+// remember its legs; one for a refused or refunded transfer is synced
+// before the client hears, because a refused HOLD leaves no record and
+// re-driving it could move the money after all. Without a path nothing is
+// written, and a transfer cut off part way stays held until someone
+// settles or refunds it.
+class TransferLog {
+public:
+    TransferLog() = default;
+    ~TransferLog();
+    TransferLog(const TransferLog&) = delete;
+    TransferLog& operator=(const TransferLog&) = delete;
+
+    bool open(const std::string &path);
+    // Ids continue after the highest id any partition reports.
+    void observe(int lastTransferId);
+    // Gives each transfer an id and logs them all with one sync. On failure
+    // the lines are cut back off, or kept pending if that fails too.
+    bool begin(std::vector<PendingTransfer> &transfers);
+    // False only if `sync` was asked for and failed.
+    bool finish(const std::vector<int> &ids, bool sync);
+
+    std::vector<PendingTransfer> unfinished() const;
+    // Rewrites the log with only the unfinished transfers.
+    bool compact();
+    std::string lastError() const;
+
+private:
+    std::string path;
+    FILE* file = nullptr;
+    mutable std::mutex mutex;
+    int lastId = 0;
+    std::map<int, PendingTransfer> pending;
+    std::string error;
+};
+
+
+struct RouterStats {
+    uint64_t forwarded = 0;          // requests sent on to a single partition
+    uint64_t crossTransfers = 0;     // transfers run as a saga
+    uint64_t refunded = 0;           // ... whose credit was refused
+    uint64_t unresolved = 0;         // ... left in the log by a lost partition
+};
+
+
+// Routes requests over one connection per partition; one thread at a time.
+// execute() answers a whole pipeline in waves: a wave's requests are sent
+// to their owners all at once, and its transfers between partitions go
+// through the saga a leg at a time for the whole wave. Each account still
+// sees its requests in order.
+class PartitionRouter {
+public:
+    PartitionRouter(const PartitionMap &map, const std::vector<std::string> &sockets, TransferLog &log);
+
+    bool execute(const std::vector<WireRequest> &reqs, std::vector<WireResponse> &resps,
+                 std::vector<std::string>* payloads = nullptr);
+    bool call(const WireRequest &req, WireResponse &resp, std::string* payload = nullptr);
+
+    // Raises the log's ids past every partition's and re-drives the log's
+    // unfinished transfers. Run once, before any router takes requests.
+    bool recover(size_t* redriven = nullptr);
+    bool totals(std::vector<PartitionTotals> &out);
+
+    const PartitionMap& partitions() const { return map; }
+    const RouterStats& stats() const { return counters; }
+    const std::string& lastError() const { return error; }
+
+private:
+    struct Leg {
+        size_t partition;
+        WireRequest req;
+        WireResponse resp;
+        std::string payload;
+    };
+
+    PartitionMap map;
+    std::vector<std::string> sockets;
+    std::vector<std::unique_ptr<EngineClient>> clients;
+    TransferLog &log;
+    RouterStats counters;
+    std::string error;
+
+    bool crosses(const WireRequest &req) const {
+        return req.op == OP_TRANSFER && map.owner(req.accNo) != map.owner(req.targetAcc);
+    }
+    EngineClient* client(size_t partition);
+    bool exchange(std::vector<Leg> &legs);
+    bool runTransfers(const std::vector<PendingTransfer> &transfers, std::vector<WireResponse> &results,
+                      std::vector<Leg> &forward);
+};
+
+
+// `route`: the router as a process that clients talk to as if it were one
+// engine. Each connection gets a thread and a PartitionRouter of its own.
+// PING, STATS (the router's own metrics) and TOTALS (summed over the
+// partitions) are answered by the router.
+class RouterServer {
+public:
+    RouterServer(const PartitionMap &map, const std::vector<std::string> &sockets, TransferLog &log,
+                 const std::string &socketPath);
+    ~RouterServer();
+
+    bool start();
+    void run();                      // serve until stop()
+    void stop();                     // safe from other threads and signal handlers
+    const std::string& lastError() const { return error; }
+
+private:
+    PartitionMap map;
+    std::vector<std::string> sockets;
+    TransferLog &log;
+    std::string socketPath;
+    int listenFd = -1;
+    std::atomic<bool> stopping{false};
+    std::string error;
+
+    struct Worker {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    void serve(Worker &w);
+};
+
+#endif // PARTITION_H
@@ -0,0 +1,70 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary request protocol spoken by EngineServer. Frames are fixed-size,
+// packed and in host byte order (client and engine share a machine).
+// A client may send many requests before reading any response; every
+// response echoes its requestId, and writes may be answered after reads
+// that were sent later, so clients match responses by id.
+
+enum WireOp : uint8_t {
+    OP_PING = 0,
+    OP_DEPOSIT = 1,
+    OP_WITHDRAW = 2,
+    OP_TRANSFER = 3,
+    OP_BALANCE = 4,      // lock-free; sees a write only once its WAL record is durable
+    OP_STATS = 5,        // payload: Metrics::snapshot() text
+    OP_AGGREGATES = 6,   // payload: describeAggregates() text for accNo
+    OP_HISTORY = 7,      // payload: describeHistory() of accNo's last `amount` records (default 5)
+    OP_PROMOTE = 8,      // follower stops replicating and takes writes; lsn: where it took over
+    // Legs of a transfer between partitions (see partition.h); accNo is the
+    // account and targetAcc the transfer id. Sent by routers, not clients.
+    OP_HOLD = 9,
+    OP_CREDIT = 10,
+    OP_SETTLE = 11,
+    OP_REFUND = 12,
+    OP_TOTALS = 13,      // payload: describeTotals() text for the conservation check
+    OP_TRACE = 14,       // payload: Trace::chromeJson() of what the engine has recorded
+};
+
+enum WireStatus : uint8_t {
+    STATUS_OK = 0,
+    STATUS_REJECTED = 1,      // well-formed but refused (funds, limit, unknown account)
+    STATUS_BAD_REQUEST = 2,
+    STATUS_READ_ONLY = 3,     // write sent to an engine that does not accept writes
+    STATUS_UNAVAILABLE = 4,   // engine shutting down or log failure
+};
+
+// A write's amount must be finite and within [0, MAX_WIRE_AMOUNT]; anything
+// else is STATUS_BAD_REQUEST. OP_HISTORY returns at most MAX_HISTORY_RECORDS.
+static const double MAX_WIRE_AMOUNT = 1e12;
+static const size_t MAX_HISTORY_RECORDS = 10000;
+
+#pragma pack(push, 1)
+struct WireRequest {
+    uint32_t requestId;
+    uint8_t op;               // WireOp
+    uint8_t reserved[3];
+    int32_t accNo;
+    int32_t targetAcc;
+    double amount;
+};
+
+struct WireResponse {
+    uint32_t requestId;
+    uint8_t status;           // WireStatus
+    uint8_t reserved[3];
+    uint32_t payloadLen;      // bytes following this header
+    uint32_t reserved2;
+    double balance;           // balance of accNo after the request
+    uint64_t lsn;             // log position of a committed write, else 0
+};
+#pragma pack(pop)
+
+static_assert(sizeof(WireRequest) == 24, "WireRequest is part of the protocol");
+static_assert(sizeof(WireResponse) == 32, "WireResponse is part of the protocol");
+
+#endif // PROTOCOL_H
@@ -0,0 +1,71 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "banking.h"
+#include "ledger.h"
+
+
+struct ReplayOptions {
+    bool binary = false;             // LedgerRecord file instead of transactions.txt text
+    bool skipMessages = false;       // don't build/print per-record status lines
+    bool skipLimits = false;         // don't run the minor daily-limit check
+    size_t checkpointEvery = 0;      // 0 = never
+    std::string checkpointPath;
+    bool resume = false;             // start from checkpointPath if it exists
+    unsigned threads = 1;            // >1 applies disjoint accounts in parallel
+    uint64_t appliedLsn = 0;         // skip records up to this LSN (already in the snapshot)
+};
+
+
+struct ReplayStats {
+    uint64_t records = 0;            // records read in this run
+    uint64_t applied = 0;
+    uint64_t rejected = 0;
+    uint64_t malformed = 0;
+    uint64_t bytes = 0;              // ledger bytes consumed in this run
+    uint64_t resumedFrom = 0;        // records already covered by the checkpoint
+    uint64_t skipped = 0;            // records at or below opts.appliedLsn
+    uint64_t baseLsn = 0;            // from the ledger's "#lsn" header; 0 without one
+    uint64_t lastLsn = 0;            // LSN of the last record read (baseLsn if none)
+    size_t checkpoints = 0;
+    double seconds = 0.0;
+
+    double mbPerSec() const { return seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0.0; }
+    double recordsPerSec() const { return seconds > 0 ? records / seconds : 0.0; }
+};
+
+
+// Streams a ledger through a Banking instance as fast as the options allow.
+// Each record is applied with Banking's usual rules (positive amount,
+// sufficient balance, optional minor limit); rejected records are counted
+// and skipped, just as processNextTransaction would. Records are numbered
+// from the text ledger's "#lsn N" header line, if it has one (a WAL does),
+// so that the first is N + 1.
+class ReplayEngine {
+public:
+    ReplayEngine(Banking &bank, const ReplayOptions &opts);
+
+    bool run(const std::string &ledgerPath, ReplayStats &stats);
+    const std::string& lastError() const { return error; }
+
+private:
+    Banking &bank;
+    ReplayOptions opts;
+    std::string error;
+
+    void applySequential(const std::vector<Transaction> &window, ReplayStats &stats);
+    void applyParallel(const std::vector<Transaction> &window, ReplayStats &stats);
+
+    bool writeCheckpoint(uint64_t offset, uint64_t records, uint64_t baseLsn, uint64_t lastLsn);
+    bool loadCheckpoint(uint64_t &offset, uint64_t &records, uint64_t &baseLsn, uint64_t &lastLsn);
+};
+
+
+// Converts a transactions.txt-format ledger to LedgerRecords.
+bool convertTextLedgerToBinary(const std::string &textPath, const std::string &binaryPath);
+
+#endif // REPLAY_H
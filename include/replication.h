@@ -0,0 +1,165 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "group_commit.h"
+
+
+// Log shipping between a primary and hot-standby followers over a Unix
+// socket. A follower opens with the LSN it has applied; the primary sends
+// every committed WAL line after it, then each new batch as it commits, and
+// heartbeats while idle. The follower acknowledges its LSN after every
+// frame. Both ends count LSNs as WAL lines, so a follower must start from
+// a copy of the accounts file the primary's WAL applies to. Lag is measured
+// on the steady clock, so both ends must share a machine.
+
+enum ReplFrameKind : uint8_t {
+    REPL_RECORDS = 1,        // payload: WAL lines ending at `lsn`
+    REPL_HEARTBEAT = 2,
+    REPL_REFUSED = 3,        // payload: why; the primary closes the stream
+};
+
+#pragma pack(push, 1)
+struct ReplHello {
+    uint64_t appliedLsn;
+};
+
+struct ReplFrame {
+    uint8_t kind;            // ReplFrameKind
+    uint8_t reserved[3];
+    uint32_t payloadLen;
+    uint64_t lsn;            // last LSN in the payload; the primary's LSN otherwise
+    uint64_t primaryLsn;     // primary's committed LSN when the frame was sent
+    int64_t committedNs;     // steady clock when `lsn` committed on the primary
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ReplFrame) == 32, "ReplFrame is part of the replication protocol");
+
+
+struct FollowerInfo {
+    uint64_t ackedLsn = 0;
+    bool connected = false;
+};
+
+
+// Primary side. Keeps the most recent WAL lines in memory, one entry per
+// committed batch, up to `windowBytes`, and serves each follower from a
+// thread of its own. A follower that is, or falls, behind the window is
+// refused and must be re-seeded. Feed it from GroupCommitter::setLogHook().
+class LogShipper {
+public:
+    static const size_t DEFAULT_WINDOW_BYTES = size_t(64) << 20;
+
+    explicit LogShipper(const std::string &socketPath, size_t windowBytes = DEFAULT_WINDOW_BYTES)
+        : socketPath(socketPath), windowBytes(windowBytes) {}
+    ~LogShipper();
+    LogShipper(const LogShipper&) = delete;
+    LogShipper& operator=(const LogShipper&) = delete;
+
+    // Loads the WAL recovery replayed (may be empty or missing) so that
+    // followers behind it can catch up, then starts listening. `startLsn` is
+    // the LSN the committer continues from; records up to it that the WAL
+    // no longer holds are outside the window.
+    bool start(const std::string &walPath, uint64_t startLsn);
+    void stop();
+
+    void append(const std::string &walLines, uint64_t lastLsn);
+
+    uint64_t lsn() const;
+    std::vector<FollowerInfo> followers() const;
+    const std::string& lastError() const { return error; }
+
+private:
+    struct Batch {
+        uint64_t firstLsn;
+        uint64_t lastLsn;
+        size_t begin;        // offsets into `log`
+        size_t end;
+        int64_t committedNs;
+    };
+
+    struct Follower {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<uint64_t> acked{0};
+        std::atomic<bool> connected{true};
+    };
+
+    std::string socketPath;
+    size_t windowBytes;
+    int listenFd = -1;
+    std::thread acceptor;
+    std::string error;
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::string log;
+    std::deque<Batch> batches;
+    size_t logStart = 0;     // offset of the oldest batch still kept
+    uint64_t windowLsn = 0;  // last LSN no longer kept; followers need more
+    uint64_t lastLsn = 0;
+    bool stopping = false;
+    std::vector<std::unique_ptr<Follower>> followerList;
+
+    void dropOldBatches();
+    void acceptLoop();
+    void serve(Follower &f);
+};
+
+
+struct ReplicaStatus {
+    bool connected = false;
+    uint64_t appliedLsn = 0;
+    uint64_t primaryLsn = 0;
+    uint64_t frames = 0;
+    double lastLagMs = 0.0;          // primary commit to apply, latest batch
+    double meanLagMs = 0.0;
+    double maxLagMs = 0.0;
+
+    uint64_t behind() const { return primaryLsn > appliedLsn ? primaryLsn - appliedLsn : 0; }
+};
+
+
+// Follower side: streams the primary's log into a GroupCommitter with
+// applyReplicated(), reconnecting until stopped. Stopping is how a
+// follower is promoted: it keeps its state and LSN and can take writes.
+class ReplicaFollower {
+public:
+    explicit ReplicaFollower(GroupCommitter &committer) : committer(committer) {}
+    ~ReplicaFollower();
+    ReplicaFollower(const ReplicaFollower&) = delete;
+    ReplicaFollower& operator=(const ReplicaFollower&) = delete;
+
+    void start(const std::string &primaryPath);
+    void stop();
+    bool running() const { return worker.joinable(); }
+
+    ReplicaStatus status() const;
+    std::string lastError() const;
+
+private:
+    GroupCommitter &committer;
+    std::string primaryPath;
+    std::thread worker;
+    std::atomic<bool> stopping{false};
+    int fd = -1;                     // guarded by statusMutex
+
+    mutable std::mutex statusMutex;
+    ReplicaStatus current;
+    double totalLagMs = 0.0;
+    std::string error;
+
+    void run();
+    bool follow(int sock);
+};
+
+#endif // REPLICATION_H
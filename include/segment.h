@@ -0,0 +1,137 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "ledger.h"
+
+
+// Sealed ledger segments: LedgerRecords compressed in independent blocks.
+//
+//   "BTMSEG02" | block... | block index | SegmentFooter
+//
+// Each block starts with a SegmentBlockHeader followed by column sections:
+// a nibble per record (3-bit type, has-target bit), zigzag varint timestamp
+// deltas, varint account ids, varint target ids (only where present), and
+// amounts and balances as varint cents (falling back to the raw double when
+// a value is not a whole number of cents). Decoding is lossless except for
+// LedgerRecord::reserved, and a type byte above REFUND reads back as
+// UNKNOWN. "BTMSEG01" segments, whose nibbles held a 2-bit type and could
+// not carry escrow legs, are still read.
+
+static const size_t SEGMENT_BLOCK_RECORDS = 4096;
+static const int SEGMENT_VERSION = 2;
+
+struct SegmentBlockHeader {
+    uint32_t records;
+    uint32_t payloadBytes;           // everything after this header
+    int64_t baseTimestamp;           // first record's timestamp
+    uint32_t sectionBytes[5];        // timestamps, accounts, targets, amounts, balances
+    uint32_t reserved;
+};
+static_assert(sizeof(SegmentBlockHeader) == 40, "SegmentBlockHeader layout is part of the file format");
+
+struct SegmentBlockInfo {
+    uint64_t offset;                 // of the SegmentBlockHeader
+    uint32_t records;
+    uint32_t bytes;                  // header + payload
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+};
+static_assert(sizeof(SegmentBlockInfo) == 32, "SegmentBlockInfo layout is part of the file format");
+
+struct SegmentFooter {
+    uint64_t indexOffset;
+    uint64_t records;
+    uint32_t blockCount;
+    uint32_t blockRecords;
+    char magic[8];
+};
+static_assert(sizeof(SegmentFooter) == 32, "SegmentFooter layout is part of the file format");
+
+
+// Appends an encoded block (header + payload) for `n` records to `out`.
+void encodeSegmentBlock(const LedgerRecord* records, size_t n, std::string &out);
+// Decodes one block of a segment of the given version; `out` must have
+// room for header.records entries. Returns false on a truncated or corrupt
+// block.
+bool decodeSegmentBlock(const uint8_t* block, size_t bytes, LedgerRecord* out, int version = SEGMENT_VERSION);
+
+
+// Buffers records and writes one block per SEGMENT_BLOCK_RECORDS; seal()
+// flushes the last block, writes the index and footer and fsyncs.
+class SegmentWriter {
+public:
+    ~SegmentWriter();
+    bool open(const std::string &path);
+    bool append(const LedgerRecord &r);
+    bool seal();
+    const std::string& lastError() const { return error; }
+
+private:
+    std::FILE* file = nullptr;
+    std::string path;
+    uint64_t offset = 0;
+    uint64_t records = 0;
+    std::vector<LedgerRecord> pending;
+    std::vector<SegmentBlockInfo> index;
+    std::string encoded;
+    std::string error;
+
+    bool flushBlock();
+};
+
+
+// Read-only mmap of a sealed segment. open() only validates the footer and
+// loads the block index; blocks are decoded on demand.
+class SegmentReader {
+public:
+    SegmentReader() = default;
+    ~SegmentReader();
+    SegmentReader(const SegmentReader&) = delete;
+    SegmentReader& operator=(const SegmentReader&) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    uint64_t records() const { return totalRecords; }
+    uint64_t fileBytes() const { return mappedBytes; }
+    size_t blockCount() const { return index.size(); }
+    const SegmentBlockInfo& block(size_t i) const { return index[i]; }
+
+    bool readBlock(size_t i, std::vector<LedgerRecord> &out) const;
+
+    // Calls fn(const LedgerRecord&) for every record with a timestamp in
+    // [from, to], skipping blocks whose range lies outside it.
+    template <typename Fn>
+    bool scan(int64_t from, int64_t to, Fn fn) const {
+        std::vector<LedgerRecord> buf;
+        for (size_t i = 0; i < index.size(); i++) {
+            if (index[i].maxTimestamp < from || index[i].minTimestamp > to) continue;
+            if (!readBlock(i, buf)) return false;
+            for (const auto &r : buf)
+                if (r.timestamp >= from && r.timestamp <= to) fn(r);
+        }
+        return true;
+    }
+
+    const std::string& lastError() const { return error; }
+
+private:
+    int fd = -1;
+    const uint8_t* base = nullptr;
+    size_t mappedBytes = 0;
+    int version = SEGMENT_VERSION;
+    uint64_t totalRecords = 0;
+    std::vector<SegmentBlockInfo> index;
+    std::string error;
+};
+
+
+// Binary ledger (LedgerRecord file) <-> sealed segment.
+bool sealLedgerSegment(const std::string &binaryPath, const std::string &segmentPath, std::string* error = nullptr);
+bool unsealLedgerSegment(const std::string &segmentPath, const std::string &binaryPath, std::string* error = nullptr);
+
+#endif // SEGMENT_H
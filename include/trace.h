@@ -0,0 +1,98 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Pipeline tracing: scoped spans recorded per thread and dumped as Chrome
+// trace-event JSON (chrome://tracing, ui.perfetto.dev). Nothing is recorded
+// until Trace::start(); a span point costs one relaxed load until then.
+
+
+// One finished span. Names and categories must be string literals; only
+// the pointers are kept.
+struct TraceEvent {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<const char*> category{nullptr};
+    std::atomic<uint64_t> startNs{0};
+    std::atomic<uint64_t> durationNs{0};
+};
+
+
+// The last `capacity` spans of one thread. Only the owning thread writes
+// and it never waits; a dump copies the ring while it is being written and
+// drops whatever the writer lapped in the meantime. Rings are registered
+// once and never freed.
+struct TraceRing {
+    explicit TraceRing(size_t capacity) : events(new TraceEvent[capacity]), capacity(capacity) {}
+
+    std::unique_ptr<TraceEvent[]> events;
+    const size_t capacity;
+    std::atomic<uint64_t> written{0};              // spans ever recorded
+    std::atomic<const char*> threadName{nullptr};
+    uint32_t tid = 0;
+};
+
+
+class Trace {
+public:
+    static constexpr size_t DEFAULT_SPANS = size_t(1) << 16;
+
+    // Recording covers spans that begin after start(); stop() keeps what
+    // was recorded for a later dump. Threads that have not traced yet get
+    // rings of `spansPerThread`.
+    static void start(size_t spansPerThread = DEFAULT_SPANS);
+    static void stop();
+    static bool enabled() { return recording.load(std::memory_order_relaxed); }
+
+    static uint64_t now();                         // ns on the trace clock
+    static void record(const char* name, const char* category, uint64_t startNs, uint64_t endNs);
+    static void nameThread(const char* name);
+
+    // {"traceEvents": [...]} with one complete ("X") event per span and a
+    // thread_name record per named thread.
+    static std::string chromeJson();
+    static bool writeChromeJson(const std::string &path);
+
+private:
+    static std::atomic<bool> recording;
+    static TraceRing& local();
+};
+
+
+// Records the enclosing scope as a span if tracing was on when it began.
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category)
+        : name(name), category(category), start(Trace::enabled() ? Trace::now() : 0) {}
+
+    ~TraceScope() {
+        if (start != 0) Trace::record(name, category, start, Trace::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    uint64_t start;
+};
+
+
+// Build with -DBANKING_NO_TRACE to compile every trace point out.
+#ifdef BANKING_NO_TRACE
+#define TRACE_SCOPE(name, category)
+#define TRACE_THREAD_NAME(name)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name, category) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, category)
+#define TRACE_THREAD_NAME(name) Trace::nameThread(name)
+#endif
+
+#endif // TRACE_H
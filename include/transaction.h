@@ -2,18 +2,32 @@
 #define TRANSACTION_H
 
 #include <string>
+#include <sstream>
+#include <stdexcept>
 #include <ctime>
 #include <queue>
 #include <vector>
 
 
-enum TransactionType { DEPOSIT, WITHDRAW, TRANSFER, UNKNOWN };
+// HOLD..REFUND are the legs of a transfer between partitions (see
+// partition.h): accNo is the account and targetAcc the transfer id. They
+// sit after UNKNOWN so the ledger formats' type bytes keep their values.
+enum TransactionType { DEPOSIT, WITHDRAW, TRANSFER, UNKNOWN, HOLD, CREDIT, SETTLE, REFUND };
+
+
+inline bool isEscrowLeg(TransactionType t) {
+    return t >= HOLD && t <= REFUND;
+}
 
 
 inline TransactionType strToType(const std::string &s) {
     if (s == "DEPOSIT") return DEPOSIT;
     if (s == "WITHDRAW") return WITHDRAW;
     if (s == "TRANSFER") return TRANSFER;
+    if (s == "HOLD") return HOLD;
+    if (s == "CREDIT") return CREDIT;
+    if (s == "SETTLE") return SETTLE;
+    if (s == "REFUND") return REFUND;
     return UNKNOWN;
 }
 
@@ -23,6 +37,10 @@ inline std::string typeToStr(TransactionType t) {
         case DEPOSIT: return "DEPOSIT";
         case WITHDRAW: return "WITHDRAW";
         case TRANSFER: return "TRANSFER";
+        case HOLD: return "HOLD";
+        case CREDIT: return "CREDIT";
+        case SETTLE: return "SETTLE";
+        case REFUND: return "REFUND";
         default: return "UNKNOWN";
     }
 }
@@ -42,6 +60,36 @@ struct Transaction {
 };
 
 
+// Parses one line of a batch file: "TYPE|accNo|amount" or "TRANSFER|from|to|amount"
+// ("HOLD|accNo|transferId|amount" and the other escrow legs likewise). WAL
+// lines add "|timestamp"; lines without one are stamped now.
+inline bool parseTransactionLine(const std::string &line, Transaction &out) {
+    std::stringstream ss(line);
+    std::string typeStr, first, second, third, fourth;
+    if (!std::getline(ss, typeStr, '|') || !std::getline(ss, first, '|') ||
+        !std::getline(ss, second, '|')) return false;
+    std::getline(ss, third, '|');
+    std::getline(ss, fourth, '|');
+
+    TransactionType type = strToType(typeStr);
+    if (type == UNKNOWN) return false;
+    try {
+        const std::string* stamp = &third;
+        if (type == TRANSFER || isEscrowLeg(type)) {
+            if (third.empty()) return false;
+            out = Transaction(type, std::stoi(first), std::stoi(second), std::stod(third));
+            stamp = &fourth;
+        } else {
+            out = Transaction(type, std::stoi(first), 0, std::stod(second));
+        }
+        if (!stamp->empty()) out.timestamp = static_cast<std::time_t>(std::stoll(*stamp));
+    } catch (const std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+
 class DailyTransactionTracker {
 private:
     std::queue<std::time_t> transactionTimes;  
@@ -0,0 +1,50 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "banking.h"
+#include "ledger_history.h"
+
+
+// Faults accounts into a Banking instance backed by an account table on a
+// background thread, a batch at a time under the mutex its writer holds,
+// so warm-up never keeps a request waiting for more than one batch. Stops
+// early once the account cache is full rather than evict anything.
+class AccountWarmer {
+public:
+    AccountWarmer(Banking &bank, std::mutex &bankMutex) : bank(bank), bankMutex(bankMutex) {}
+    ~AccountWarmer();
+    AccountWarmer(const AccountWarmer&) = delete;
+    AccountWarmer& operator=(const AccountWarmer&) = delete;
+
+    void start(std::vector<int> accNos, size_t batch = 256);
+    // Warms the `accounts` most recently active in `history`, which must
+    // outlive the warm-up; picking them is done on the worker too.
+    void start(const LedgerHistory &history, size_t accounts, size_t batch = 256);
+    void wait();
+    void stop();
+
+    bool done() const { return finished.load(std::memory_order_acquire); }
+    size_t warmed() const { return count.load(std::memory_order_relaxed); }
+    double seconds() const;          // from start() to done
+
+private:
+    Banking &bank;
+    std::mutex &bankMutex;
+    std::thread worker;
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> finished{false};
+    std::atomic<size_t> count{0};
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::duration elapsed{};
+
+    void launch(std::function<std::vector<int>()> pick, size_t batch);
+};
+
+#endif // WARMUP_H
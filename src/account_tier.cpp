@@ -0,0 +1,552 @@
+#include "account_tier.h"
+#include "durable.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char TABLE_MAGIC[8] = {'B', 'T', 'M', 'A', 'C', 'C', 'T', '2'};
+static const char REDO_MAGIC[8] = {'B', 'T', 'M', 'R', 'E', 'D', 'O', '1'};
+static const size_t INDEX_NODE_BYTES = 48;    // unordered_map node and bucket, roughly
+
+
+// "<table>.redo" holds one checkpoint: a RedoHeader, a RedoEntry per
+// changed account followed by its encoded aggregates, then the escrow text.
+struct RedoHeader {
+    char magic[8];
+    uint64_t lsn;
+    uint64_t entries;
+    uint64_t escrowBytes;
+};
+
+struct RedoEntry {
+    int32_t accNo;
+    int32_t age;
+    int32_t transactionCount;
+    uint32_t aggBytes;
+    uint64_t balanceBits;
+};
+
+
+static inline uint64_t toBits(double v) {
+    uint64_t b;
+    std::memcpy(&b, &v, sizeof b);
+    return b;
+}
+
+
+static inline double fromBits(uint64_t b) {
+    double v;
+    std::memcpy(&v, &b, sizeof v);
+    return v;
+}
+
+
+static std::string encodedAggregates(const Account &a) {
+    std::string out;
+    a.aggregates.encode(out);
+    return out;
+}
+
+
+// Writes `target` beside itself, syncs it and renames it into place.
+static bool writeWholeFile(const std::string &target, const void* const parts[], const size_t sizes[], int n) {
+    std::string tmp = target + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = true;
+    for (int i = 0; i < n && ok; i++)
+        ok = sizes[i] == 0 || std::fwrite(parts[i], 1, sizes[i], f) == sizes[i];
+    ok = ok && std::fflush(f) == 0 && syncFd(fileno(f));
+    ok = std::fclose(f) == 0 && ok;
+    return ok && replaceFile(tmp, target);
+}
+
+
+static bool readWholeFile(const std::string &path, std::string &out) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buf[1 << 16];
+    size_t got;
+    out.clear();
+    while ((got = std::fread(buf, 1, sizeof buf, f)) > 0) out.append(buf, got);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    return ok;
+}
+
+
+// Both files are written beside their targets and renamed into place, the
+// .aggs file first so the new table never points into an old one.
+bool writeAccountTable(const std::string &path, std::vector<Account> accounts, uint64_t appliedLsn) {
+    std::sort(accounts.begin(), accounts.end(),
+              [](const Account &a, const Account &b) { return a.accNo < b.accNo; });
+
+    std::vector<AccountTableRow> rows(accounts.size());
+    std::string names, aggs;
+    for (size_t i = 0; i < accounts.size(); i++) {
+        const Account &a = accounts[i];
+        AccountTableRow &r = rows[i];
+        r = AccountTableRow{};
+        r.accNo = a.accNo;
+        r.age = a.age;
+        r.transactionCount = a.transactionCount;
+        r.balanceBits = toBits(a.balance);
+        r.nameOffset = names.size();
+        r.nameBytes = static_cast<uint32_t>(a.name.size());
+        names += a.name;
+        if (!a.aggregates.empty()) {
+            std::string encoded = encodedAggregates(a);
+            r.aggOffset = aggs.size();
+            r.aggBytes = static_cast<uint32_t>(encoded.size());
+            aggs += encoded;
+        }
+    }
+
+    AccountTableHeader h{};
+    std::memcpy(h.magic, TABLE_MAGIC, sizeof h.magic);
+    h.rows = h.liveRows = rows.size();
+    h.nameBytes = names.size();
+    h.appliedLsn = appliedLsn;
+
+    const void* const aggParts[] = {aggs.data()};
+    const size_t aggSizes[] = {aggs.size()};
+    const void* const tableParts[] = {&h, rows.data(), names.data()};
+    const size_t tableSizes[] = {sizeof h, rows.size() * sizeof(AccountTableRow), names.size()};
+    return writeWholeFile(path + ".aggs", aggParts, aggSizes, 1) && writeWholeFile(path, tableParts, tableSizes, 3);
+}
+
+
+AccountTier::~AccountTier() {
+    close();
+}
+
+
+bool AccountTier::open(const std::string &tablePath, size_t budgetBytes) {
+    close();
+    path = tablePath;
+    budget = budgetBytes;
+
+    fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat st{};
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(AccountTableHeader)) {
+        error = path + " is not an account table";
+        close();
+        return false;
+    }
+
+    void* m = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        error = "cannot map " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    base = static_cast<uint8_t*>(m);
+    mappedBytes = size;
+    header = reinterpret_cast<AccountTableHeader*>(base);
+    if (std::memcmp(header->magic, TABLE_MAGIC, sizeof TABLE_MAGIC) != 0 ||
+        sizeof(AccountTableHeader) + header->rows * sizeof(AccountTableRow) + header->nameBytes != size) {
+        error = path + " is not an account table";
+        close();
+        return false;
+    }
+    rows = reinterpret_cast<AccountTableRow*>(base + sizeof(AccountTableHeader));
+    rowCount = header->rows;
+    liveRows = header->liveRows;
+    names = reinterpret_cast<const char*>(rows + rowCount);
+
+    aggFd = ::open((path + ".aggs").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    off_t end = aggFd >= 0 ? ::lseek(aggFd, 0, SEEK_END) : -1;
+    if (end < 0) {
+        error = "cannot open " + path + ".aggs: " + std::strerror(errno);
+        close();
+        return false;
+    }
+    aggEnd = static_cast<uint64_t>(end);
+
+    std::string redo;
+    if (readWholeFile(path + ".redo", redo) && !applyRedo(redo)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+// Writes back every changed resident account in place and syncs the table,
+// when closing a table whose rows need not match a WAL.
+bool AccountTier::flush() {
+    if (!base) return true;
+    bool ok = true;
+    for (auto &e : slots)
+        if (e && e->dirty && e->row >= 0) ok = writeBack(*e) && ok;
+    ok = ::msync(base, mappedBytes, MS_SYNC) == 0 && ok;
+    ok = syncFd(aggFd) && ok;
+    if (!ok) error = "failed to flush " + path;
+    return ok;
+}
+
+
+// The redo file is complete before anything else is touched, so whatever
+// happens after it is renamed into place, open() can finish the job.
+bool AccountTier::checkpoint(uint64_t lsn, const std::string &escrow) {
+    if (!base) return true;
+    std::string redo(sizeof(RedoHeader), '\0');
+    std::vector<Entry*> written;
+    for (auto &e : slots) {
+        if (!e || !e->dirty || e->row < 0) continue;
+        const Account &a = e->account;
+        std::string encoded;
+        if (!a.aggregates.empty()) encoded = encodedAggregates(a);
+        RedoEntry r{a.accNo, a.age, a.transactionCount, static_cast<uint32_t>(encoded.size()), toBits(a.balance)};
+        redo.append(reinterpret_cast<const char*>(&r), sizeof r);
+        redo += encoded;
+        written.push_back(e.get());
+    }
+    RedoHeader h{};
+    std::memcpy(h.magic, REDO_MAGIC, sizeof h.magic);
+    h.lsn = lsn;
+    h.entries = written.size();
+    h.escrowBytes = escrow.size();
+    std::memcpy(&redo[0], &h, sizeof h);
+    redo += escrow;
+
+    const void* const parts[] = {redo.data()};
+    const size_t sizes[] = {redo.size()};
+    if (!writeWholeFile(path + ".redo", parts, sizes, 1)) {
+        error = "cannot write " + path + ".redo: " + std::strerror(errno);
+        return false;
+    }
+    if (!applyRedo(redo)) return false;
+    for (Entry* e : written) e->dirty = false;
+    counters.writebacks += written.size();
+    counters.checkpoints++;
+    heldBytes = 0;
+    return true;
+}
+
+
+// Storing a row image is idempotent, so a checkpoint cut short by a crash
+// is simply applied again.
+bool AccountTier::applyRedo(const std::string &redo) {
+    const std::string redoPath = path + ".redo";
+    RedoHeader h;
+    bool whole = redo.size() >= sizeof h;
+    if (whole) std::memcpy(&h, redo.data(), sizeof h);
+    if (!whole || std::memcmp(h.magic, REDO_MAGIC, sizeof h.magic) != 0) {
+        error = redoPath + " is not a checkpoint";
+        return false;
+    }
+    size_t at = sizeof h;
+    for (uint64_t i = 0; i < h.entries && whole; i++) {
+        RedoEntry r;
+        whole = redo.size() - at >= sizeof r;
+        if (!whole) break;
+        std::memcpy(&r, redo.data() + at, sizeof r);
+        at += sizeof r;
+        whole = redo.size() - at >= r.aggBytes;
+        if (!whole) break;
+        int64_t row = findRow(r.accNo);
+        if (row >= 0 && !storeRow(rows[row], r.age, r.transactionCount, r.balanceBits, redo.data() + at, r.aggBytes))
+            return false;
+        at += r.aggBytes;
+    }
+    if (!whole || redo.size() - at != h.escrowBytes) {
+        error = redoPath + " is truncated";
+        return false;
+    }
+
+    const std::string escrowPath = path + ".escrow";
+    const void* const parts[] = {redo.data() + at};
+    const size_t sizes[] = {static_cast<size_t>(h.escrowBytes)};
+    bool ok = h.escrowBytes > 0 ? writeWholeFile(escrowPath, parts, sizes, 1)
+                                : (std::remove(escrowPath.c_str()) == 0 || errno == ENOENT) && syncParentDir(escrowPath);
+    ok = ok && ::msync(base, mappedBytes, MS_SYNC) == 0 && syncFd(aggFd);
+    if (ok) {
+        header->appliedLsn = h.lsn;
+        ok = ::msync(base, sizeof(AccountTableHeader), MS_SYNC) == 0;
+    }
+    ok = ok && std::remove(redoPath.c_str()) == 0 && syncParentDir(redoPath);
+    if (!ok) error = "failed to checkpoint " + path + ": " + std::strerror(errno);
+    return ok;
+}
+
+
+void AccountTier::close() {
+    if (base) {
+        if (!holdDirty) flush();
+        ::munmap(base, mappedBytes);
+    }
+    if (fd >= 0) ::close(fd);
+    if (aggFd >= 0) ::close(aggFd);
+    fd = aggFd = -1;
+    base = nullptr;
+    header = nullptr;
+    rows = nullptr;
+    names = nullptr;
+    mappedBytes = 0;
+    rowCount = liveRows = aggEnd = 0;
+    unbacked = 0;
+    slots.clear();
+    freeSlots.clear();
+    resident.clear();
+    hand = 0;
+    residentBytes = 0;
+    heldBytes = 0;
+    counters = TierStats();
+}
+
+
+int64_t AccountTier::findRow(int accNo) const {
+    const AccountTableRow* end = rows + rowCount;
+    const AccountTableRow* r = std::lower_bound(static_cast<const AccountTableRow*>(rows), end, accNo,
+        [](const AccountTableRow &row, int key) { return row.accNo < key; });
+    if (r == end || r->accNo != accNo || (r->flags & ROW_DELETED)) return -1;
+    return r - rows;
+}
+
+
+bool AccountTier::loadRow(const AccountTableRow &row, Account &out, bool withAggregates) const {
+    out = Account(row.accNo, std::string(names + row.nameOffset, row.nameBytes),
+                  fromBits(__atomic_load_n(&row.balanceBits, __ATOMIC_RELAXED)), row.age);
+    out.transactionCount = row.transactionCount;
+    if (!withAggregates || row.aggBytes == 0) return true;
+
+    std::string encoded(row.aggBytes, '\0');
+    if (::pread(aggFd, &encoded[0], encoded.size(), static_cast<off_t>(row.aggOffset)) != static_cast<ssize_t>(encoded.size()))
+        return false;
+    return AccountAggregates::decode(encoded.data(), encoded.size(), out.aggregates);
+}
+
+
+// What an entry costs while resident: the entry, its index node, and the
+// heap behind the name and the aggregate buckets.
+void AccountTier::recharge(Entry &e) {
+    const Account &a = e.account;
+    size_t bytes = sizeof(Entry) + INDEX_NODE_BYTES;
+    if (a.name.capacity() > 15) bytes += a.name.capacity() + 1;
+    bytes += (a.aggregates.days().capacity() + a.aggregates.months().capacity()) * sizeof(AggregateBucket);
+    residentBytes = residentBytes - e.bytes + bytes;
+    e.bytes = bytes;
+}
+
+
+uint32_t AccountTier::place(std::unique_ptr<Entry> e) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        slots[slot] = std::move(e);
+    } else {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.push_back(std::move(e));
+    }
+    Entry &placed = *slots[slot];
+    resident[placed.account.accNo] = slot;
+    recharge(placed);
+    return slot;
+}
+
+
+Account* AccountTier::find(int accNo) {
+    auto it = resident.find(accNo);
+    if (it != resident.end()) {
+        Entry &e = *slots[it->second];
+        e.referenced = true;
+        counters.hits++;
+        return &e.account;
+    }
+
+    int64_t row = findRow(accNo);
+    if (row < 0) return nullptr;
+    std::unique_ptr<Entry> e(new Entry());
+    if (!loadRow(rows[row], e->account, true)) {
+        error = "cannot read aggregates of account " + std::to_string(accNo) + " from " + path + ".aggs";
+        return nullptr;
+    }
+    e->row = row;
+    counters.misses++;
+    return &slots[place(std::move(e))]->account;
+}
+
+
+bool AccountTier::prefetch(int accNo) {
+    if (resident.count(accNo)) return true;
+    if (residentBytes >= budget) return false;
+    int64_t row = findRow(accNo);
+    if (row < 0) return true;
+    std::unique_ptr<Entry> e(new Entry());
+    if (!loadRow(rows[row], e->account, true)) return true;
+    e->row = row;
+    e->referenced = false;
+    counters.prefetched++;
+    place(std::move(e));
+    return true;
+}
+
+
+Account* AccountTier::insert(const Account &a) {
+    if (resident.count(a.accNo) || findRow(a.accNo) >= 0) return nullptr;
+    std::unique_ptr<Entry> e(new Entry());
+    e->account = a;
+    e->dirty = true;
+    unbacked++;
+    return &slots[place(std::move(e))]->account;
+}
+
+
+bool AccountTier::erase(int accNo) {
+    bool found = false;
+    auto it = resident.find(accNo);
+    if (it != resident.end()) {
+        uint32_t slot = it->second;
+        Entry &e = *slots[slot];
+        if (e.row < 0) unbacked--;
+        residentBytes -= e.bytes;
+        resident.erase(it);
+        slots[slot].reset();
+        freeSlots.push_back(slot);
+        found = true;
+    }
+    int64_t row = findRow(accNo);
+    if (row >= 0) {
+        rows[row].flags |= ROW_DELETED;
+        header->liveRows = --liveRows;
+        found = true;
+    }
+    return found;
+}
+
+
+int AccountTier::maxAccNo() const {
+    int highest = 0;
+    if (rowCount) highest = rows[rowCount - 1].accNo;
+    for (const auto &e : slots)
+        if (e && e->row < 0) highest = std::max(highest, e->account.accNo);
+    return highest;
+}
+
+
+bool AccountTier::readColdBalance(int accNo, double &balance) const {
+    int64_t row = findRow(accNo);
+    if (row < 0) return false;
+    balance = fromBits(__atomic_load_n(&rows[row].balanceBits, __ATOMIC_ACQUIRE));
+    return true;
+}
+
+
+bool AccountTier::coldAge(int accNo, int &age) const {
+    int64_t row = findRow(accNo);
+    if (row < 0) return false;
+    age = rows[row].age;
+    return true;
+}
+
+
+void AccountTier::markDirty(int accNo) {
+    auto it = resident.find(accNo);
+    if (it == resident.end()) return;
+    Entry &e = *slots[it->second];
+    e.dirty = true;
+    recharge(e);
+}
+
+
+void AccountTier::markAllDirty() {
+    for (auto &e : slots) {
+        if (!e) continue;
+        e->dirty = true;
+        recharge(*e);
+    }
+}
+
+
+// The balance is stored last so a concurrent readColdBalance() never sees
+// it ahead of the row being current.
+bool AccountTier::storeRow(AccountTableRow &row, int32_t age, int32_t transactionCount, uint64_t balanceBits,
+                           const char* agg, size_t aggBytes) {
+    row.age = age;
+    row.transactionCount = transactionCount;
+    if (aggBytes == 0) {
+        row.aggBytes = 0;
+    } else {
+        // Bucket counts only grow up to the kept window, so most write-backs
+        // fit over the previous blob.
+        bool fits = row.aggBytes >= aggBytes;
+        uint64_t at = fits ? row.aggOffset : aggEnd;
+        if (::pwrite(aggFd, agg, aggBytes, static_cast<off_t>(at)) != static_cast<ssize_t>(aggBytes)) {
+            error = "cannot write to " + path + ".aggs: " + std::strerror(errno);
+            return false;
+        }
+        row.aggOffset = at;
+        row.aggBytes = static_cast<uint32_t>(aggBytes);
+        if (!fits) aggEnd += aggBytes;
+    }
+    __atomic_store_n(&row.balanceBits, balanceBits, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+bool AccountTier::writeBack(Entry &e) {
+    const Account &a = e.account;
+    std::string encoded;
+    if (!a.aggregates.empty()) encoded = encodedAggregates(a);
+    if (!storeRow(rows[e.row], a.age, a.transactionCount, toBits(a.balance), encoded.data(), encoded.size()))
+        return false;
+    e.dirty = false;
+    counters.writebacks++;
+    return true;
+}
+
+
+void AccountTier::trim(std::vector<int> &evicted) {
+    // Nothing more can go until a checkpoint writes the held changes.
+    if (checkpointDue()) return;
+    heldBytes = 0;
+    // Two sweeps are enough: the first clears every reference bit.
+    size_t sweep = 2 * slots.size();
+    while (residentBytes > budget && sweep-- > 0) {
+        if (hand >= slots.size()) hand = 0;
+        const uint32_t slot = static_cast<uint32_t>(hand++);
+        std::unique_ptr<Entry> &e = slots[slot];
+        if (!e || e->row < 0) continue;
+        if (e->referenced) {
+            e->referenced = false;
+            continue;
+        }
+        if (e->dirty) {
+            if (holdDirty) {
+                heldBytes += e->bytes;
+                continue;
+            }
+            if (!writeBack(*e)) continue;   // keep it rather than lose the change
+        }
+
+        evicted.push_back(e->account.accNo);
+        resident.erase(e->account.accNo);
+        residentBytes -= e->bytes;
+        e.reset();
+        freeSlots.push_back(slot);
+        counters.evictions++;
+    }
+}
+
+
+TierStats AccountTier::stats() const {
+    TierStats s = counters;
+    s.residentAccounts = resident.size();
+    s.residentBytes = residentBytes;
+    s.budgetBytes = budget;
+    return s;
+}
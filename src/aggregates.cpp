@@ -0,0 +1,225 @@
+#include "aggregates.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+
+static const char* SLOT_NAMES[AGG_SLOTS] = {"deposit", "withdraw", "transfer_out", "transfer_in"};
+
+
+int64_t AccountAggregates::dayKey(std::time_t ts) {
+    int64_t t = static_cast<int64_t>(ts);
+    return t >= 0 ? t / 86400 : (t - 86399) / 86400;
+}
+
+
+// Civil-from-days (proleptic Gregorian), so no gmtime call per transaction.
+int64_t AccountAggregates::monthKey(std::time_t ts) {
+    int64_t z = dayKey(ts) + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+    return year * 12 + month - 1;
+}
+
+
+static void applyTotals(TypeTotals &t, double amount, int sign) {
+    if (sign > 0) {
+        t.count++;
+        t.sum += amount;
+    } else if (t.count > 0) {
+        t.count--;
+        t.sum = t.count ? t.sum - amount : 0.0;   // no rounding residue on empty
+    }
+}
+
+
+// Buckets are ascending by key and almost every update hits the newest one.
+// Removals for a bucket that has already rolled off only touch lifetime.
+static void bump(std::vector<AggregateBucket> &buckets, int64_t key, int64_t kept,
+                 AggregateSlot slot, double amount, int sign) {
+    if (!buckets.empty() && buckets.back().key == key) {
+        applyTotals(buckets.back().slots[slot], amount, sign);
+        return;
+    }
+
+    auto byKey = [](const AggregateBucket &b, int64_t k) { return b.key < k; };
+    auto it = std::lower_bound(buckets.begin(), buckets.end(), key, byKey);
+    if (it != buckets.end() && it->key == key) {
+        applyTotals(it->slots[slot], amount, sign);
+        return;
+    }
+    if (sign < 0) return;
+    if (!buckets.empty() && key <= buckets.back().key - kept) return;
+
+    AggregateBucket fresh{};
+    fresh.key = key;
+    applyTotals(fresh.slots[slot], amount, sign);
+    buckets.insert(it, fresh);
+
+    int64_t oldest = buckets.back().key - kept;
+    auto keep = std::lower_bound(buckets.begin(), buckets.end(), oldest + 1, byKey);
+    buckets.erase(buckets.begin(), keep);
+}
+
+
+void AccountAggregates::update(AggregateSlot slot, double amount, std::time_t when, int sign) {
+    const int64_t day = dayKey(when);
+    if (day != cachedDay) {
+        cachedDay = day;
+        cachedMonth = monthKey(when);
+    }
+    applyTotals(lifetime[slot], amount, sign);
+    bump(daily, day, DAYS_KEPT, slot, amount, sign);
+    bump(monthly, cachedMonth, MONTHS_KEPT, slot, amount, sign);
+}
+
+
+static const AggregateBucket* findBucket(const std::vector<AggregateBucket> &buckets, int64_t key) {
+    for (auto it = buckets.rbegin(); it != buckets.rend(); ++it) {
+        if (it->key == key) return &*it;
+        if (it->key < key) break;
+    }
+    return nullptr;
+}
+
+
+TypeTotals AccountAggregates::onDay(int64_t day, AggregateSlot slot) const {
+    const AggregateBucket* b = findBucket(daily, day);
+    return b ? b->slots[slot] : TypeTotals{};
+}
+
+
+TypeTotals AccountAggregates::inMonth(int64_t month, AggregateSlot slot) const {
+    const AggregateBucket* b = findBucket(monthly, month);
+    return b ? b->slots[slot] : TypeTotals{};
+}
+
+
+uint64_t AccountAggregates::transactionCount() const {
+    uint64_t n = 0;
+    for (const auto &t : lifetime) n += t.count;
+    return n;
+}
+
+
+uint64_t AccountAggregates::countOnDay(int64_t day) const {
+    const AggregateBucket* b = findBucket(daily, day);
+    uint64_t n = 0;
+    if (b) for (const auto &t : b->slots) n += t.count;
+    return n;
+}
+
+
+uint64_t AccountAggregates::countInMonth(int64_t month) const {
+    const AggregateBucket* b = findBucket(monthly, month);
+    uint64_t n = 0;
+    if (b) for (const auto &t : b->slots) n += t.count;
+    return n;
+}
+
+
+bool AccountAggregates::empty() const {
+    for (const auto &t : lifetime)
+        if (t.count) return false;
+    return true;
+}
+
+
+static void writeSlots(std::ostream &out, const TypeTotals* slots) {
+    for (int s = 0; s < AGG_SLOTS; s++) out << ' ' << slots[s].count << ' ' << slots[s].sum;
+}
+
+
+void AccountAggregates::write(std::ostream &out, int accNo) const {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(17) << accNo << " L";
+    writeSlots(out, lifetime);
+    for (const auto &b : daily) {
+        out << " D " << b.key;
+        writeSlots(out, b.slots);
+    }
+    for (const auto &b : monthly) {
+        out << " M " << b.key;
+        writeSlots(out, b.slots);
+    }
+    out << '\n';
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+static bool readSlots(std::istream &in, TypeTotals* slots) {
+    for (int s = 0; s < AGG_SLOTS; s++)
+        if (!(in >> slots[s].count >> slots[s].sum)) return false;
+    return true;
+}
+
+
+bool AccountAggregates::parse(const std::string &line, int &accNo, AccountAggregates &out) {
+    std::istringstream in(line);
+    std::string tag;
+    out = AccountAggregates();
+    if (!(in >> accNo >> tag) || tag != "L" || !readSlots(in, out.lifetime)) return false;
+
+    while (in >> tag) {
+        AggregateBucket b{};
+        if ((tag != "D" && tag != "M") || !(in >> b.key) || !readSlots(in, b.slots)) return false;
+        (tag == "D" ? out.daily : out.monthly).push_back(b);
+    }
+    return true;
+}
+
+
+// lifetime slots | uint32 days | uint32 months | day buckets | month buckets
+void AccountAggregates::encode(std::string &out) const {
+    uint32_t counts[2] = {static_cast<uint32_t>(daily.size()), static_cast<uint32_t>(monthly.size())};
+    out.append(reinterpret_cast<const char*>(lifetime), sizeof lifetime);
+    out.append(reinterpret_cast<const char*>(counts), sizeof counts);
+    if (!daily.empty()) out.append(reinterpret_cast<const char*>(daily.data()), daily.size() * sizeof(AggregateBucket));
+    if (!monthly.empty()) out.append(reinterpret_cast<const char*>(monthly.data()), monthly.size() * sizeof(AggregateBucket));
+}
+
+
+bool AccountAggregates::decode(const char* data, size_t bytes, AccountAggregates &out) {
+    uint32_t counts[2];
+    const size_t fixed = sizeof out.lifetime + sizeof counts;
+    if (bytes < fixed) return false;
+    std::memcpy(&counts, data + sizeof out.lifetime, sizeof counts);
+    if (bytes != fixed + (static_cast<size_t>(counts[0]) + counts[1]) * sizeof(AggregateBucket)) return false;
+
+    out = AccountAggregates();
+    std::memcpy(out.lifetime, data, sizeof out.lifetime);
+    out.daily.resize(counts[0]);
+    out.monthly.resize(counts[1]);
+    const char* buckets = data + fixed;
+    if (counts[0]) std::memcpy(out.daily.data(), buckets, counts[0] * sizeof(AggregateBucket));
+    if (counts[1]) std::memcpy(out.monthly.data(), buckets + counts[0] * sizeof(AggregateBucket),
+                               counts[1] * sizeof(AggregateBucket));
+    return true;
+}
+
+
+std::string describeAggregates(const AccountAggregates &agg, std::time_t now) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    const int64_t day = AccountAggregates::dayKey(now);
+    const int64_t month = AccountAggregates::monthKey(now);
+    for (int s = 0; s < AGG_SLOTS; s++) {
+        AggregateSlot slot = static_cast<AggregateSlot>(s);
+        TypeTotals life = agg.total(slot), today = agg.onDay(day, slot), thisMonth = agg.inMonth(month, slot);
+        out << SLOT_NAMES[s]
+            << " lifetime_count=" << life.count << " lifetime_sum=" << life.sum
+            << " today_count=" << today.count << " today_sum=" << today.sum
+            << " month_count=" << thisMonth.count << " month_sum=" << thisMonth.sum << "\n";
+    }
+    out << "transactions today=" << agg.countOnDay(day) << " month=" << agg.countInMonth(month) << "\n";
+    return out.str();
+}
@@ -0,0 +1,234 @@
+#include "balance_table.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+
+static const int32_t EMPTY_KEY = INT32_MIN;
+static const int32_t TOMBSTONE_KEY = INT32_MIN + 1;
+static const size_t INITIAL_CAPACITY = 1024;
+static const int OPTIMISTIC_SNAPSHOT_ATTEMPTS = 8;
+
+
+static inline uint64_t toBits(double v) {
+    uint64_t b;
+    std::memcpy(&b, &v, sizeof b);
+    return b;
+}
+
+
+static inline double fromBits(uint64_t b) {
+    double v;
+    std::memcpy(&v, &b, sizeof v);
+    return v;
+}
+
+
+static inline size_t hashAcc(int accNo) {
+    return static_cast<size_t>(static_cast<uint32_t>(accNo) * 2654435761u);
+}
+
+
+bool BalanceSnapshot::find(int accNo, double &balance) const {
+    auto it = std::lower_bound(balances.begin(), balances.end(), std::make_pair(accNo, std::numeric_limits<double>::lowest()));
+    if (it == balances.end() || it->first != accNo) return false;
+    balance = it->second;
+    return true;
+}
+
+
+double BalanceSnapshot::total() const {
+    double sum = 0.0;
+    for (const auto &b : balances) sum += b.second;
+    return sum;
+}
+
+
+BalanceTable::Table::Table(size_t capacity) : mask(capacity - 1), slots(new Slot[capacity]) {
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].key.store(EMPTY_KEY, std::memory_order_relaxed);
+        slots[i].bits.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+BalanceTable::BalanceTable() {
+    tables.emplace_back(new Table(INITIAL_CAPACITY));
+    current.store(tables.back().get(), std::memory_order_release);
+}
+
+
+BalanceTable::~BalanceTable() = default;
+
+
+void BalanceTable::beginWrite() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+void BalanceTable::endWrite() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    if (snapshotRequests.load(std::memory_order_relaxed) != snapshotsServed.load(std::memory_order_relaxed))
+        serveSnapshot();
+}
+
+
+// Returns the slot holding accNo, or null with *freeSlot set to where it
+// would be inserted (the first tombstone on the probe path, else the empty
+// slot that ended it).
+BalanceTable::Slot* BalanceTable::findForWrite(int accNo, Slot** freeSlot) {
+    Table* t = current.load(std::memory_order_relaxed);
+    *freeSlot = nullptr;
+    for (size_t i = hashAcc(accNo) & t->mask, n = 0; n <= t->mask; i = (i + 1) & t->mask, n++) {
+        int32_t k = t->slots[i].key.load(std::memory_order_relaxed);
+        if (k == accNo) return &t->slots[i];
+        if (k == TOMBSTONE_KEY && !*freeSlot) *freeSlot = &t->slots[i];
+        if (k == EMPTY_KEY) {
+            if (!*freeSlot) *freeSlot = &t->slots[i];
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+
+void BalanceTable::grow() {
+    Table* old = current.load(std::memory_order_relaxed);
+    size_t capacity = old->mask + 1;
+    while (live * 4 > capacity) capacity *= 2;   // otherwise a same-size rehash drops tombstones
+
+    std::unique_ptr<Table> fresh(new Table(capacity));
+    for (size_t i = 0; i <= old->mask; i++) {
+        int32_t k = old->slots[i].key.load(std::memory_order_relaxed);
+        if (k == EMPTY_KEY || k == TOMBSTONE_KEY) continue;
+        size_t j = hashAcc(k) & fresh->mask;
+        while (fresh->slots[j].key.load(std::memory_order_relaxed) != EMPTY_KEY) j = (j + 1) & fresh->mask;
+        fresh->slots[j].bits.store(old->slots[i].bits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        fresh->slots[j].key.store(k, std::memory_order_relaxed);
+    }
+    used = live;
+    current.store(fresh.get(), std::memory_order_release);
+    tables.push_back(std::move(fresh));
+}
+
+
+void BalanceTable::set(int accNo, double balance) {
+    Slot* freeSlot;
+    if (Slot* s = findForWrite(accNo, &freeSlot)) {
+        s->bits.store(toBits(balance), std::memory_order_relaxed);
+        return;
+    }
+
+    Table* t = current.load(std::memory_order_relaxed);
+    if ((used + 1) * 2 > t->mask + 1) {
+        grow();
+        findForWrite(accNo, &freeSlot);
+    }
+    if (freeSlot->key.load(std::memory_order_relaxed) == EMPTY_KEY) used++;
+    live++;
+    freeSlot->bits.store(toBits(balance), std::memory_order_relaxed);
+    freeSlot->key.store(accNo, std::memory_order_relaxed);
+}
+
+
+void BalanceTable::erase(int accNo) {
+    Slot* freeSlot;
+    if (Slot* s = findForWrite(accNo, &freeSlot)) {
+        s->key.store(TOMBSTONE_KEY, std::memory_order_relaxed);
+        live--;
+    }
+}
+
+
+bool BalanceTable::readMany(const int* accNos, size_t n, double* balances, uint64_t* version) const {
+    for (;;) {
+        uint64_t before = seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            retries.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::yield();
+            continue;
+        }
+
+        const Table* t = current.load(std::memory_order_acquire);
+        bool all = true;
+        for (size_t a = 0; a < n && all; a++) {
+            bool found = false;
+            for (size_t i = hashAcc(accNos[a]) & t->mask, probes = 0; probes <= t->mask;
+                 i = (i + 1) & t->mask, probes++) {
+                int32_t k = t->slots[i].key.load(std::memory_order_relaxed);
+                if (k == EMPTY_KEY) break;
+                if (k == accNos[a]) {
+                    balances[a] = fromBits(t->slots[i].bits.load(std::memory_order_relaxed));
+                    found = true;
+                    break;
+                }
+            }
+            all = found;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == before) {
+            if (version) *version = before / 2;
+            return all;
+        }
+        retries.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+bool BalanceTable::read(int accNo, double &balance) const {
+    return readMany(&accNo, 1, &balance);
+}
+
+
+bool BalanceTable::tryCopy(BalanceSnapshot &out) const {
+    uint64_t before = seq.load(std::memory_order_acquire);
+    if (before & 1) return false;
+
+    const Table* t = current.load(std::memory_order_acquire);
+    out.balances.clear();
+    for (size_t i = 0; i <= t->mask; i++) {
+        int32_t k = t->slots[i].key.load(std::memory_order_relaxed);
+        if (k == EMPTY_KEY || k == TOMBSTONE_KEY) continue;
+        out.balances.emplace_back(k, fromBits(t->slots[i].bits.load(std::memory_order_relaxed)));
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq.load(std::memory_order_relaxed) != before) return false;
+    out.version = before / 2;
+    std::sort(out.balances.begin(), out.balances.end());
+    return true;
+}
+
+
+// Runs on the writer between transactions, so the copy needs no validation.
+void BalanceTable::serveSnapshot() {
+    uint64_t requested = snapshotRequests.load(std::memory_order_acquire);
+    auto snap = std::make_shared<BalanceSnapshot>();
+    tryCopy(*snap);
+    {
+        std::lock_guard<std::mutex> lock(handoffMutex);
+        served = std::move(snap);
+    }
+    snapshotsServed.store(requested, std::memory_order_release);
+}
+
+
+std::shared_ptr<const BalanceSnapshot> BalanceTable::snapshot() const {
+    auto snap = std::make_shared<BalanceSnapshot>();
+    uint64_t ticket = 0;
+    for (int attempt = 0;; attempt++) {
+        if (tryCopy(*snap)) return snap;
+        retries.fetch_add(1, std::memory_order_relaxed);
+        if (attempt + 1 == OPTIMISTIC_SNAPSHOT_ATTEMPTS)
+            ticket = snapshotRequests.fetch_add(1, std::memory_order_acq_rel) + 1;
+        if (ticket && snapshotsServed.load(std::memory_order_acquire) >= ticket) {
+            std::lock_guard<std::mutex> lock(handoffMutex);
+            return served;
+        }
+        std::this_thread::yield();
+    }
+}
@@ -1,5 +1,13 @@
 #include "banking.h"
+#include "durable.h"
+#include "metrics.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
+#include <fstream>
+#include <iomanip>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
@@ -7,14 +15,8 @@
 
 
 
-static std::unordered_map<int, int> accountAges;
-
-
-static std::unordered_map<int, std::vector<std::time_t>> accountTransactions;
-
-
-static size_t cleanupOldTransactions(int accNo) {
-    auto &times = accountTransactions[accNo];
+size_t Banking::cleanupOldTransactions(int accNo) {
+    auto &times = minorTxnTimes[accNo];
     std::time_t now = std::time(nullptr);
     const std::time_t ONE_DAY = 24 * 60 * 60;
 
@@ -28,121 +30,917 @@ static size_t cleanupOldTransactions(int accNo) {
 }
 
 
-static bool canRecordTransaction(int accNo) {
-    int age = 18; // default
-    if (accountAges.count(accNo)) age = accountAges[accNo];
+// Only minors are limited, so only their timestamps are kept.
+bool Banking::canRecordTransaction(int accNo) {
+    TRACE_SCOPE("limit_check", "banking");
+    if (accountAge(accNo) >= 18) return true;
 
-    if (age < 18) {
-        size_t count = cleanupOldTransactions(accNo);
-        if (count >= 20) {
-            std::cerr << "⚠️ Transaction limit reached for minor account " << accNo << " (20 per day).\n";
-            return false;
+    size_t count = cleanupOldTransactions(accNo);
+    if (count >= 20) {
+        std::cerr << "⚠️ Transaction limit reached for minor account " << accNo << " (20 per day).\n";
+        METRICS_LIMIT_REJECTED();
+        return false;
+    }
+    minorTxnTimes[accNo].push_back(std::time(nullptr));
+    return true;
+}
+
+
+void Banking::setAccountAge(int accNo, int age) {
+    accountAges[accNo] = age;
+}
+
+
+int Banking::accountAge(int accNo) const {
+    int age = 18;
+    auto it = accountAges.find(accNo);
+    if (it != accountAges.end()) age = it->second;
+    else if (tier) tier->coldAge(accNo, age);
+    return age;
+}
+
+
+Account* Banking::findAccount(int accNo) {
+    TRACE_SCOPE("account_lookup", "banking");
+    if (tier) return tier->find(accNo);
+    auto it = accountIndex.find(accNo);
+    return it != accountIndex.end() ? &accounts[it->second] : nullptr;
+}
+
+
+void Banking::rebuildIndex() {
+    accountIndex.clear();
+    for (size_t i = 0; i < accounts.size(); i++) accountIndex[accounts[i].accNo] = i;
+}
+
+
+void Banking::publish(const Account* a, const Account* b) {
+    if (tier) {
+        tier->markDirty(a->accNo);
+        if (b) tier->markDirty(b->accNo);
+    }
+    if (deferring) {
+        deferred.push_back(a->accNo);
+        if (b) deferred.push_back(b->accNo);
+        return;
+    }
+    published.beginWrite();
+    published.set(a->accNo, a->balance);
+    if (b) published.set(b->accNo, b->balance);
+    published.endWrite();
+}
+
+
+void Banking::deferPublishing(bool on) {
+    deferring = on;
+    if (on || deferred.empty()) return;
+    published.beginWrite();
+    for (int accNo : deferred)
+        if (const Account* a = findAccount(accNo)) published.set(accNo, a->balance);
+    published.endWrite();
+    deferred.clear();
+}
+
+
+void Banking::publishAll() {
+    published.beginWrite();
+    if (tier) {
+        tier->markAllDirty();
+        tier->forEachResident([this](const Account &a) { published.set(a.accNo, a.balance); });
+    } else {
+        for (const auto &a : accounts) published.set(a.accNo, a.balance);
+    }
+    published.endWrite();
+    trimTier();
+}
+
+
+// Evicts cold accounts once the caller holds no Account pointers; each is
+// written back before it is unpublished, so readers fall through to its row.
+void Banking::trimTier() {
+    if (!tier) return;
+    evicted.clear();
+    tier->trim(evicted);
+    if (evicted.empty()) return;
+    published.beginWrite();
+    for (int accNo : evicted) published.erase(accNo);
+    published.endWrite();
+}
+
+
+bool Banking::openAccountTable(const std::string &path, size_t budgetBytes) {
+    std::unique_ptr<AccountTier> opened(new AccountTier());
+    if (!opened->open(path, budgetBytes)) {
+        std::cerr << opened->lastError() << "\n";
+        return false;
+    }
+    accounts.clear();
+    accountIndex.clear();
+    accountAges.clear();
+    minorTxnTimes.clear();
+    tier = std::move(opened);
+    nextAccountNumber = std::max(nextAccountNumber, tier->maxAccNo() + 1);
+    holds.clear();
+    credits.clear();
+    loadEscrowFromFile(path + ".escrow");
+    appliedWalLsn = tier->appliedLsn();
+    return true;
+}
+
+
+bool Banking::flushAccountTable() {
+    if (!tier) return true;
+    std::ostringstream escrow;
+    writeEscrow(escrow);
+    if (tier->checkpoint(appliedWalLsn, escrow.str())) return true;
+    std::cerr << tier->lastError() << "\n";
+    return false;
+}
+
+
+void Banking::holdTableChanges(bool hold) {
+    if (tier) tier->setHoldDirty(hold);
+}
+
+
+bool Banking::tableCheckpointDue() const {
+    return tier && tier->checkpointDue();
+}
+
+
+bool Banking::saveAccountTable(const std::string &path) const {
+    std::vector<Account> all;
+    all.reserve(accountCount());
+    forEachAccount([&all](const Account &a) { all.push_back(a); });
+    return saveEscrowToFile(path + ".escrow") && writeAccountTable(path, std::move(all), appliedWalLsn);
+}
+
+
+bool Banking::prefetchAccount(int accNo) {
+    return tier && tier->prefetch(accNo);
+}
+
+
+TierStats Banking::tierStats() const {
+    return tier ? tier->stats() : TierStats();
+}
+
+
+bool Banking::readBalance(int accNo, double &balance) const {
+    return published.read(accNo, balance) || (tier && tier->readColdBalance(accNo, balance));
+}
+
+
+bool Banking::readBalances(const std::vector<int> &accNos, std::vector<double> &balances) const {
+    balances.resize(accNos.size());
+    if (published.readMany(accNos.data(), accNos.size(), balances.data())) return true;
+    if (!tier) return false;
+    for (size_t i = 0; i < accNos.size(); i++)
+        if (!readBalance(accNos[i], balances[i])) return false;
+    return true;
+}
+
+
+std::shared_ptr<const BalanceSnapshot> Banking::snapshotBalances() const {
+    return published.snapshot();
+}
+
+
+const Account* Banking::getAccount(int accNo) const {
+    if (tier) return tier->find(accNo);
+    auto it = accountIndex.find(accNo);
+    return it != accountIndex.end() ? &accounts[it->second] : nullptr;
+}
+
+
+size_t Banking::accountCount() const {
+    return tier ? tier->size() : accounts.size();
+}
+
+
+const AccountAggregates* Banking::getAggregates(int accNo) const {
+    const Account* a = getAccount(accNo);
+    return a ? &a->aggregates : nullptr;
+}
+
+
+Account* Banking::createAccount(const std::string &name, double balance, int age) {
+    if (balance < 0) return nullptr;
+    if (tier) {
+        Account* a = tier->insert(Account(nextAccountNumber++, name, balance, age));
+        if (!a) return nullptr;
+        setAccountAge(a->accNo, age);
+        publish(a);
+        return a;
+    }
+    accounts.emplace_back(nextAccountNumber++, name, balance, age);
+    accountIndex[accounts.back().accNo] = accounts.size() - 1;
+    setAccountAge(accounts.back().accNo, age);
+    publish(&accounts.back());
+    return &accounts.back();
+}
+
+
+bool Banking::deleteAccount(int accNo) {
+    if (tier) {
+        if (!tier->erase(accNo)) return false;
+        accountAges.erase(accNo);
+        minorTxnTimes.erase(accNo);
+        published.beginWrite();
+        published.erase(accNo);
+        published.endWrite();
+        return true;
+    }
+    for (auto it = accounts.begin(); it != accounts.end(); ++it) {
+        if (it->accNo == accNo) {
+            accounts.erase(it);
+            rebuildIndex();
+            accountAges.erase(accNo);
+            minorTxnTimes.erase(accNo);
+            published.beginWrite();
+            published.erase(accNo);
+            published.endWrite();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void Banking::displayAllAccounts() const {
+    if (accountCount() == 0) {
+        std::cout << "No accounts found.\n";
+        return;
+    }
+    forEachAccount([](const Account &a) {
+        std::cout << std::left << std::setw(8) << a.accNo;
+        a.display();
+    }, false);
+}
+
+
+// File format: one account per line, "accNo|name|balance[|age]", after a
+// "#lsn N" line naming the last WAL record the snapshot covers (none while
+// it is 0) and followed by the escrow lines. Written beside the file and
+// renamed over it, the .agg sidecar first.
+bool Banking::saveAccountsToFile(const std::string &filename) {
+    METRICS_SCOPE(timer, MetricOp::SaveAccounts);
+    TRACE_SCOPE("save_accounts", "io");
+    METRICS_SET_OK(timer, false);
+    if (!saveAggregatesToFile(filename + ".agg")) return false;
+    const std::string tmp = filename + ".tmp";
+    std::ofstream file(tmp, std::ios::trunc);
+    if (!file) return false;
+    if (appliedWalLsn > 0) file << "#lsn " << appliedWalLsn << '\n';
+    file << std::fixed << std::setprecision(2);
+    forEachAccount([&file](const Account &a) {
+        file << a.accNo << '|' << a.name << '|' << a.balance << '|' << a.age << '\n';
+    }, false);
+    writeEscrow(file);
+    file.close();
+    if (!file || !syncFile(tmp) || !replaceFile(tmp, filename)) return false;
+    METRICS_SET_OK(timer, true);
+    return true;
+}
+
+
+// One line per account that has seen transactions; see AccountAggregates::write.
+bool Banking::saveAggregatesToFile(const std::string &filename) const {
+    const std::string tmp = filename + ".tmp";
+    std::ofstream file(tmp, std::ios::trunc);
+    if (!file) return false;
+    forEachAccount([&file](const Account &a) {
+        if (!a.aggregates.empty()) a.aggregates.write(file, a.accNo);
+    });
+    file.close();
+    return file && syncFile(tmp) && replaceFile(tmp, filename);
+}
+
+
+bool Banking::loadAggregatesFromFile(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file) return false;
+    std::string line;
+    AccountAggregates agg;
+    while (std::getline(file, line)) {
+        int accNo = 0;
+        if (line.empty() || !AccountAggregates::parse(line, accNo, agg)) continue;
+        Account* a = findAccount(accNo);
+        if (!a) continue;
+        a->aggregates = agg;
+        a->transactionCount = static_cast<int>(agg.transactionCount());
+        if (tier) tier->markDirty(accNo);
+    }
+    trimTier();
+    return true;
+}
+
+
+bool Banking::loadAccountsFromFile(const std::string &filename) {
+    METRICS_SCOPE(timer, MetricOp::LoadAccounts);
+    TRACE_SCOPE("load_accounts", "io");
+    std::ifstream file(filename);
+    if (!file) {
+        METRICS_SET_OK(timer, false);
+        return false;
+    }
+
+    appliedWalLsn = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        if (line[0] == '#') {
+            if (line.compare(0, 5, "#lsn ") == 0) appliedWalLsn = std::strtoull(line.c_str() + 5, nullptr, 10);
+            else parseEscrowLine(line);
+            continue;
         }
-        accountTransactions[accNo].push_back(std::time(nullptr));
+        std::stringstream ss(line);
+        std::string accStr, name, balStr, ageStr;
+        if (!std::getline(ss, accStr, '|') || !std::getline(ss, name, '|') ||
+            !std::getline(ss, balStr, '|')) continue;
+        std::getline(ss, ageStr, '|');
+
+        int age = ageStr.empty() ? 18 : std::stoi(ageStr);
+        addLoadedAccount(std::stoi(accStr), name, std::stod(balStr), age);
+    }
+    loadAggregatesFromFile(filename + ".agg");   // absent for older snapshots
+    publishAll();
+    return true;
+}
+
+
+// "#hold id accNo amount timestamp state" per hold and "#credit id accNo"
+// per credit, in the accounts file or the table's sidecar.
+void Banking::writeEscrow(std::ostream &out) const {
+    std::streamsize precision = out.precision(17);
+    std::ios::fmtflags flags = out.flags();
+    out.unsetf(std::ios::floatfield);
+    for (const auto &kv : holds) {
+        const EscrowHold &h = kv.second;
+        out << "#hold " << kv.first << ' ' << h.accNo << ' ' << h.amount << ' ' << h.timestamp << ' '
+            << int(h.state) << '\n';
+    }
+    for (const auto &kv : credits) out << "#credit " << kv.first << ' ' << kv.second << '\n';
+    out.precision(precision);
+    out.flags(flags);
+}
+
+
+bool Banking::parseEscrowLine(const std::string &line) {
+    std::istringstream in(line);
+    std::string kind;
+    int id = 0;
+    in >> kind;
+    if (kind == "#hold") {
+        EscrowHold h;
+        int state = 0;
+        if (!(in >> id >> h.accNo >> h.amount >> h.timestamp >> state)) return false;
+        h.state = static_cast<HoldState>(state);
+        holds[id] = h;
+    } else if (kind == "#credit") {
+        int accNo = 0;
+        if (!(in >> id >> accNo)) return false;
+        credits[id] = accNo;
+    } else {
+        return false;
+    }
+    lastTransferId = std::max(lastTransferId, id);
+    return true;
+}
+
+
+// There is no sidecar at all while there are neither holds nor credits.
+bool Banking::saveEscrowToFile(const std::string &filename) const {
+    if (holds.empty() && credits.empty()) {
+        std::remove(filename.c_str());
         return true;
     }
+    const std::string tmp = filename + ".tmp";
+    std::ofstream file(tmp, std::ios::trunc);
+    if (!file) return false;
+    writeEscrow(file);
+    file.close();
+    return file && syncFile(tmp) && replaceFile(tmp, filename);
+}
 
-    
-    accountTransactions[accNo].push_back(std::time(nullptr));
+
+bool Banking::loadEscrowFromFile(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line))
+        if (!line.empty()) parseEscrowLine(line);
     return true;
 }
 
 
-void setAccountAge(int accNo, int age) {
-    accountAges[accNo] = age;
+// Accounts already present are left alone.
+void Banking::addLoadedAccount(int accNo, const std::string &name, double balance, int age) {
+    if (findAccount(accNo)) return;
+    if (tier) {
+        tier->insert(Account(accNo, name, balance, age));
+    } else {
+        accounts.emplace_back(accNo, name, balance, age);
+        accountIndex[accNo] = accounts.size() - 1;
+    }
+    setAccountAge(accNo, age);
+    if (accNo >= nextAccountNumber) nextAccountNumber = accNo + 1;
 }
 
 
-bool Banking::deposit(int accNo, double amount) {
-    if (amount <= 0) return false;
-    Account* a = findAccount(accNo);
+void recordAggregates(const Transaction& t, Account* from, Account* to, int sign) {
+    if (!from) return;
+    auto bump = [&](Account* a, AggregateSlot slot) {
+        a->transactionCount += sign;
+        if (sign > 0) a->aggregates.add(slot, t.amount, t.timestamp);
+        else a->aggregates.remove(slot, t.amount, t.timestamp);
+    };
+    switch (t.type) {
+        case DEPOSIT: bump(from, AGG_DEPOSIT); break;
+        case WITHDRAW: bump(from, AGG_WITHDRAW); break;
+        case TRANSFER:
+            bump(from, AGG_TRANSFER_OUT);
+            if (to) bump(to, AGG_TRANSFER_IN);
+            break;
+        case HOLD: bump(from, AGG_TRANSFER_OUT); break;
+        case CREDIT: bump(from, AGG_TRANSFER_IN); break;
+        default: break;
+    }
+}
+
+
+Transaction inverseOf(const Transaction& t) {
+    Transaction inv = t;
+    switch (t.type) {
+        case DEPOSIT: inv.type = WITHDRAW; break;
+        case WITHDRAW: inv.type = DEPOSIT; break;
+        case TRANSFER:
+            inv.accNo = t.targetAcc;
+            inv.targetAcc = t.accNo;
+            break;
+        default: break;
+    }
+    return inv;
+}
+
+
+bool Banking::applyDeposit(const Transaction& t, bool checkLimits, bool record) {
+    if (t.amount <= 0) return false;
+    Account* a = findAccount(t.accNo);
     if (!a) return false;
 
-    if (!canRecordTransaction(accNo)) return false; // 👈 minor limit check
+    if (checkLimits && !canRecordTransaction(t.accNo)) return false; // 👈 minor limit check
 
-    a->balance += amount;
+    a->balance += t.amount;
+    publish(a);
+    if (record) recordAggregates(t, a, nullptr, 1);
     return true;
 }
 
 
-bool Banking::withdraw(int accNo, double amount) {
-    if (amount <= 0) return false;
-    Account* a = findAccount(accNo);
-    if (!a || a->balance < amount) return false;
+bool Banking::applyWithdraw(const Transaction& t, bool checkLimits, bool record) {
+    if (t.amount <= 0) return false;
+    Account* a = findAccount(t.accNo);
+    if (!a || a->balance < t.amount) return false;
+
+    if (checkLimits && !canRecordTransaction(t.accNo)) return false; // 👈 minor limit check
+
+    a->balance -= t.amount;
+    publish(a);
+    if (record) recordAggregates(t, a, nullptr, 1);
+    return true;
+}
+
+
+bool Banking::applyTransfer(const Transaction& t, bool checkLimits, bool record) {
+    if (t.amount <= 0) return false;
+    Account* from = findAccount(t.accNo);
+    Account* to = findAccount(t.targetAcc);
+    if (!from || !to || from->balance < t.amount) return false;
 
-    if (!canRecordTransaction(accNo)) return false; // 👈 minor limit check
+    if (checkLimits && !canRecordTransaction(t.accNo)) return false; // 👈 minor limit check
 
-    a->balance -= amount;
+    from->balance -= t.amount;
+    to->balance += t.amount;
+    publish(from, to);
+    if (record) recordAggregates(t, from, to, 1);
     return true;
 }
 
 
+// The public operations, processing and undo/redo all come through here so
+// each is counted, and sampled for latency, under its own MetricOp.
+bool Banking::applyMetered(const Transaction& t, bool record) {
+    bool ok = false;
+    switch (t.type) {
+        case DEPOSIT: {
+            METRICS_SAMPLED_SCOPE(timer, MetricOp::Deposit);
+            TRACE_SCOPE("deposit", "banking");
+            ok = applyDeposit(t, true, record);
+            METRICS_SET_OK(timer, ok);
+            break;
+        }
+        case WITHDRAW: {
+            METRICS_SAMPLED_SCOPE(timer, MetricOp::Withdraw);
+            TRACE_SCOPE("withdraw", "banking");
+            ok = applyWithdraw(t, true, record);
+            METRICS_SET_OK(timer, ok);
+            break;
+        }
+        case TRANSFER: {
+            METRICS_SAMPLED_SCOPE(timer, MetricOp::Transfer);
+            TRACE_SCOPE("transfer", "banking");
+            ok = applyTransfer(t, true, record);
+            METRICS_SET_OK(timer, ok);
+            break;
+        }
+        default: break;
+    }
+    return ok;
+}
+
+
+bool Banking::deposit(int accNo, double amount) {
+    bool ok = applyMetered(Transaction(DEPOSIT, accNo, 0, amount), true);
+    trimTier();
+    return ok;
+}
+
+
+bool Banking::withdraw(int accNo, double amount) {
+    bool ok = applyMetered(Transaction(WITHDRAW, accNo, 0, amount), true);
+    trimTier();
+    return ok;
+}
+
+
 bool Banking::transfer(int fromAcc, int toAcc, double amount) {
-    if (amount <= 0) return false;
-    Account* from = findAccount(fromAcc);
-    Account* to = findAccount(toAcc);
-    if (!from || !to || from->balance < amount) return false;
+    bool ok = applyMetered(Transaction(TRANSFER, fromAcc, toAcc, amount), true);
+    trimTier();
+    return ok;
+}
+
+
+bool Banking::applyTransaction(const Transaction& t, bool checkLimits) {
+    bool ok = false;
+    switch (t.type) {
+        case DEPOSIT: ok = applyDeposit(t, checkLimits, true); break;
+        case WITHDRAW: ok = applyWithdraw(t, checkLimits, true); break;
+        case TRANSFER: ok = applyTransfer(t, checkLimits, true); break;
+        default: ok = applyEscrowLeg(t, checkLimits); break;
+    }
+    trimTier();
+    return ok;
+}
+
+
+bool Banking::revertTransaction(const Transaction& t, bool checkLimits) {
+    if (isEscrowLeg(t.type)) {
+        bool ok = revertEscrowLeg(t);
+        trimTier();
+        return ok;
+    }
+    Transaction inv = inverseOf(t);
+    bool ok = false;
+    switch (inv.type) {
+        case DEPOSIT: ok = applyDeposit(inv, checkLimits, false); break;
+        case WITHDRAW: ok = applyWithdraw(inv, checkLimits, false); break;
+        case TRANSFER: ok = applyTransfer(inv, checkLimits, false); break;
+        default: break;
+    }
+    if (ok) recordAggregates(t, findAccount(t.accNo), findAccount(t.targetAcc), -1);
+    trimTier();
+    return ok;
+}
+
+
+void Banking::recordCompleted(const Transaction& t) {
+    if (!isEscrowLeg(t.type)) doneStack.push(t);
+}
 
-    if (!canRecordTransaction(fromAcc)) return false; // 👈 minor limit check
 
-    from->balance -= amount;
-    to->balance += amount;
+// The HOLD behind a hold, as its aggregates recorded it.
+static Transaction holdTransaction(int id, int accNo, double amount, std::time_t timestamp) {
+    Transaction t(HOLD, accNo, id, amount);
+    t.timestamp = timestamp;
+    return t;
+}
+
+
+// The transfer id travels in targetAcc. A HOLD is checked like the sending
+// side of a transfer, a CREDIT like the receiving side.
+bool Banking::applyEscrowLeg(const Transaction& t, bool checkLimits) {
+    const int id = t.targetAcc;
+    if (id <= 0) return false;
+    switch (t.type) {
+        case HOLD: {
+            auto it = holds.find(id);
+            if (it != holds.end()) return it->second.accNo == t.accNo && it->second.state != HOLD_REFUNDED;
+            if (t.amount <= 0) return false;
+            Account* a = findAccount(t.accNo);
+            if (!a || a->balance < t.amount) return false;
+            if (checkLimits && !canRecordTransaction(t.accNo)) return false;
+            a->balance -= t.amount;
+            publish(a);
+            recordAggregates(t, a, nullptr, 1);
+            holds.emplace(id, EscrowHold{t.accNo, t.amount, t.timestamp, HOLD_OPEN});
+            break;
+        }
+        case CREDIT: {
+            auto it = credits.find(id);
+            if (it != credits.end()) return it->second == t.accNo;
+            Account* a = findAccount(t.accNo);
+            if (t.amount <= 0 || !a) return false;
+            a->balance += t.amount;
+            publish(a);
+            recordAggregates(t, a, nullptr, 1);
+            credits.emplace(id, t.accNo);
+            break;
+        }
+        case SETTLE: {
+            auto it = holds.find(id);
+            if (it == holds.end() || it->second.state == HOLD_REFUNDED) return false;
+            it->second.state = HOLD_SETTLED;
+            break;
+        }
+        case REFUND: {
+            auto it = holds.find(id);
+            if (it == holds.end() || it->second.state == HOLD_SETTLED) return false;
+            if (it->second.state == HOLD_REFUNDED) return true;
+            EscrowHold &h = it->second;
+            Account* a = findAccount(h.accNo);
+            if (!a) return false;
+            a->balance += h.amount;
+            publish(a);
+            recordAggregates(holdTransaction(id, h.accNo, h.amount, h.timestamp), a, nullptr, -1);
+            h.state = HOLD_REFUNDED;
+            break;
+        }
+        default:
+            return false;
+    }
+    lastTransferId = std::max(lastTransferId, id);
     return true;
 }
 
 
+// Backs out a leg whose WAL write failed, which is the last leg applied for
+// its id. A repeat of a leg that was already durable is backed out as well;
+// the router only repeats legs while recovering.
+bool Banking::revertEscrowLeg(const Transaction& t) {
+    const int id = t.targetAcc;
+    if (t.type == CREDIT) {
+        auto it = credits.find(id);
+        if (it == credits.end()) return false;
+        if (Account* a = findAccount(it->second)) {
+            a->balance -= t.amount;
+            publish(a);
+            recordAggregates(t, a, nullptr, -1);
+        }
+        credits.erase(it);
+        return true;
+    }
+
+    auto it = holds.find(id);
+    if (it == holds.end()) return false;
+    EscrowHold &h = it->second;
+    Account* a = findAccount(h.accNo);
+    Transaction hold = holdTransaction(id, h.accNo, h.amount, h.timestamp);
+    switch (t.type) {
+        case HOLD:
+            if (h.state != HOLD_OPEN) return false;
+            if (a) {
+                a->balance += h.amount;
+                publish(a);
+                recordAggregates(hold, a, nullptr, -1);
+            }
+            holds.erase(it);
+            return true;
+        case SETTLE:
+            if (h.state != HOLD_SETTLED) return false;
+            h.state = HOLD_OPEN;
+            return true;
+        case REFUND:
+            if (h.state != HOLD_REFUNDED) return false;
+            if (a) {
+                a->balance -= h.amount;
+                publish(a);
+                recordAggregates(hold, a, nullptr, 1);
+            }
+            h.state = HOLD_OPEN;
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+PartitionTotals Banking::totals() const {
+    PartitionTotals p;
+    forEachAccount([&p](const Account &a) {
+        p.accounts++;
+        p.balanceCents += std::llround(a.balance * 100.0);
+    }, false);
+    for (const auto &kv : holds) {
+        if (kv.second.state != HOLD_OPEN) continue;
+        p.openHolds++;
+        p.heldCents += std::llround(kv.second.amount * 100.0);
+    }
+    p.lastTransferId = lastTransferId;
+    return p;
+}
+
+
+uint32_t Banking::netSlot(int accNo) {
+    auto it = netIndex.find(accNo);
+    if (it != netIndex.end()) return it->second;
+    Account* a = findAccount(accNo);
+    netSlots.push_back({a, a ? a->balance : 0.0, a && accountAge(accNo) < 18, false});
+    uint32_t slot = static_cast<uint32_t>(netSlots.size() - 1);
+    netIndex.emplace(accNo, slot);
+    return slot;
+}
+
+
+// The checks and their order are applyDeposit/Withdraw/Transfer's, run
+// against the slots' running balances, so every transaction is accepted or
+// rejected exactly as it would be one at a time. Balances change by the same
+// additions in the same order, so the final figures match bit for bit.
+size_t Banking::applyNetted(const Transaction* txns, size_t n, std::vector<char>& applied,
+                            std::vector<double>& balances, bool checkLimits) {
+    METRICS_SCOPE(timer, MetricOp::ProcessNetted);
+    TRACE_SCOPE("apply_netted", "banking");
+    applied.assign(n, 0);
+    balances.assign(n, 0.0);
+    netIndex.clear();
+    netSlots.clear();
+
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Transaction &t = txns[i];
+        NetSlot* from;
+        bool ok = false;
+        if (!(t.amount <= 0) && (t.type == DEPOSIT || t.type == WITHDRAW || t.type == TRANSFER)) {
+            uint32_t fromSlot = netSlot(t.accNo);
+            uint32_t toSlot = t.type == TRANSFER ? netSlot(t.targetAcc) : fromSlot;
+            from = &netSlots[fromSlot];
+            NetSlot &to = netSlots[toSlot];
+            ok = from->account && to.account && (t.type == DEPOSIT || !(from->balance < t.amount)) &&
+                 (!checkLimits || !from->minor || canRecordTransaction(t.accNo));
+            if (ok) {
+                switch (t.type) {
+                    case DEPOSIT: from->balance += t.amount; break;
+                    case WITHDRAW: from->balance -= t.amount; break;
+                    default:
+                        from->balance -= t.amount;
+                        to.balance += t.amount;
+                        break;
+                }
+                from->touched = to.touched = true;
+                recordAggregates(t, from->account, t.type == TRANSFER ? to.account : nullptr, 1);
+                applied[i] = 1;
+                count++;
+            }
+        } else {
+            from = &netSlots[netSlot(t.accNo)];
+        }
+        balances[i] = from->balance;
+    }
+
+    if (!deferring) published.beginWrite();
+    for (auto &slot : netSlots) {
+        if (!slot.touched) continue;
+        slot.account->balance = slot.balance;
+        if (deferring) deferred.push_back(slot.account->accNo);
+        else published.set(slot.account->accNo, slot.balance);
+        if (tier) tier->markDirty(slot.account->accNo);
+    }
+    if (!deferring) published.endWrite();
+    trimTier();
+
+    METRICS_SET_OK(timer, count > 0);
+    return count;
+}
+
+
 bool Banking::enqueueTransaction(const Transaction& t) {
+    TRACE_SCOPE("enqueue", "queue");
     queue.enqueue(t);
+    METRICS_QUEUE_DEPTH(queue.size());
     return true;
 }
 
 
-bool Banking::processNextTransaction(std::string& outMsg) {
-    if (queue.isEmpty()) {
-        outMsg = "No pending transactions.";
-        return false;
-    }
-
-    Transaction t = queue.dequeue();
-    bool success = false;
+std::string describeTransaction(const Transaction& t, bool success) {
+    TRACE_SCOPE("describe", "format");
     std::stringstream msg;
-
     switch (t.type) {
         case DEPOSIT:
-            success = deposit(t.accNo, t.amount);
             msg << (success ? "Deposited " : "Failed deposit of ")
                 << t.amount << " to Acc " << t.accNo;
             break;
 
         case WITHDRAW:
-            success = withdraw(t.accNo, t.amount);
             msg << (success ? "Withdrew " : "Failed withdrawal of ")
                 << t.amount << " from Acc " << t.accNo;
             break;
 
         case TRANSFER:
-            success = transfer(t.accNo, t.targetAcc, t.amount);
             msg << (success ? "Transferred " : "Failed transfer of ")
                 << t.amount << " from Acc " << t.accNo
                 << " to Acc " << t.targetAcc;
             break;
 
+        case HOLD:
+            msg << (success ? "Held " : "Failed hold of ")
+                << t.amount << " from Acc " << t.accNo << " for transfer " << t.targetAcc;
+            break;
+
+        case CREDIT:
+            msg << (success ? "Credited " : "Failed credit of ")
+                << t.amount << " to Acc " << t.accNo << " for transfer " << t.targetAcc;
+            break;
+
+        case SETTLE:
+            msg << (success ? "Settled" : "Failed to settle") << " transfer " << t.targetAcc;
+            break;
+
+        case REFUND:
+            msg << (success ? "Refunded" : "Failed to refund") << " transfer " << t.targetAcc
+                << " to Acc " << t.accNo;
+            break;
+
         default:
             msg << "Unknown transaction type.";
             break;
     }
+    return msg.str();
+}
 
-    outMsg = msg.str();
+
+Transaction Banking::dequeueTransaction() {
+    TRACE_SCOPE("dequeue", "queue");
+    Transaction t = queue.dequeue();
+    METRICS_QUEUE_DEPTH(queue.size());
+    return t;
+}
+
+
+bool Banking::processNextTransaction(std::string& outMsg) {
+    if (queue.isEmpty()) {
+        outMsg = "No pending transactions.";
+        return false;
+    }
+
+    METRICS_SAMPLED_SCOPE(timer, MetricOp::ProcessNext);
+    TRACE_SCOPE("process_next", "queue");
+    Transaction t = dequeueTransaction();
+    bool success = applyMetered(t, true);
+
+    outMsg = describeTransaction(t, success);
     if (success) doneStack.push(t);
+    trimTier();
 
+    METRICS_SET_OK(timer, success);
     return success;
 }
 
 
-void Banking::processAllTransactions() {
+size_t Banking::processNetted(NettedBatch& batch, size_t maxBatch) {
+    TRACE_SCOPE("process_netted", "queue");
+    batch.txns.clear();
+    {
+        TRACE_SCOPE("dequeue", "queue");
+        while (!queue.isEmpty() && batch.txns.size() < std::max<size_t>(1, maxBatch))
+            batch.txns.push_back(queue.dequeue());
+        METRICS_QUEUE_DEPTH(queue.size());
+    }
+
+    size_t count = applyNetted(batch.txns.data(), batch.txns.size(), batch.applied, batch.balances);
+    for (size_t i = 0; i < batch.txns.size(); i++)
+        if (batch.applied[i]) doneStack.push(batch.txns[i]);
+    return count;
+}
+
+
+void Banking::processAllTransactions(bool net) {
     std::string msg;
+    if (net) {
+        NettedBatch batch;
+        while (!queue.isEmpty()) {
+            processNetted(batch);
+            TRACE_SCOPE("print", "format");
+            for (size_t i = 0; i < batch.txns.size(); i++) {
+                std::cout << (batch.applied[i] ? "✅ " : "❌ ")
+                          << describeTransaction(batch.txns[i], batch.applied[i]) << "\n";
+            }
+        }
+        return;
+    }
     while (!queue.isEmpty()) {
-        if (processNextTransaction(msg))
+        bool ok = processNextTransaction(msg);
+        TRACE_SCOPE("print", "format");
+        if (ok)
             std::cout << "✅ " << msg << "\n";
         else
             std::cout << "❌ " << msg << "\n";
@@ -157,24 +955,22 @@ bool Banking::undoLast(std::string& outMsg) {
     }
 
     Transaction t = doneStack.pop();
-    bool ok = false;
+    bool ok = applyMetered(inverseOf(t), false);
+    if (ok) recordAggregates(t, findAccount(t.accNo), findAccount(t.targetAcc), -1);
     std::stringstream msg;
 
     switch (t.type) {
         case DEPOSIT:
-            ok = withdraw(t.accNo, t.amount);
             msg << (ok ? "Undid deposit of " : "Failed to undo deposit of ")
                 << t.amount << " from Acc " << t.accNo;
             break;
 
         case WITHDRAW:
-            ok = deposit(t.accNo, t.amount);
             msg << (ok ? "Undid withdrawal of " : "Failed to undo withdrawal of ")
                 << t.amount << " to Acc " << t.accNo;
             break;
 
         case TRANSFER:
-            ok = transfer(t.targetAcc, t.accNo, t.amount);
             msg << (ok ? "Undid transfer of " : "Failed to undo transfer of ")
                 << t.amount << " from Acc " << t.targetAcc
                 << " to Acc " << t.accNo;
@@ -188,6 +984,7 @@ bool Banking::undoLast(std::string& outMsg) {
     outMsg = msg.str();
     if (ok) undoStack.push(t);
     else doneStack.push(t);
+    trimTier();
 
     return ok;
 }
@@ -200,24 +997,21 @@ bool Banking::redoLast(std::string& outMsg) {
     }
 
     Transaction t = undoStack.pop();
-    bool ok = false;
+    bool ok = applyMetered(t, true);
     std::stringstream msg;
 
     switch (t.type) {
         case DEPOSIT:
-            ok = deposit(t.accNo, t.amount);
             msg << (ok ? "Redid deposit of " : "Failed to redo deposit of ")
                 << t.amount << " to Acc " << t.accNo;
             break;
 
         case WITHDRAW:
-            ok = withdraw(t.accNo, t.amount);
             msg << (ok ? "Redid withdrawal of " : "Failed to redo withdrawal of ")
                 << t.amount << " from Acc " << t.accNo;
             break;
 
         case TRANSFER:
-            ok = transfer(t.accNo, t.targetAcc, t.amount);
             msg << (ok ? "Redid transfer of " : "Failed to redo transfer of ")
                 << t.amount << " from Acc " << t.accNo
                 << " to Acc " << t.targetAcc;
@@ -231,6 +1025,7 @@ bool Banking::redoLast(std::string& outMsg) {
     outMsg = msg.str();
     if (ok) doneStack.push(t);
     else undoStack.push(t);
+    trimTier();
 
     return ok;
 }
@@ -239,3 +1034,17 @@ bool Banking::redoLast(std::string& outMsg) {
 int Banking::getNextAccountNumber() const {
     return nextAccountNumber;
 }
+
+
+bool Banking::canPerformTransaction(int accNo) const {
+    if (accountAge(accNo) >= 18) return true;
+
+    auto times = minorTxnTimes.find(accNo);
+    if (times == minorTxnTimes.end()) return true;
+    std::time_t now = std::time(nullptr);
+    size_t recent = 0;
+    for (auto t : times->second) {
+        if (now - t < 24 * 60 * 60) recent++;
+    }
+    return recent < 20;
+}
@@ -0,0 +1,124 @@
+#include "engine_client.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+EngineClient::~EngineClient() {
+    close();
+}
+
+
+bool EngineClient::connectUnix(const std::string &path) {
+    close();
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+bool EngineClient::connectTcp(const std::string &host, int port) {
+    close();
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return false;
+
+    fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        close();
+        return false;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return true;
+}
+
+
+void EngineClient::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    outBuf.clear();
+    inBuf.clear();
+    inPos = 0;
+}
+
+
+void EngineClient::send(const WireRequest &req) {
+    outBuf.append(reinterpret_cast<const char*>(&req), sizeof req);
+}
+
+
+bool EngineClient::flush() {
+    size_t pos = 0;
+    while (pos < outBuf.size()) {
+        ssize_t sent = ::send(fd, outBuf.data() + pos, outBuf.size() - pos, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        pos += static_cast<size_t>(sent);
+    }
+    outBuf.clear();
+    return true;
+}
+
+
+bool EngineClient::readAtLeast(size_t n) {
+    if (inPos > 0 && inPos == inBuf.size()) {
+        inBuf.clear();
+        inPos = 0;
+    }
+    char buf[64 * 1024];
+    while (inBuf.size() - inPos < n) {
+        ssize_t got = ::read(fd, buf, sizeof buf);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        inBuf.insert(inBuf.end(), buf, buf + got);
+    }
+    return true;
+}
+
+
+bool EngineClient::receive(WireResponse &resp, std::string* payload) {
+    if (fd < 0 || !readAtLeast(sizeof resp)) return false;
+    std::memcpy(&resp, inBuf.data() + inPos, sizeof resp);
+    inPos += sizeof resp;
+
+    if (resp.payloadLen > 0) {
+        if (!readAtLeast(resp.payloadLen)) return false;
+        if (payload) payload->assign(inBuf.data() + inPos, resp.payloadLen);
+        inPos += resp.payloadLen;
+    } else if (payload) {
+        payload->clear();
+    }
+    return true;
+}
+
+
+bool EngineClient::call(const WireRequest &req, WireResponse &resp, std::string* payload) {
+    send(req);
+    return flush() && receive(resp, payload);
+}
+
+
+WireRequest makeRequest(uint32_t requestId, WireOp op, int accNo, int targetAcc, double amount) {
+    WireRequest req{};
+    req.requestId = requestId;
+    req.op = op;
+    req.accNo = accNo;
+    req.targetAcc = targetAcc;
+    req.amount = amount;
+    return req;
+}
@@ -0,0 +1,459 @@
+#include "engine_server.h"
+#include "metrics.h"
+#include "partition.h"
+#include "trace.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// epoll user data for the descriptors that are not client connections.
+static const uint64_t WAKE_ID = 0;
+static const uint64_t UNIX_LISTEN_ID = UINT64_MAX;
+static const uint64_t TCP_LISTEN_ID = UINT64_MAX - 1;
+
+// Stop reading from a client whose unread responses exceed this.
+static const size_t MAX_PENDING_OUTPUT = 8 << 20;
+
+
+EngineServer::EngineServer(Banking &bank, GroupCommitter* committer, const ServerOptions &opts)
+    : bank(bank), committer(committer), opts(opts), readOnly(opts.readOnly) {}
+
+
+EngineServer::~EngineServer() {
+    if (reader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(readMutex);
+            readerStopping = true;
+        }
+        readCv.notify_one();
+        reader.join();
+    }
+    for (auto &kv : connections) ::close(kv.second.fd);
+    if (unixFd >= 0) {
+        ::close(unixFd);
+        ::unlink(opts.unixPath.c_str());
+    }
+    if (tcpFd >= 0) ::close(tcpFd);
+    if (wakeFd >= 0) ::close(wakeFd);
+    if (epollFd >= 0) ::close(epollFd);
+}
+
+
+static bool addToEpoll(int epollFd, int fd, uint32_t events, uint64_t id) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.u64 = id;
+    return ::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+
+bool EngineServer::start() {
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0 || !addToEpoll(epollFd, wakeFd, EPOLLIN, WAKE_ID)) {
+        error = std::string("epoll setup failed: ") + std::strerror(errno);
+        return false;
+    }
+    if (opts.unixPath.empty() && opts.tcpPort == 0) {
+        error = "no listener configured";
+        return false;
+    }
+    if (!opts.unixPath.empty() && !listenUnix()) return false;
+    if (opts.tcpPort != 0 && !listenTcp()) return false;
+    if (committer) reader = std::thread([this] { runReader(); });
+    return true;
+}
+
+
+bool EngineServer::listenUnix() {
+    sockaddr_un addr{};
+    if (opts.unixPath.size() >= sizeof(addr.sun_path)) {
+        error = "unix socket path too long";
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, opts.unixPath.c_str());
+
+    unixFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ::unlink(opts.unixPath.c_str());
+    if (unixFd < 0 || ::bind(unixFd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+        ::listen(unixFd, 128) != 0 || !addToEpoll(epollFd, unixFd, EPOLLIN, UNIX_LISTEN_ID)) {
+        error = "cannot listen on " + opts.unixPath + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+
+bool EngineServer::listenTcp() {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(opts.tcpPort));
+    if (::inet_pton(AF_INET, opts.tcpHost.c_str(), &addr.sin_addr) != 1) {
+        error = "bad TCP host " + opts.tcpHost;
+        return false;
+    }
+
+    tcpFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (tcpFd >= 0) ::setsockopt(tcpFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (tcpFd < 0 || ::bind(tcpFd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+        ::listen(tcpFd, 128) != 0 || !addToEpoll(epollFd, tcpFd, EPOLLIN, TCP_LISTEN_ID)) {
+        error = "cannot listen on TCP port " + std::to_string(opts.tcpPort) + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+
+void EngineServer::stop() {
+    stopping.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    if (wakeFd >= 0 && ::write(wakeFd, &one, sizeof one) < 0) {
+        // Counter overflow only; the loop is already awake.
+    }
+}
+
+
+void EngineServer::run() {
+    epoll_event events[256];
+    TRACE_THREAD_NAME("engine_server");
+    while (!stopping.load(std::memory_order_relaxed)) {
+        int n = ::epoll_wait(epollFd, events, 256, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            error = std::string("epoll_wait failed: ") + std::strerror(errno);
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == WAKE_ID) {
+                uint64_t count;
+                while (::read(wakeFd, &count, sizeof count) > 0) {}
+                drainCompletions();
+            } else if (id == UNIX_LISTEN_ID) {
+                acceptAll(unixFd);
+            } else if (id == TCP_LISTEN_ID) {
+                acceptAll(tcpFd);
+            } else {
+                if (events[i].events & EPOLLOUT) onWritable(id);
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) onReadable(id);
+            }
+        }
+    }
+}
+
+
+void EngineServer::acceptAll(int listenFd) {
+    for (;;) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;   // EAGAIN, or a transient error we retry on the next event
+        if (listenFd == tcpFd) {
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        }
+        uint64_t id = nextConnId++;
+        if (!addToEpoll(epollFd, fd, EPOLLIN, id)) {
+            ::close(fd);
+            continue;
+        }
+        connections[id].fd = fd;
+    }
+}
+
+
+void EngineServer::onReadable(uint64_t connId) {
+    auto it = connections.find(connId);
+    if (it == connections.end()) return;
+    Connection &conn = it->second;
+
+    bool closed = false;
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t got = ::read(conn.fd, buf, sizeof buf);
+        if (got > 0) {
+            conn.in.insert(conn.in.end(), buf, buf + got);
+            if (static_cast<size_t>(got) < sizeof buf) break;
+            continue;
+        }
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) closed = true;
+        if (got < 0 && errno == EINTR) continue;
+        break;
+    }
+
+    // Every complete frame is handled before one write flushes all replies.
+    size_t pos = 0;
+    while (conn.in.size() - pos >= sizeof(WireRequest)) {
+        WireRequest req;
+        std::memcpy(&req, conn.in.data() + pos, sizeof req);
+        pos += sizeof req;
+        handleRequest(connId, conn, req);
+    }
+    conn.in.erase(conn.in.begin(), conn.in.begin() + static_cast<std::ptrdiff_t>(pos));
+
+    if (closed) {
+        closeConnection(connId);
+        return;
+    }
+    flush(connId, conn);
+}
+
+
+void EngineServer::onWritable(uint64_t connId) {
+    auto it = connections.find(connId);
+    if (it != connections.end()) flush(connId, it->second);
+}
+
+
+static TransactionType typeForOp(uint8_t op) {
+    switch (op) {
+        case OP_DEPOSIT: return DEPOSIT;
+        case OP_WITHDRAW: return WITHDRAW;
+        case OP_TRANSFER: return TRANSFER;
+        case OP_HOLD: return HOLD;
+        case OP_CREDIT: return CREDIT;
+        case OP_SETTLE: return SETTLE;
+        case OP_REFUND: return REFUND;
+        default: return UNKNOWN;
+    }
+}
+
+
+void EngineServer::handleRequest(uint64_t connId, Connection &conn, const WireRequest &req) {
+    TRACE_SCOPE("request", "server");
+    WireResponse resp{};
+    resp.requestId = req.requestId;
+
+    switch (req.op) {
+        case OP_PING:
+            resp.status = STATUS_OK;
+            break;
+
+        case OP_BALANCE: {
+            // Lock-free; never waits for the commit thread's batch.
+            double balance = 0.0;
+            bool found = bank.readBalance(req.accNo, balance);
+            resp.status = found ? STATUS_OK : STATUS_REJECTED;
+            resp.balance = balance;
+            break;
+        }
+
+        case OP_STATS:
+            resp.status = STATUS_OK;
+            queueResponse(conn, resp, Metrics::snapshot());
+            return;
+
+        case OP_TRACE:
+            resp.status = STATUS_OK;
+            queueResponse(conn, resp, Trace::chromeJson());
+            return;
+
+        case OP_AGGREGATES: {
+            int accNo = req.accNo;
+            readLocked(connId, conn, resp, [this, accNo](WireResponse &r, std::string &text) {
+                const AccountAggregates* agg = bank.getAggregates(accNo);
+                if (agg) text = describeAggregates(*agg, std::time(nullptr));
+                r.status = text.empty() ? STATUS_REJECTED : STATUS_OK;
+            });
+            return;
+        }
+
+        case OP_HISTORY: {
+            // Segments are immutable; no bank lock needed.
+            std::vector<LedgerRecord> records;
+            size_t n = req.amount >= 1 ? static_cast<size_t>(std::min(req.amount, double(MAX_HISTORY_RECORDS))) : 5;
+            bool ok = history && history->lastRecords(req.accNo, n, records);
+            resp.status = ok ? STATUS_OK : STATUS_REJECTED;
+            queueResponse(conn, resp, describeHistory(records));
+            return;
+        }
+
+        case OP_TOTALS:
+            readLocked(connId, conn, resp, [this](WireResponse &r, std::string &text) {
+                text = describeTotals(bank.totals());
+                r.status = STATUS_OK;
+            });
+            return;
+
+        case OP_PROMOTE: {
+            bool ok = promote && promote();
+            if (ok) readOnly.store(false, std::memory_order_relaxed);
+            resp.status = ok ? STATUS_OK : STATUS_REJECTED;
+            if (committer) resp.lsn = committer->committedLsn();
+            break;
+        }
+
+        case OP_DEPOSIT:
+        case OP_WITHDRAW:
+        case OP_TRANSFER:
+        case OP_HOLD:
+        case OP_CREDIT:
+        case OP_SETTLE:
+        case OP_REFUND: {
+            if (readOnly.load(std::memory_order_relaxed)) {
+                resp.status = STATUS_READ_ONLY;
+                break;
+            }
+            if (!std::isfinite(req.amount) || req.amount < 0 || req.amount > MAX_WIRE_AMOUNT) {
+                resp.status = STATUS_BAD_REQUEST;
+                break;
+            }
+            Transaction t(typeForOp(req.op), req.accNo, req.targetAcc, req.amount);
+            if (committer) {
+                uint32_t requestId = req.requestId;
+                committer->submit(t, [this, connId, requestId](const CommitResult &r) {
+                    WireResponse done{};
+                    done.requestId = requestId;
+                    done.status = r.ok ? STATUS_OK : STATUS_REJECTED;
+                    done.balance = r.balance;
+                    done.lsn = r.lsn;
+                    complete(connId, done);
+                });
+                return;   // answered from drainCompletions()
+            }
+            // No undo over the protocol, so nothing goes on the undo stack.
+            bool ok = bank.applyTransaction(t, opts.checkLimits);
+            resp.status = ok ? STATUS_OK : STATUS_REJECTED;
+            if (const Account* a = bank.getAccount(req.accNo)) resp.balance = a->balance;
+            break;
+        }
+
+        default:
+            resp.status = STATUS_BAD_REQUEST;
+            break;
+    }
+    queueResponse(conn, resp);
+}
+
+
+void EngineServer::queueResponse(Connection &conn, const WireResponse &resp, const std::string &payload) {
+    WireResponse header = resp;
+    header.payloadLen = static_cast<uint32_t>(payload.size());
+    conn.out.append(reinterpret_cast<const char*>(&header), sizeof header);
+    conn.out.append(payload);
+}
+
+
+void EngineServer::complete(uint64_t connId, const WireResponse &resp, std::string payload) {
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        completions.push_back({connId, resp, std::move(payload)});
+    }
+    uint64_t one = 1;
+    if (::write(wakeFd, &one, sizeof one) < 0) {
+        // Counter overflow only; the loop is already awake.
+    }
+}
+
+
+void EngineServer::readLocked(uint64_t connId, Connection &conn, const WireResponse &resp, LockedRead read) {
+    if (!committer) {
+        WireResponse r = resp;
+        std::string text;
+        read(r, text);
+        queueResponse(conn, r, text);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(readMutex);
+        reads.push_back({connId, resp, std::move(read)});
+    }
+    readCv.notify_one();
+}
+
+
+void EngineServer::runReader() {
+    TRACE_THREAD_NAME("engine_reader");
+    std::vector<PendingRead> batch;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(readMutex);
+            readCv.wait(lock, [this] { return readerStopping || !reads.empty(); });
+            if (readerStopping) return;
+            batch.swap(reads);
+        }
+        for (auto &p : batch) {
+            std::string text;
+            {
+                std::lock_guard<std::mutex> lock(committer->bankMutex());
+                p.read(p.response, text);
+            }
+            complete(p.connId, p.response, std::move(text));
+        }
+        batch.clear();
+    }
+}
+
+
+void EngineServer::drainCompletions() {
+    std::vector<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        ready.swap(completions);
+    }
+
+    std::vector<uint64_t> touched;
+    for (const auto &c : ready) {
+        auto it = connections.find(c.connId);
+        if (it == connections.end()) continue;   // client went away
+        queueResponse(it->second, c.response, c.payload);
+        touched.push_back(c.connId);
+    }
+    for (uint64_t id : touched) {
+        auto it = connections.find(id);
+        if (it != connections.end() && !it->second.wantWrite) flush(id, it->second);
+    }
+}
+
+
+void EngineServer::flush(uint64_t connId, Connection &conn) {
+    while (conn.outPos < conn.out.size()) {
+        ssize_t sent = ::send(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos,
+                              MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn.outPos += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        closeConnection(connId);
+        return;
+    }
+    if (conn.outPos == conn.out.size()) {
+        conn.out.clear();
+        conn.outPos = 0;
+    }
+    updateInterest(conn, connId);
+}
+
+
+void EngineServer::updateInterest(Connection &conn, uint64_t connId) {
+    bool wantWrite = conn.outPos < conn.out.size();
+    bool backlogged = conn.out.size() - conn.outPos > MAX_PENDING_OUTPUT;
+    epoll_event ev{};
+    ev.events = (backlogged ? 0 : EPOLLIN) | (wantWrite ? EPOLLOUT : 0);
+    ev.data.u64 = connId;
+    ::epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.wantWrite = wantWrite;
+}
+
+
+void EngineServer::closeConnection(uint64_t connId) {
+    auto it = connections.find(connId);
+    if (it == connections.end()) return;
+    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    ::close(it->second.fd);
+    connections.erase(it);
+}
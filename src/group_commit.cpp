@@ -0,0 +1,319 @@
+#include "group_commit.h"
+#include "durable.h"
+#include "metrics.h"
+#include "trace.h"
+#include <algorithm>
+#include <iterator>
+
+
+GroupCommitter::GroupCommitter(Banking &bank, const GroupCommitOptions &opts)
+    : bank(bank), opts(opts), lsn(opts.startLsn) {
+    if (this->opts.maxBatch == 0) this->opts.maxBatch = 1;
+}
+
+
+GroupCommitter::~GroupCommitter() {
+    stop();
+}
+
+
+bool GroupCommitter::start() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (running) return true;
+    if (!opts.walPath.empty()) {
+        wal = std::fopen(opts.walPath.c_str(), "ab");
+        // A new WAL starts with its base LSN so that records keep their
+        // numbers after the snapshot it continues.
+        bool fresh = wal && std::fseek(wal, 0, SEEK_END) == 0 && std::ftell(wal) == 0;
+        if (!wal || (fresh && (std::fprintf(wal, "#lsn %llu\n", static_cast<unsigned long long>(opts.startLsn)) < 0 ||
+                               std::fflush(wal) != 0 || !syncFd(fileno(wal))))) {
+            if (wal) std::fclose(wal);
+            wal = nullptr;
+            std::lock_guard<std::mutex> stateLock(stateMutex);
+            error = "cannot open WAL " + opts.walPath;
+            return false;
+        }
+    }
+    stopping = false;
+    running = true;
+    worker = std::thread(&GroupCommitter::run, this);
+    return true;
+}
+
+
+bool resetWal(const std::string &path, uint64_t lsn) {
+    const std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fprintf(f, "#lsn %llu\n", static_cast<unsigned long long>(lsn)) > 0 &&
+              std::fflush(f) == 0 && syncFd(fileno(f));
+    ok = std::fclose(f) == 0 && ok;
+    return ok && replaceFile(tmp, path);
+}
+
+
+void GroupCommitter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running) return;
+        stopping = true;
+    }
+    queueCv.notify_all();
+    worker.join();
+    running = false;
+    if (wal) {
+        std::fclose(wal);
+        wal = nullptr;
+    }
+}
+
+
+void GroupCommitter::submit(const Transaction &t, Callback done) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!running || stopping) {
+            done(CommitResult());
+            return;
+        }
+        pending.push_back({t, std::move(done)});
+        // Wake the committer for the first request of a batch and when the
+        // batch is full; anything in between just waits for the window.
+        wake = pending.size() == 1 || pending.size() >= opts.maxBatch;
+    }
+    records.fetch_add(1, std::memory_order_relaxed);
+    if (wake) queueCv.notify_one();
+}
+
+
+std::future<CommitResult> GroupCommitter::submit(const Transaction &t) {
+    auto promise = std::make_shared<std::promise<CommitResult>>();
+    std::future<CommitResult> result = promise->get_future();
+    submit(t, [promise](const CommitResult &r) { promise->set_value(r); });
+    return result;
+}
+
+
+std::string GroupCommitter::lastError() const {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return error;
+}
+
+
+GroupCommitStats GroupCommitter::stats() const {
+    GroupCommitStats s;
+    s.batches = batches.load(std::memory_order_relaxed);
+    s.records = records.load(std::memory_order_relaxed);
+    s.committed = committed.load(std::memory_order_relaxed);
+    s.walFailures = walFailures.load(std::memory_order_relaxed);
+    s.replicated = replicated.load(std::memory_order_relaxed);
+    s.diverged = diverged.load(std::memory_order_relaxed);
+    return s;
+}
+
+
+void GroupCommitter::run() {
+    std::vector<Pending> batch;
+    std::string walBuffer;
+    TRACE_THREAD_NAME("group_commit");
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCv.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) return;   // stopping and drained
+
+            // Hold the batch open for the window unless it fills up first.
+            auto deadline = std::chrono::steady_clock::now() + opts.maxWait;
+            queueCv.wait_until(lock, deadline, [this] {
+                return stopping || pending.size() >= opts.maxBatch;
+            });
+
+            size_t take = std::min(pending.size(), opts.maxBatch);
+            batch.assign(std::make_move_iterator(pending.begin()),
+                         std::make_move_iterator(pending.begin() + static_cast<std::ptrdiff_t>(take)));
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(take));
+        }
+        commitBatch(batch, walBuffer);
+        batch.clear();
+    }
+}
+
+
+template <typename... Args>
+static void appendFormatted(std::string &out, const char* format, Args... args) {
+    int n = std::snprintf(nullptr, 0, format, args...);
+    if (n <= 0) return;
+    size_t at = out.size();
+    out.resize(at + static_cast<size_t>(n) + 1);
+    std::snprintf(&out[at], static_cast<size_t>(n) + 1, format, args...);
+    out.resize(at + static_cast<size_t>(n));
+}
+
+
+// Amounts keep every significant digit and the timestamp goes last, so
+// recovery and followers apply exactly the amount the engine did, to the
+// same day and month aggregates.
+static void appendWalLine(std::string &out, const Transaction &t) {
+    const std::string type = typeToStr(t.type);
+    const long long when = static_cast<long long>(t.timestamp);
+    if (t.type == TRANSFER || isEscrowLeg(t.type))
+        appendFormatted(out, "%s|%d|%d|%.17g|%lld\n", type.c_str(), t.accNo, t.targetAcc, t.amount, when);
+    else
+        appendFormatted(out, "%s|%d|%.17g|%lld\n", type.c_str(), t.accNo, t.amount, when);
+}
+
+
+// One write and one fsync; a failed append is cut back off the log.
+bool GroupCommitter::appendWal(const std::string &walBuffer) {
+    if (walBuffer.empty()) return true;
+    if (!wal) return opts.walPath.empty();   // lost after a failed checkpoint reset
+    TRACE_SCOPE("wal_write", "io");
+    long long before = std::ftell(wal);
+    bool durable = std::fwrite(walBuffer.data(), 1, walBuffer.size(), wal) == walBuffer.size() &&
+                   std::fflush(wal) == 0 &&
+                   syncFd(fileno(wal));
+    if (!durable) {
+        std::clearerr(wal);
+        if (before >= 0) truncateFd(fileno(wal), before);
+    }
+    return durable;
+}
+
+
+void GroupCommitter::commitBatch(std::vector<Pending> &batch, std::string &walBuffer) {
+    METRICS_SCOPE(timer, MetricOp::GroupCommit);
+    TRACE_SCOPE("commit_batch", "commit");
+    std::lock_guard<std::mutex> logLock(logMutex);
+    std::vector<CommitResult> results(batch.size());
+    walBuffer.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (wal) bank.deferPublishing(true);
+        // The netting stage has no escrow legs; a batch with any goes one by one.
+        bool net = opts.net && std::none_of(batch.begin(), batch.end(),
+                                            [](const Pending &p) { return isEscrowLeg(p.t.type); });
+        if (net) {
+            std::vector<Transaction> txns;
+            txns.reserve(batch.size());
+            for (const auto &p : batch) txns.push_back(p.t);
+            std::vector<char> applied;
+            std::vector<double> balances;
+            bank.applyNetted(txns.data(), txns.size(), applied, balances, opts.checkLimits);
+            for (size_t i = 0; i < batch.size(); i++) {
+                results[i].ok = applied[i] != 0;
+                results[i].balance = balances[i];
+                if (results[i].ok) appendWalLine(walBuffer, txns[i]);
+            }
+        } else {
+            for (size_t i = 0; i < batch.size(); i++) {
+                const Transaction &t = batch[i].t;
+                results[i].ok = bank.applyTransaction(t, opts.checkLimits);
+                if (const Account* a = bank.getAccount(t.accNo)) results[i].balance = a->balance;
+                if (results[i].ok) appendWalLine(walBuffer, t);
+            }
+        }
+    }
+
+    bool durable = appendWal(walBuffer);
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (durable) {
+            uint64_t next = lsn.load(std::memory_order_relaxed);
+            uint64_t count = 0;
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (!results[i].ok) continue;
+                if (opts.undoHistory) bank.recordCompleted(batch[i].t);
+                results[i].lsn = ++next;
+                count++;
+            }
+            lsn.store(next, std::memory_order_release);
+            committed.fetch_add(count, std::memory_order_relaxed);
+            if (logHook && count) logHook(walBuffer, next);
+            if (wal && bank.tableCheckpointDue()) checkpointTable(next);
+        } else {
+            // Undo in reverse so every inverse sees the balance it relied on.
+            for (size_t i = batch.size(); i-- > 0;) {
+                if (!results[i].ok) continue;
+                bank.revertTransaction(batch[i].t);
+                results[i].ok = false;
+            }
+            walFailures.fetch_add(1, std::memory_order_relaxed);
+            error = "WAL write failed for " + opts.walPath;
+        }
+        bank.deferPublishing(false);
+    }
+    batches.fetch_add(1, std::memory_order_relaxed);
+    METRICS_SET_OK(timer, durable);
+
+    for (size_t i = 0; i < batch.size(); i++) batch[i].done(results[i]);
+}
+
+
+// Runs with both locks held once the account table's budget is used up by
+// changes it may not write back yet. They go into the table as of `at`,
+// and the WAL restarts after it. If the checkpoint fails the WAL keeps
+// everything and the next batch tries again.
+void GroupCommitter::checkpointTable(uint64_t at) {
+    TRACE_SCOPE("table_checkpoint", "io");
+    bank.setAppliedLsn(at);
+    if (!bank.flushAccountTable()) {
+        error = "account table checkpoint failed";
+        return;
+    }
+    std::fclose(wal);
+    bool reset = resetWal(opts.walPath, at);
+    wal = std::fopen(opts.walPath.c_str(), "ab");
+    if (!reset || !wal) error = "cannot restart WAL " + opts.walPath + " after a checkpoint";
+}
+
+
+bool GroupCommitter::applyReplicated(const std::string &walLines) {
+    std::lock_guard<std::mutex> logLock(logMutex);
+    std::vector<Transaction> txns;
+    std::vector<char> applied;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (wal) bank.deferPublishing(true);
+        size_t start = 0;
+        while (start < walLines.size()) {
+            size_t end = walLines.find('\n', start);
+            if (end == std::string::npos) end = walLines.size();
+            Transaction t;
+            bool ok = parseTransactionLine(walLines.substr(start, end - start), t) && bank.applyTransaction(t, false);
+            txns.push_back(t);
+            applied.push_back(ok);
+            start = end + 1;
+        }
+    }
+
+    if (!appendWal(walLines)) {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        for (size_t i = txns.size(); i-- > 0;)
+            if (applied[i]) bank.revertTransaction(txns[i]);
+        bank.deferPublishing(false);
+        walFailures.fetch_add(1, std::memory_order_relaxed);
+        error = "WAL write failed for " + opts.walPath;
+        return false;
+    }
+
+    uint64_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        for (size_t i = 0; i < txns.size(); i++) {
+            if (!applied[i]) continue;
+            if (opts.undoHistory) bank.recordCompleted(txns[i]);
+            count++;
+        }
+        bank.deferPublishing(false);
+    }
+    uint64_t next = lsn.load(std::memory_order_relaxed) + txns.size();
+    lsn.store(next, std::memory_order_release);
+    committed.fetch_add(count, std::memory_order_relaxed);
+    replicated.fetch_add(txns.size(), std::memory_order_relaxed);
+    diverged.fetch_add(txns.size() - count, std::memory_order_relaxed);
+    if (logHook && !txns.empty()) logHook(walLines, next);
+    return true;
+}
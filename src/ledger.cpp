@@ -0,0 +1,103 @@
+#include "ledger.h"
+#include "durable.h"
+#include "metrics.h"
+#include "trace.h"
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+
+string currentDateTime() {
+    time_t now = time(0);
+    char buf[80];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    return buf;
+}
+
+
+void saveTransactionsToFile(const string& username, const vector<LedgerEntry>& transactions) {
+    METRICS_SCOPE(timer, MetricOp::SaveLedger);
+    TRACE_SCOPE("save_ledger", "io");
+    string path = username + "_transactions.txt";
+    ofstream file(path, ios::trunc);
+    for (const auto& txn : transactions) {
+        file << txn.date << "," << txn.type << "," << txn.amount << "," << txn.balanceAfter << "\n";
+    }
+    file.close();
+    METRICS_SET_OK(timer, file && syncFile(path));
+}
+
+
+vector<LedgerEntry> loadTransactionsFromFile(const string& username) {
+    METRICS_SCOPE(timer, MetricOp::LoadLedger);
+    TRACE_SCOPE("load_ledger", "io");
+    vector<LedgerEntry> transactions;
+    ifstream file(username + "_transactions.txt");
+    string date, type;
+    double amount, balance;
+
+    while (getline(file, date, ',')) {
+        getline(file, type, ',');
+        file >> amount;
+        file.ignore();
+        file >> balance;
+        file.ignore();
+        transactions.push_back({type, amount, balance, date});
+    }
+
+    file.close();
+    return transactions;
+}
+
+
+double getBalance(const vector<LedgerEntry>& transactions) {
+    if (transactions.empty()) return 0.0;
+    return transactions.back().balanceAfter;
+}
+
+
+void printMiniStatement(const vector<LedgerEntry>& transactions) {
+    cout << left << setw(20) << "Date" << setw(15) << "Type"
+         << setw(15) << "Amount" << setw(15) << "Balance" << "\n";
+    cout << string(65, '-') << "\n";
+    int count = 0;
+    for (auto it = transactions.rbegin(); it != transactions.rend() && count < 5; ++it, ++count) {
+        cout << left << setw(20) << it->date
+             << setw(15) << it->type
+             << setw(15) << fixed << setprecision(2) << it->amount
+             << setw(15) << it->balanceAfter << "\n";
+    }
+}
+
+
+LedgerRecord toLedgerRecord(const Transaction& t, double balanceAfter) {
+    LedgerRecord r{};
+    r.timestamp = static_cast<int64_t>(t.timestamp);
+    r.accNo = t.accNo;
+    r.targetAcc = t.targetAcc;
+    r.amount = t.amount;
+    r.balanceAfter = balanceAfter;
+    r.type = static_cast<uint8_t>(t.type);
+    return r;
+}
+
+
+Transaction fromLedgerRecord(const LedgerRecord& r) {
+    Transaction t(ledgerType(r.type), r.accNo, r.targetAcc, r.amount);
+    t.timestamp = static_cast<time_t>(r.timestamp);
+    return t;
+}
+
+
+bool writeLedgerRecords(const string& path, const vector<LedgerRecord>& records, bool append) {
+    TRACE_SCOPE("write_ledger_records", "io");
+    ofstream file(path, ios::binary | (append ? ios::app : ios::trunc));
+    if (!file) return false;
+    file.write(reinterpret_cast<const char*>(records.data()),
+               static_cast<streamsize>(records.size() * sizeof(LedgerRecord)));
+    file.close();
+    return file && syncFile(path);
+}
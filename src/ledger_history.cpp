@@ -0,0 +1,90 @@
+#include "ledger_history.h"
+#include "ledger_view.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <unordered_set>
+
+
+bool LedgerHistory::open(const std::vector<std::string> &segmentPaths) {
+    close();
+    for (const auto &path : segmentPaths) {
+        std::unique_ptr<SegmentReader> segment(new SegmentReader());
+        if (!segment->open(path)) {
+            error = segment->lastError();
+            close();
+            return false;
+        }
+        segments.push_back(std::move(segment));
+    }
+    return true;
+}
+
+
+void LedgerHistory::close() {
+    segments.clear();
+    decoded.store(0, std::memory_order_relaxed);
+}
+
+
+uint64_t LedgerHistory::records() const {
+    uint64_t n = 0;
+    for (const auto &s : segments) n += s->records();
+    return n;
+}
+
+
+template <typename Fn>
+bool LedgerHistory::walkBackward(Fn fn) const {
+    std::vector<LedgerRecord> buf;
+    for (auto seg = segments.rbegin(); seg != segments.rend(); ++seg) {
+        for (size_t b = (*seg)->blockCount(); b-- > 0;) {
+            if (!(*seg)->readBlock(b, buf)) return false;
+            decoded.fetch_add(1, std::memory_order_relaxed);
+            for (auto r = buf.rbegin(); r != buf.rend(); ++r)
+                if (!fn(*r)) return true;
+        }
+    }
+    return true;
+}
+
+
+bool LedgerHistory::lastRecords(int accNo, size_t n, std::vector<LedgerRecord> &out) const {
+    out.clear();
+    if (n == 0) return true;
+    // Only a TRANSFER's targetAcc is an account; an escrow leg's is its
+    // transfer id, so a leg belongs to accNo alone.
+    bool ok = walkBackward([&](const LedgerRecord &r) {
+        if (r.accNo == accNo || (r.type == TRANSFER && r.targetAcc == accNo)) out.push_back(r);
+        return out.size() < n;
+    });
+    std::reverse(out.begin(), out.end());
+    return ok;
+}
+
+
+bool LedgerHistory::recentAccounts(size_t limit, std::vector<int> &out) const {
+    out.clear();
+    std::unordered_set<int> seen;
+    auto note = [&](int accNo) {
+        if (out.size() < limit && seen.insert(accNo).second) out.push_back(accNo);
+    };
+    return walkBackward([&](const LedgerRecord &r) {
+        note(r.accNo);
+        if (r.type == TRANSFER) note(r.targetAcc);
+        return out.size() < limit;
+    });
+}
+
+
+std::string describeHistory(const std::vector<LedgerRecord> &records) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (const auto &r : records) {
+        out << get_date(r) << " " << get_type_as_string(r) << " acc=" << r.accNo;
+        if (r.type == TRANSFER) out << " to=" << r.targetAcc;
+        else if (isEscrowLeg(ledgerType(r.type))) out << " transfer=" << r.targetAcc;
+        out << " amount=" << r.amount << " balance=" << r.balanceAfter << "\n";
+    }
+    return out.str();
+}
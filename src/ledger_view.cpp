@@ -0,0 +1,74 @@
+#include "ledger_view.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+MappedLedger::~MappedLedger() {
+    close();
+}
+
+
+bool MappedLedger::open(const std::string &path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        error = "cannot stat " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    count = static_cast<size_t>(st.st_size) / sizeof(LedgerRecord);
+    if (count == 0) return true;                // mmap rejects zero-length maps
+
+    mappedBytes = count * sizeof(LedgerRecord);
+    base = ::mmap(nullptr, mappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        error = "cannot map " + path + ": " + std::strerror(errno);
+        base = nullptr;
+        close();
+        return false;
+    }
+    records = static_cast<const LedgerRecord*>(base);
+    return true;
+}
+
+
+void MappedLedger::close() {
+    if (base) ::munmap(base, mappedBytes);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    base = nullptr;
+    mappedBytes = 0;
+    records = nullptr;
+    count = 0;
+}
+
+
+void LedgerColumns::reserve(size_t n) {
+    timestamps.reserve(n);
+    accNos.reserve(n);
+    targetAccs.reserve(n);
+    amounts.reserve(n);
+    balances.reserve(n);
+    types.reserve(n);
+}
+
+
+void LedgerColumns::append(const LedgerRecord &r) {
+    timestamps.push_back(r.timestamp);
+    accNos.push_back(r.accNo);
+    targetAccs.push_back(r.targetAcc);
+    amounts.push_back(r.amount);
+    balances.push_back(r.balanceAfter);
+    types.push_back(r.type);
+}
@@ -4,22 +4,32 @@
 #include <iomanip>
 #include <vector>
 #include <ctime>
+#include <chrono>
 #include "stack.h"
 #include "queue.h"
 #include "TransactionList.h"
+#include "banking.h"
+#include "ledger.h"
+#include "ledger_view.h"
+#include "segment.h"
+#include "metrics.h"
+#include "trace.h"
+#include "replay.h"
+#include "engine_client.h"
+#include "engine_server.h"
+#include "group_commit.h"
+#include "ledger_history.h"
+#include "warmup.h"
+#include "replication.h"
+#include "partition.h"
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <csignal>
 
 using namespace std;
 
 
-struct Transaction {
-    string type;
-    double amount;
-    double balanceAfter;
-    string date;
-};
-
 string toLower(const string &str) {
     string lowerStr = str;
     transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(),
@@ -28,68 +38,635 @@ string toLower(const string &str) {
 }
 
 
-string currentDateTime() {
-    time_t now = time(0);
-    char buf[80];
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    return buf;
+// Loads accounts, queues every line of a batch file and drains the queue,
+// with --net a batch at a time through the netting stage.
+int runBatch(const string& accountFile, const string& txnFile, bool net) {
+    Banking bank;
+    if (!bank.loadAccountsFromFile(accountFile)) {
+        cerr << "Cannot open accounts file " << accountFile << endl;
+        return 1;
+    }
+
+    ifstream file(txnFile);
+    if (!file) {
+        cerr << "Cannot open transactions file " << txnFile << endl;
+        return 1;
+    }
+    string line;
+    size_t lineNo = 0;
+    {
+        TRACE_SCOPE("read_batch", "io");
+        while (getline(file, line)) {
+            lineNo++;
+            if (line.empty()) continue;
+            Transaction t;
+            bool parsed;
+            {
+                TRACE_SCOPE("parse", "parse");
+                parsed = parseTransactionLine(line, t);
+            }
+            if (!parsed) {
+                cerr << "Skipping malformed line " << lineNo << ": " << line << endl;
+                continue;
+            }
+            bank.enqueueTransaction(t);
+        }
+    }
+
+    bank.processAllTransactions(net);
+    if (!bank.saveAccountsToFile(accountFile)) {
+        cerr << "Failed to save accounts to " << accountFile << endl;
+        return 1;
+    }
+    return 0;
+}
+
+static void printTierStats(const TierStats &s) {
+    cerr << "Account cache: " << s.residentAccounts << " resident, " << s.residentBytes / 1024 << " of "
+         << s.budgetBytes / 1024 << " KB, hit rate " << fixed << setprecision(3) << s.hitRate()
+         << " (" << s.hits << " hits, " << s.misses << " misses), " << s.evictions << " evictions, "
+         << s.writebacks << " writebacks, " << s.prefetched << " prefetched, " << s.checkpoints << " checkpoints" << endl;
 }
 
+// replay <accountFile> <ledgerFile> [options]
+// Rebuilds balances by streaming a ledger through the engine. With
+// --cache-mb the first argument is an account table, updated in place.
+int runReplay(int argc, char* argv[]) {
+    ReplayOptions opts;
+    string saveTo;
+    long cacheMb = -1;
+    for (int i = 4; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--binary") opts.binary = true;
+        else if (arg == "--no-messages") opts.skipMessages = true;
+        else if (arg == "--no-limits") opts.skipLimits = true;
+        else if (arg == "--fast") opts.skipMessages = opts.skipLimits = true;
+        else if (arg == "--resume") opts.resume = true;
+        else if (arg == "--checkpoint-every" && hasValue) opts.checkpointEvery = stoul(argv[++i]);
+        else if (arg == "--checkpoint" && hasValue) opts.checkpointPath = argv[++i];
+        else if (arg == "--threads" && hasValue) opts.threads = static_cast<unsigned>(stoul(argv[++i]));
+        else if (arg == "--save" && hasValue) saveTo = argv[++i];
+        else if (arg == "--cache-mb" && hasValue) cacheMb = stol(argv[++i]);
+        else {
+            cerr << "Usage: replay <accountFile> <ledgerFile> [--binary] [--fast | --no-messages --no-limits]\n"
+                 << "       [--checkpoint FILE --checkpoint-every N [--resume]] [--threads N] [--save FILE]\n"
+                 << "       [--cache-mb N]   (accountFile is an account table)" << endl;
+            return 1;
+        }
+    }
+    if ((opts.checkpointEvery > 0 || opts.resume) && opts.checkpointPath.empty()) {
+        cerr << "--checkpoint FILE is required with --checkpoint-every/--resume" << endl;
+        return 1;
+    }
+    if (opts.threads > 1 && !(opts.skipLimits && opts.skipMessages))
+        cerr << "Parallel replay needs --fast; replaying on one thread." << endl;
+
+    Banking bank;
+    if (cacheMb >= 0) {
+        if (!bank.openAccountTable(argv[2], static_cast<size_t>(cacheMb) << 20)) return 1;
+    } else if (!bank.loadAccountsFromFile(argv[2])) {
+        cerr << "Cannot open accounts file " << argv[2] << endl;
+        return 1;
+    }
+
+    ReplayEngine engine(bank, opts);
+    ReplayStats stats;
+    if (!engine.run(argv[3], stats)) {
+        cerr << "Replay failed: " << engine.lastError() << endl;
+        return 1;
+    }
 
-void saveTransactionsToFile(const string& username, const vector<Transaction>& transactions) {
-    ofstream file(username + "_transactions.txt", ios::trunc);
-    for (const auto& txn : transactions) {
-        file << txn.date << "," << txn.type << "," << txn.amount << "," << txn.balanceAfter << "\n";
+    cerr << "Replayed " << stats.records << " records (" << stats.applied << " applied, "
+         << stats.rejected << " rejected, " << stats.malformed << " malformed) in "
+         << fixed << setprecision(3) << stats.seconds << " s: "
+         << setprecision(1) << stats.mbPerSec() << " MB/s, "
+         << setprecision(0) << stats.recordsPerSec() << " records/s";
+    if (stats.resumedFrom) cerr << ", resumed after " << stats.resumedFrom;
+    if (stats.checkpoints) cerr << ", " << stats.checkpoints << " checkpoints";
+    cerr << endl;
+    if (bank.tiered()) {
+        printTierStats(bank.tierStats());
+        if (!bank.flushAccountTable()) {
+            cerr << "Failed to write back " << argv[2] << endl;
+            return 1;
+        }
     }
-    file.close();
+
+    if (!saveTo.empty() && !bank.saveAccountsToFile(saveTo)) {
+        cerr << "Failed to save accounts to " << saveTo << endl;
+        return 1;
+    }
+    return 0;
 }
 
+static EngineServer* activeServer = nullptr;
+
+static void stopServer(int) {
+    if (activeServer) activeServer->stop();
+}
 
-vector<Transaction> loadTransactionsFromFile(const string& username) {
-    vector<Transaction> transactions;
-    ifstream file(username + "_transactions.txt");
-    string date, type;
-    double amount, balance;
+static vector<string> splitList(const string &list) {
+    vector<string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == string::npos) comma = list.size();
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
 
-    while (getline(file, date, ',')) {
-        getline(file, type, ',');
-        file >> amount;
-        file.ignore();
-        file >> balance;
-        file.ignore();
-        transactions.push_back({type, amount, balance, date});
+// serve <accountFile> [options]
+// Resident engine: replays the WAL on top of the accounts file, serves the
+// binary protocol, and on SIGINT/SIGTERM saves the accounts and resets the WAL.
+// With --cache-mb the accounts file is an account table: boot maps it and
+// reads only the history segments' footers, accounts are loaded on first
+// use, and --warm N faults in the N most recently active in the background.
+// --replicate PATH ships the WAL to followers connecting on PATH, keeping
+// the last --replicate-window-mb (default 64) of it for catch-up; --follow
+// PATH makes this engine a read-only follower of the primary there until
+// it is promoted. An unpromoted follower leaves its accounts file and WAL
+// as they are at shutdown, so it restarts at the same LSN.
+int runServe(int argc, char* argv[]) {
+    const auto booted = chrono::steady_clock::now();
+    ServerOptions serverOpts;
+    GroupCommitOptions commitOpts;
+    long cacheMb = -1;
+    size_t warmAccounts = 0;
+    vector<string> historyPaths;
+    string replicatePath, followPath;
+    size_t replicateWindowMb = LogShipper::DEFAULT_WINDOW_BYTES >> 20;
+    for (int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--unix" && hasValue) serverOpts.unixPath = argv[++i];
+        else if (arg == "--tcp" && hasValue) serverOpts.tcpPort = stoi(argv[++i]);
+        else if (arg == "--wal" && hasValue) commitOpts.walPath = argv[++i];
+        else if (arg == "--window-us" && hasValue) commitOpts.maxWait = chrono::microseconds(stol(argv[++i]));
+        else if (arg == "--max-batch" && hasValue) commitOpts.maxBatch = stoul(argv[++i]);
+        else if (arg == "--no-limits") commitOpts.checkLimits = false;
+        else if (arg == "--net") commitOpts.net = true;
+        else if (arg == "--cache-mb" && hasValue) cacheMb = stol(argv[++i]);
+        else if (arg == "--history" && hasValue) historyPaths = splitList(argv[++i]);
+        else if (arg == "--warm" && hasValue) warmAccounts = stoul(argv[++i]);
+        else if (arg == "--replicate" && hasValue) replicatePath = argv[++i];
+        else if (arg == "--follow" && hasValue) followPath = argv[++i];
+        else if (arg == "--replicate-window-mb" && hasValue) replicateWindowMb = stoul(argv[++i]);
+        else {
+            cerr << "Usage: serve <accountFile> [--unix PATH] [--tcp PORT] [--wal FILE]\n"
+                 << "       [--window-us N] [--max-batch N] [--no-limits] [--net]\n"
+                 << "       [--cache-mb N [--warm N]]   (accountFile is an account table)\n"
+                 << "       [--history SEG[,SEG...]]   (sealed segments, oldest first)\n"
+                 << "       [--replicate PATH [--replicate-window-mb N]] [--follow PATH]" << endl;
+            return 1;
+        }
+    }
+    if (!followPath.empty() && cacheMb >= 0) {
+        // Table checkpoints run on the commit path, which replicated
+        // records bypass, so a follower's changes would pile up resident.
+        cerr << "--follow needs an accounts file, not an account table" << endl;
+        return 1;
+    }
+    serverOpts.readOnly = !followPath.empty();
+    if (serverOpts.unixPath.empty() && serverOpts.tcpPort == 0) serverOpts.unixPath = "banking.sock";
+
+    const string accountFile = argv[2];
+    Banking bank;
+    if (cacheMb >= 0) {
+        if (!bank.openAccountTable(accountFile, static_cast<size_t>(cacheMb) << 20)) return 1;
+    } else if (!bank.loadAccountsFromFile(accountFile)) {
+        cerr << "Cannot open accounts file " << accountFile << endl;
+        return 1;
+    }
+    LedgerHistory history;
+    if (!history.open(historyPaths)) {
+        cerr << history.lastError() << endl;
+        return 1;
     }
 
-    file.close();
-    return transactions;
+    // The snapshot covers the WAL up to its LSN; recovery applies the rest.
+    // A table's rows must keep matching its LSN, so changes stay resident
+    // until the committer checkpoints them.
+    commitOpts.startLsn = bank.appliedLsn();
+    if (!commitOpts.walPath.empty()) bank.holdTableChanges(true);
+    if (!commitOpts.walPath.empty() && ifstream(commitOpts.walPath)) {
+        ReplayOptions replayOpts;
+        replayOpts.skipMessages = replayOpts.skipLimits = true;
+        replayOpts.appliedLsn = bank.appliedLsn();
+        ReplayEngine recovery(bank, replayOpts);
+        ReplayStats stats;
+        if (!recovery.run(commitOpts.walPath, stats)) {
+            cerr << "WAL recovery failed: " << recovery.lastError() << endl;
+            return 1;
+        }
+        if (stats.baseLsn > bank.appliedLsn()) {
+            cerr << "WAL " << commitOpts.walPath << " starts after LSN " << stats.baseLsn << " but "
+                 << accountFile << " only covers LSN " << bank.appliedLsn() << endl;
+            return 1;
+        }
+        cerr << "Recovered " << stats.applied << " records from " << commitOpts.walPath;
+        if (stats.skipped) cerr << " (" << stats.skipped << " already in " << accountFile << ")";
+        cerr << endl;
+        commitOpts.startLsn = max(commitOpts.startLsn, stats.lastLsn);
+    }
+
+    GroupCommitter committer(bank, commitOpts);
+    LogShipper shipper(replicatePath, replicateWindowMb << 20);
+    if (!replicatePath.empty()) {
+        if (!shipper.start(commitOpts.walPath, commitOpts.startLsn)) {
+            cerr << shipper.lastError() << endl;
+            return 1;
+        }
+        committer.setLogHook([&shipper](const string &lines, uint64_t lsn) { shipper.append(lines, lsn); });
+    }
+    if (!committer.start()) {
+        cerr << committer.lastError() << endl;
+        return 1;
+    }
+    ReplicaFollower follower(committer);
+    bool promoted = false;
+    if (!followPath.empty()) follower.start(followPath);
+
+    EngineServer server(bank, &committer, serverOpts);
+    server.setHistory(&history);
+    if (!followPath.empty()) {
+        server.setPromoteHandler([&]() {
+            follower.stop();
+            if (!promoted) cerr << "Promoted at LSN " << committer.committedLsn() << endl;
+            promoted = true;
+            return true;
+        });
+    }
+    if (!server.start()) {
+        cerr << server.lastError() << endl;
+        return 1;
+    }
+    cerr << "Ready after " << fixed << setprecision(1)
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - booted).count() << " ms" << endl;
+
+    AccountWarmer warmer(bank, committer.bankMutex());
+    if (warmAccounts > 0 && bank.tiered()) warmer.start(history, warmAccounts);
+
+    activeServer = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    cerr << "Serving " << bank.accountCount() << " accounts";
+    if (!serverOpts.unixPath.empty()) cerr << " on " << serverOpts.unixPath;
+    if (serverOpts.tcpPort) cerr << " on " << serverOpts.tcpHost << ":" << serverOpts.tcpPort;
+    cerr << endl;
+
+    server.run();
+    warmer.stop();
+    follower.stop();
+    committer.stop();     // acknowledges anything still pending
+    shipper.stop();
+    activeServer = nullptr;
+    if (!followPath.empty()) {
+        ReplicaStatus r = follower.status();
+        cerr << "Followed to LSN " << committer.committedLsn() << " (" << committer.stats().diverged
+             << " diverged), mean lag " << setprecision(3) << r.meanLagMs << " ms, max " << r.maxLagMs << " ms";
+        if (!follower.lastError().empty()) cerr << "; last error: " << follower.lastError();
+        cerr << endl;
+    }
+    for (const auto &f : shipper.followers())
+        cerr << "Follower " << (f.connected ? "connected" : "gone") << " at LSN " << f.ackedLsn << " of "
+             << shipper.lsn() << endl;
+    if (warmer.done() && warmAccounts > 0)
+        cerr << "Warmed " << warmer.warmed() << " accounts in " << setprecision(1) << warmer.seconds() * 1e3 << " ms" << endl;
+    if (bank.tiered()) printTierStats(bank.tierStats());
+
+    if (!followPath.empty() && !promoted) {
+        cerr << "Left " << accountFile << " and the WAL as they are for the next start" << endl;
+        return 0;
+    }
+    if (!commitOpts.walPath.empty()) bank.setAppliedLsn(committer.committedLsn());
+    if (bank.tiered() ? !bank.flushAccountTable() : !bank.saveAccountsToFile(accountFile)) {
+        cerr << "Failed to save accounts; keeping WAL " << commitOpts.walPath << endl;
+        return 1;
+    }
+    if (!commitOpts.walPath.empty() && !resetWal(commitOpts.walPath, bank.appliedLsn())) {
+        cerr << "Saved accounts to " << accountFile << " but could not reset WAL " << commitOpts.walPath
+             << "; its records up to LSN " << bank.appliedLsn() << " will be skipped" << endl;
+        return 1;
+    }
+    cerr << "Saved accounts to " << accountFile << endl;
+    return 0;
 }
 
+static RouterServer* activeRouter = nullptr;
 
-double getBalance(const vector<Transaction>& transactions) {
-    if (transactions.empty()) return 0.0;
-    return transactions.back().balanceAfter;
+static void stopRouter(int) {
+    if (activeRouter) activeRouter->stop();
 }
 
+// route <map> <socket,socket,...> [--unix PATH] [--log FILE]
+// Fronts partitions started with `serve` (one socket per partition, in
+// partition order) as a single engine. --log keeps the transfer log that
+// lets a restarted router finish transfers it was cut off in.
+int runRoute(int argc, char* argv[]) {
+    PartitionMap map;
+    if (!PartitionMap::parse(argv[2], map)) {
+        cerr << "Bad partition map " << argv[2] << " (hash:N or range:B1,B2,...)" << endl;
+        return 1;
+    }
+    vector<string> sockets = splitList(argv[3]);
+    if (sockets.size() != map.count()) {
+        cerr << map.describe() << " needs " << map.count() << " partition sockets" << endl;
+        return 1;
+    }
+    string unixPath = "router.sock", logPath;
+    for (int i = 4; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--unix" && hasValue) unixPath = argv[++i];
+        else if (arg == "--log" && hasValue) logPath = argv[++i];
+        else {
+            cerr << "Usage: route <map> <socket,socket,...> [--unix PATH] [--log FILE]" << endl;
+            return 1;
+        }
+    }
 
-void printMiniStatement(const vector<Transaction>& transactions) {
-    cout << left << setw(20) << "Date" << setw(15) << "Type"
-         << setw(15) << "Amount" << setw(15) << "Balance" << "\n";
-    cout << string(65, '-') << "\n";
-    int count = 0;
-    for (auto it = transactions.rbegin(); it != transactions.rend() && count < 5; ++it, ++count) {
-        cout << left << setw(20) << it->date
-             << setw(15) << it->type
-             << setw(15) << fixed << setprecision(2) << it->amount
-             << setw(15) << it->balanceAfter << "\n";
+    TransferLog log;
+    if (!log.open(logPath)) {
+        cerr << log.lastError() << endl;
+        return 1;
     }
+    PartitionRouter recovery(map, sockets, log);
+    size_t redriven = 0;
+    if (!recovery.recover(&redriven)) {
+        cerr << "Recovery failed: " << recovery.lastError() << endl;
+        return 1;
+    }
+    if (redriven > 0) cerr << "Finished " << redriven << " transfers from " << logPath << endl;
+
+    RouterServer server(map, sockets, log, unixPath);
+    if (!server.start()) {
+        cerr << server.lastError() << endl;
+        return 1;
+    }
+    activeRouter = &server;
+    signal(SIGINT, stopRouter);
+    signal(SIGTERM, stopRouter);
+    cerr << "Routing " << map.describe() << " on " << unixPath << endl;
+    server.run();
+    activeRouter = nullptr;
+    return 0;
+}
+
+// check-partitions <socket,socket,...> [--expect AMOUNT]
+// Conservation check: every partition's balances plus the holds still open.
+int runCheckPartitions(int argc, char* argv[]) {
+    vector<string> sockets = splitList(argv[2]);
+    bool expect = argc == 5 && string(argv[3]) == "--expect";
+    if (argc != 3 && !expect) {
+        cerr << "Usage: check-partitions <socket,socket,...> [--expect AMOUNT]" << endl;
+        return 1;
+    }
+    TransferLog ids;
+    PartitionRouter router(PartitionMap::hashed(sockets.size()), sockets, ids);
+    vector<PartitionTotals> parts;
+    if (!router.totals(parts)) {
+        cerr << router.lastError() << endl;
+        return 1;
+    }
+    cout << fixed << setprecision(2);
+    for (size_t p = 0; p < parts.size(); p++)
+        cout << "partition " << p << ": " << parts[p].accounts << " accounts, balance "
+             << parts[p].balanceCents / 100.0 << ", " << parts[p].openHolds << " open holds ("
+             << parts[p].heldCents / 100.0 << ")" << endl;
+    PartitionTotals sum = sumTotals(parts);
+    int64_t total = sum.balanceCents + sum.heldCents;
+    cout << "total " << total / 100.0 << " in " << sum.accounts << " accounts" << endl;
+    if (!expect) return 0;
+
+    int64_t expected = llround(stod(argv[4]) * 100.0);
+    if (total == expected) {
+        cout << "conserved" << endl;
+        return 0;
+    }
+    if (sum.openHolds > 0 && total > expected && total - expected <= sum.heldCents) {
+        cout << "conserved up to " << sum.openHolds << " transfers in flight" << endl;
+        return 0;
+    }
+    cout << "NOT conserved: off by " << (total - expected) / 100.0 << endl;
+    return 1;
+}
+
+// request <socketPath> <ping|stats|trace|totals|balance|aggregates|history|promote|deposit|withdraw|transfer> [args]
+int runRequest(int argc, char* argv[]) {
+    EngineClient client;
+    if (!client.connectUnix(argv[2])) {
+        cerr << "Cannot connect to " << argv[2] << endl;
+        return 1;
+    }
+
+    string op = argv[3];
+    WireRequest req;
+    if (op == "ping" && argc == 4) req = makeRequest(1, OP_PING);
+    else if (op == "stats" && argc == 4) req = makeRequest(1, OP_STATS);
+    else if (op == "trace" && argc == 4) req = makeRequest(1, OP_TRACE);
+    else if (op == "totals" && argc == 4) req = makeRequest(1, OP_TOTALS);
+    else if (op == "balance" && argc == 5) req = makeRequest(1, OP_BALANCE, stoi(argv[4]));
+    else if (op == "aggregates" && argc == 5) req = makeRequest(1, OP_AGGREGATES, stoi(argv[4]));
+    else if (op == "history" && (argc == 5 || argc == 6))
+        req = makeRequest(1, OP_HISTORY, stoi(argv[4]), 0, argc == 6 ? stod(argv[5]) : 5);
+    else if (op == "promote" && argc == 4) req = makeRequest(1, OP_PROMOTE);
+    else if (op == "deposit" && argc == 6) req = makeRequest(1, OP_DEPOSIT, stoi(argv[4]), 0, stod(argv[5]));
+    else if (op == "withdraw" && argc == 6) req = makeRequest(1, OP_WITHDRAW, stoi(argv[4]), 0, stod(argv[5]));
+    else if (op == "transfer" && argc == 7)
+        req = makeRequest(1, OP_TRANSFER, stoi(argv[4]), stoi(argv[5]), stod(argv[6]));
+    else {
+        cerr << "Invalid request." << endl;
+        return 1;
+    }
+
+    WireResponse resp;
+    string payload;
+    if (!client.call(req, resp, &payload)) {
+        cerr << "Connection lost." << endl;
+        return 1;
+    }
+    if (!payload.empty()) cout << payload;
+    else cout << (resp.status == STATUS_OK ? "OK" : "FAILED") << " status=" << int(resp.status)
+              << " balance=" << fixed << setprecision(2) << resp.balance << " lsn=" << resp.lsn << endl;
+    return resp.status == STATUS_OK ? 0 : 1;
+}
+
+int runCommand(int argc, char* argv[]);
+
+
+// statement <binaryLedger> [N] [--account A]: last N records, read in place
+// from the mapped file.
+int runStatement(int argc, char* argv[]) {
+    size_t n = 5;
+    int account = 0;
+    for (int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--account" && i + 1 < argc) account = stoi(argv[++i]);
+        else n = stoul(arg);
+    }
+
+    MappedLedger ledger;
+    if (!ledger.open(argv[2])) {
+        cerr << ledger.lastError() << endl;
+        return 1;
+    }
+    if (account == 0) {
+        TransactionList::displayMiniStatement(ledger, n);
+    } else {
+        TransactionList::displayMiniStatement(ledger, n, [account](const LedgerRecord &r) {
+            return r.accNo == account || (r.type == TRANSFER && r.targetAcc == account);
+        });
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
+    // "--stats" may appear anywhere; it prints the metrics snapshot on exit.
+    // "--trace FILE" records trace spans for the whole run and writes them
+    // to FILE as Chrome trace JSON on exit, keeping the last
+    // "--trace-spans N" spans of each thread.
+    bool printStats = false;
+    string tracePath;
+    size_t traceSpans = Trace::DEFAULT_SPANS;
+    vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && string(argv[i]) == "--stats") printStats = true;
+        else if (i > 0 && string(argv[i]) == "--trace" && i + 1 < argc) tracePath = argv[++i];
+        else if (i > 0 && string(argv[i]) == "--trace-spans" && i + 1 < argc) traceSpans = stoul(argv[++i]);
+        else args.push_back(argv[i]);
+    }
+
+    if (!tracePath.empty()) {
+        TRACE_THREAD_NAME("main");
+        Trace::start(traceSpans);
+    }
+    int rc = runCommand(static_cast<int>(args.size()), args.data());
+    if (printStats) cerr << Metrics::snapshot();
+    if (!tracePath.empty() && !Trace::writeChromeJson(tracePath))
+        cerr << "Failed to write trace to " << tracePath << endl;
+    return rc;
+}
+
+int runCommand(int argc, char* argv[]) {
     
     if (argc > 1) {
         string command = argv[1];
 
-        if (command == "deposit" && argc == 4) {
+        if (command == "batch" && (argc == 4 || (argc == 5 && string(argv[4]) == "--net"))) {
+            return runBatch(argv[2], argv[3], argc == 5);
+        }
+
+        else if (command == "replay" && argc >= 4) {
+            return runReplay(argc, argv);
+        }
+
+        else if (command == "serve" && argc >= 3) {
+            return runServe(argc, argv);
+        }
+
+        else if (command == "request" && argc >= 4) {
+            return runRequest(argc, argv);
+        }
+
+        else if (command == "route" && argc >= 4) {
+            return runRoute(argc, argv);
+        }
+
+        else if (command == "check-partitions" && argc >= 3) {
+            return runCheckPartitions(argc, argv);
+        }
+
+        else if (command == "split-accounts" && argc == 5) {
+            PartitionMap map;
+            if (!PartitionMap::parse(argv[3], map)) {
+                cerr << "Bad partition map " << argv[3] << " (hash:N or range:B1,B2,...)" << endl;
+                return 1;
+            }
+            vector<PartitionTotals> parts;
+            string error;
+            if (!splitAccountsFile(argv[2], map, argv[4], parts, &error)) {
+                cerr << error << endl;
+                return 1;
+            }
+            cout << fixed << setprecision(2);
+            for (size_t p = 0; p < parts.size(); p++)
+                cout << argv[4] << "." << p << ": " << parts[p].accounts << " accounts, balance "
+                     << parts[p].balanceCents / 100.0 << endl;
+            cout << "total " << sumTotals(parts).balanceCents / 100.0 << endl;
+            return 0;
+        }
+
+        else if (command == "convert-ledger" && argc == 4) {
+            if (!convertTextLedgerToBinary(argv[2], argv[3])) {
+                cerr << "Failed to convert " << argv[2] << endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        else if (command == "seal-ledger" && argc == 4) {
+            string error;
+            if (!sealLedgerSegment(argv[2], argv[3], &error)) {
+                cerr << error << endl;
+                return 1;
+            }
+            SegmentReader segment;
+            if (segment.open(argv[3])) {
+                double raw = static_cast<double>(segment.records() * sizeof(LedgerRecord));
+                cout << "Sealed " << segment.records() << " records in " << segment.blockCount()
+                     << " blocks, " << segment.fileBytes() << " bytes ("
+                     << fixed << setprecision(2) << (segment.fileBytes() ? raw / segment.fileBytes() : 0.0)
+                     << "x smaller)" << endl;
+            }
+            return 0;
+        }
+
+        else if (command == "unseal-ledger" && argc == 4) {
+            string error;
+            if (!unsealLedgerSegment(argv[2], argv[3], &error)) {
+                cerr << error << endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        else if (command == "build-account-table" && argc == 4) {
+            Banking bank;
+            if (!bank.loadAccountsFromFile(argv[2])) {
+                cerr << "Cannot read " << argv[2] << endl;
+                return 1;
+            }
+            if (!bank.saveAccountTable(argv[3])) {
+                cerr << "Failed to write " << argv[3] << endl;
+                return 1;
+            }
+            cout << "Wrote " << bank.accountCount() << " accounts to " << argv[3] << endl;
+            return 0;
+        }
+
+        else if (command == "aggregates" && argc == 4) {
+            Banking bank;
+            if (!bank.loadAccountsFromFile(argv[2])) {
+                cerr << "Cannot read " << argv[2] << endl;
+                return 1;
+            }
+            const AccountAggregates* agg = bank.getAggregates(stoi(argv[3]));
+            if (!agg) {
+                cerr << "No account " << argv[3] << endl;
+                return 1;
+            }
+            cout << describeAggregates(*agg, time(nullptr));
+            return 0;
+        }
+
+        else if (command == "statement" && argc >= 3) {
+            return runStatement(argc, argv);
+        }
+
+        else if (command == "deposit" && argc == 4) {
             string username = argv[2];
             username = toLower(username);
             double amount = stod(argv[3]);
@@ -126,9 +703,7 @@ int main(int argc, char* argv[]) {
         }
 
         else if (command == "transfer" && argc == 5) {
-            string fromUser = argv[2];
             string fromUser = toLower(argv[2]);
-            string toUser = argv[3];
             string toUser = toLower(argv[3]);
             double amount = stod(argv[4]);
             auto fromTxns = loadTransactionsFromFile(fromUser);
@@ -176,8 +751,8 @@ int main(int argc, char* argv[]) {
 
     auto transactions = loadTransactionsFromFile(username);
     double balance = getBalance(transactions);
-    Stack<Transaction> undoStack;
-    Stack<Transaction> redoStack;
+    Stack<LedgerEntry> undoStack;
+    Stack<LedgerEntry> redoStack;
 
     int choice;
     do {
@@ -0,0 +1,260 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+
+static std::mutex shardsMutex;
+static std::vector<std::unique_ptr<MetricsShard>> shards;
+static MetricsShard retired;             // what threads that have exited recorded
+
+static std::atomic<uint64_t> currentQueueDepth{0};
+static std::atomic<uint64_t> maxQueueDepth{0};
+static std::atomic<uint64_t> currentReplicaBehind{0};
+static std::atomic<uint64_t> maxReplicaBehind{0};
+
+
+const char* metricOpName(MetricOp op) {
+    switch (op) {
+        case MetricOp::Deposit: return "deposit";
+        case MetricOp::Withdraw: return "withdraw";
+        case MetricOp::Transfer: return "transfer";
+        case MetricOp::ProcessNext: return "process_next";
+        case MetricOp::ProcessNetted: return "process_netted";
+        case MetricOp::LoadAccounts: return "load_accounts";
+        case MetricOp::SaveAccounts: return "save_accounts";
+        case MetricOp::LoadLedger: return "load_ledger";
+        case MetricOp::SaveLedger: return "save_ledger";
+        case MetricOp::Fsync: return "fsync";
+        case MetricOp::GroupCommit: return "group_commit";
+        case MetricOp::ReplicationLag: return "replication_lag";
+        case MetricOp::CrossTransfer: return "cross_partition_transfer";
+        default: return "unknown";
+    }
+}
+
+
+// Owner-only increment: a load/store pair avoids a locked RMW instruction.
+static inline void bump(std::atomic<uint64_t> &v, uint64_t by = 1) {
+    v.store(v.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+
+int LatencyHistogram::bucketFor(uint64_t ns) {
+    if (ns < static_cast<uint64_t>(SUB_BUCKETS)) return static_cast<int>(ns);
+    int msb = 63 - __builtin_clzll(ns);
+    int major = msb - SUB_BITS + 1;
+    int sub = static_cast<int>(ns >> (msb - SUB_BITS)) - SUB_BUCKETS;
+    return major * SUB_BUCKETS + sub;
+}
+
+
+uint64_t LatencyHistogram::bucketUpperBound(int bucket) {
+    int major = bucket / SUB_BUCKETS;
+    int sub = bucket % SUB_BUCKETS;
+    if (major == 0) return static_cast<uint64_t>(sub);
+    uint64_t next = static_cast<uint64_t>(SUB_BUCKETS + sub + 1) << (major - 1);
+    return next - 1;
+}
+
+
+void LatencyHistogram::record(uint64_t ns) {
+    bump(buckets[bucketFor(ns)]);
+}
+
+
+void LatencyHistogram::mergeInto(std::array<uint64_t, BUCKETS> &out) const {
+    for (int i = 0; i < BUCKETS; i++)
+        out[i] += buckets[i].load(std::memory_order_relaxed);
+}
+
+
+void LatencyHistogram::absorb(const LatencyHistogram &other) {
+    for (int i = 0; i < BUCKETS; i++) bump(buckets[i], other.buckets[i].load(std::memory_order_relaxed));
+}
+
+
+void LatencyHistogram::reset() {
+    for (auto &b : buckets) b.store(0, std::memory_order_relaxed);
+}
+
+
+static thread_local MetricsShard* ownShard = nullptr;
+
+
+// Folds an exiting thread's shard into `retired` and frees it, so threads
+// that come and go (one per router connection) do not each keep one.
+struct ShardRetirer {
+    ~ShardRetirer() {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        auto it = std::find_if(shards.begin(), shards.end(),
+                               [](const std::unique_ptr<MetricsShard> &s) { return s.get() == ownShard; });
+        if (it == shards.end()) return;
+        const MetricsShard &s = **it;
+        for (size_t i = 0; i < MetricsShard::OPS; i++) {
+            bump(retired.calls[i], s.calls[i].load(std::memory_order_relaxed));
+            bump(retired.failures[i], s.failures[i].load(std::memory_order_relaxed));
+            bump(retired.timed[i], s.timed[i].load(std::memory_order_relaxed));
+            bump(retired.totalNs[i], s.totalNs[i].load(std::memory_order_relaxed));
+            uint64_t m = s.maxNs[i].load(std::memory_order_relaxed);
+            if (m > retired.maxNs[i].load(std::memory_order_relaxed))
+                retired.maxNs[i].store(m, std::memory_order_relaxed);
+            retired.latency[i].absorb(s.latency[i]);
+        }
+        bump(retired.limitRejections, s.limitRejections.load(std::memory_order_relaxed));
+        shards.erase(it);
+        ownShard = nullptr;
+    }
+};
+
+
+MetricsShard& Metrics::local() {
+    if (!ownShard) {
+        auto owned = std::make_unique<MetricsShard>();
+        ownShard = owned.get();
+        {
+            std::lock_guard<std::mutex> lock(shardsMutex);
+            shards.push_back(std::move(owned));
+        }
+        thread_local ShardRetirer retirer;
+    }
+    return *ownShard;
+}
+
+
+static void addLatency(MetricsShard &s, size_t i, uint64_t ns) {
+    bump(s.timed[i]);
+    bump(s.totalNs[i], ns);
+    if (ns > s.maxNs[i].load(std::memory_order_relaxed))
+        s.maxNs[i].store(ns, std::memory_order_relaxed);
+    s.latency[i].record(ns);
+}
+
+
+void Metrics::record(MetricOp op, uint64_t ns, bool ok) {
+    MetricsShard &s = local();
+    size_t i = static_cast<size_t>(op);
+    bump(s.calls[i]);
+    if (!ok) bump(s.failures[i]);
+    addLatency(s, i, ns);
+}
+
+
+bool Metrics::countCall(MetricOp op, bool sampled) {
+    std::atomic<uint64_t> &calls = local().calls[static_cast<size_t>(op)];
+    uint64_t n = calls.load(std::memory_order_relaxed);
+    calls.store(n + 1, std::memory_order_relaxed);
+    return !sampled || n % SAMPLE_EVERY == 0;
+}
+
+
+void Metrics::finishCall(MetricOp op, bool ok, bool timed, uint64_t ns) {
+    if (ok && !timed) return;
+    MetricsShard &s = local();
+    size_t i = static_cast<size_t>(op);
+    if (!ok) bump(s.failures[i]);
+    if (timed) addLatency(s, i, ns);
+}
+
+
+void Metrics::limitRejected() {
+    bump(local().limitRejections);
+}
+
+
+void Metrics::queueDepth(size_t depth) {
+    currentQueueDepth.store(depth, std::memory_order_relaxed);
+    if (depth > maxQueueDepth.load(std::memory_order_relaxed))
+        maxQueueDepth.store(depth, std::memory_order_relaxed);
+}
+
+
+void Metrics::replicaBehind(uint64_t records) {
+    currentReplicaBehind.store(records, std::memory_order_relaxed);
+    if (records > maxReplicaBehind.load(std::memory_order_relaxed))
+        maxReplicaBehind.store(records, std::memory_order_relaxed);
+}
+
+
+static uint64_t percentile(const std::array<uint64_t, LatencyHistogram::BUCKETS> &hist,
+                           uint64_t total, double q) {
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= rank) return LatencyHistogram::bucketUpperBound(i);
+    }
+    return LatencyHistogram::bucketUpperBound(LatencyHistogram::BUCKETS - 1);
+}
+
+
+std::string Metrics::snapshot() {
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(shardsMutex);
+
+    std::vector<const MetricsShard*> all{&retired};
+    for (const auto &s : shards) all.push_back(s.get());
+
+    out << "# banking engine metrics (" << shards.size() << " thread shards)\n";
+    for (size_t i = 0; i < MetricsShard::OPS; i++) {
+        uint64_t calls = 0, failures = 0, timed = 0, totalNs = 0, maxNs = 0;
+        std::array<uint64_t, LatencyHistogram::BUCKETS> hist{};
+        for (const MetricsShard* s : all) {
+            calls += s->calls[i].load(std::memory_order_relaxed);
+            failures += s->failures[i].load(std::memory_order_relaxed);
+            timed += s->timed[i].load(std::memory_order_relaxed);
+            totalNs += s->totalNs[i].load(std::memory_order_relaxed);
+            uint64_t m = s->maxNs[i].load(std::memory_order_relaxed);
+            if (m > maxNs) maxNs = m;
+            s->latency[i].mergeInto(hist);
+        }
+        if (calls == 0) continue;
+
+        out << "op " << std::left << std::setw(14) << metricOpName(static_cast<MetricOp>(i))
+            << " calls=" << calls
+            << " failures=" << failures
+            << " timed=" << timed
+            << " mean_ns=" << (timed ? totalNs / timed : 0)
+            << " p50_ns=" << std::min(maxNs, percentile(hist, timed, 0.50))
+            << " p99_ns=" << std::min(maxNs, percentile(hist, timed, 0.99))
+            << " p999_ns=" << std::min(maxNs, percentile(hist, timed, 0.999))
+            << " max_ns=" << maxNs << "\n";
+    }
+
+    uint64_t rejections = 0;
+    for (const MetricsShard* s : all) rejections += s->limitRejections.load(std::memory_order_relaxed);
+    out << "limit_rejections " << rejections << "\n";
+    out << "queue_depth current=" << currentQueueDepth.load(std::memory_order_relaxed)
+        << " max=" << maxQueueDepth.load(std::memory_order_relaxed) << "\n";
+    out << "replica_behind current=" << currentReplicaBehind.load(std::memory_order_relaxed)
+        << " max=" << maxReplicaBehind.load(std::memory_order_relaxed) << "\n";
+    return out.str();
+}
+
+
+void Metrics::reset() {
+    std::lock_guard<std::mutex> lock(shardsMutex);
+    std::vector<MetricsShard*> all{&retired};
+    for (auto &s : shards) all.push_back(s.get());
+    for (MetricsShard* s : all) {
+        for (size_t i = 0; i < MetricsShard::OPS; i++) {
+            s->calls[i].store(0, std::memory_order_relaxed);
+            s->failures[i].store(0, std::memory_order_relaxed);
+            s->timed[i].store(0, std::memory_order_relaxed);
+            s->totalNs[i].store(0, std::memory_order_relaxed);
+            s->maxNs[i].store(0, std::memory_order_relaxed);
+            s->latency[i].reset();
+        }
+        s->limitRejections.store(0, std::memory_order_relaxed);
+    }
+    currentQueueDepth.store(0, std::memory_order_relaxed);
+    maxQueueDepth.store(0, std::memory_order_relaxed);
+    currentReplicaBehind.store(0, std::memory_order_relaxed);
+    maxReplicaBehind.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,700 @@
+#include "partition.h"
+#include "durable.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+bool PartitionMap::parse(const std::string &spec, PartitionMap &out) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) return false;
+    std::string kind = spec.substr(0, colon);
+    std::stringstream rest(spec.substr(colon + 1));
+    PartitionMap map;
+    try {
+        if (kind == "hash") {
+            std::string n;
+            if (!std::getline(rest, n) || std::stoi(n) < 1) return false;
+            map.partitions = static_cast<size_t>(std::stoi(n));
+        } else if (kind == "range") {
+            std::string bound;
+            while (std::getline(rest, bound, ',')) {
+                int b = std::stoi(bound);
+                if (!map.bounds.empty() && b <= map.bounds.back()) return false;
+                map.bounds.push_back(b);
+            }
+            if (map.bounds.empty()) return false;
+        } else {
+            return false;
+        }
+    } catch (const std::exception &) {
+        return false;
+    }
+    out = map;
+    return true;
+}
+
+
+PartitionMap PartitionMap::hashed(size_t partitions) {
+    PartitionMap map;
+    map.partitions = std::max<size_t>(1, partitions);
+    return map;
+}
+
+
+std::string PartitionMap::describe() const {
+    if (bounds.empty()) return "hash:" + std::to_string(partitions);
+    std::string s = "range:";
+    for (size_t i = 0; i < bounds.size(); i++) s += (i ? "," : "") + std::to_string(bounds[i]);
+    return s;
+}
+
+
+// Both files lead each line with the accNo: "accNo|..." and "accNo L ...".
+static int leadingAccNo(const std::string &line) {
+    try {
+        return std::stoi(line);
+    } catch (const std::exception &) {
+        return -1;
+    }
+}
+
+
+// The balance field of "accNo|name|balance[|age]", which must be a whole
+// finite number.
+static bool balanceField(const std::string &line, size_t at, double &balance) {
+    const char* s = line.c_str() + at;
+    char* end;
+    balance = std::strtod(s, &end);
+    return end != s && (*end == '\0' || *end == '|') && std::isfinite(balance);
+}
+
+
+bool splitAccountsFile(const std::string &path, const PartitionMap &map, const std::string &prefix,
+                       std::vector<PartitionTotals> &totals, std::string* error) {
+    auto fail = [error](const std::string &why) {
+        if (error) *error = why;
+        return false;
+    };
+    std::ifstream accounts(path);
+    if (!accounts) return fail("cannot open " + path);
+
+    const size_t n = map.count();
+    totals.assign(n, PartitionTotals());
+    std::vector<std::unique_ptr<std::ofstream>> outs, aggOuts;
+    for (size_t p = 0; p < n; p++) {
+        std::string name = prefix + "." + std::to_string(p);
+        outs.emplace_back(new std::ofstream(name, std::ios::trunc));
+        aggOuts.emplace_back(new std::ofstream(name + ".agg", std::ios::trunc));
+        if (!*outs.back() || !*aggOuts.back()) return fail("cannot write " + name);
+    }
+
+    std::string line;
+    while (std::getline(accounts, line)) {
+        int accNo = leadingAccNo(line);
+        if (line.empty() || accNo < 0) continue;
+        size_t bal = line.find('|', line.find('|') + 1);
+        double balance = 0.0;
+        if (bal != std::string::npos && !balanceField(line, bal + 1, balance))
+            return fail("malformed balance in " + path + ": " + line);
+        size_t p = map.owner(accNo);
+        *outs[p] << line << '\n';
+        totals[p].accounts++;
+        totals[p].balanceCents += std::llround(balance * 100.0);
+    }
+    std::ifstream aggregates(path + ".agg");
+    while (aggregates && std::getline(aggregates, line)) {
+        int accNo = leadingAccNo(line);
+        if (!line.empty() && accNo >= 0) *aggOuts[map.owner(accNo)] << line << '\n';
+    }
+
+    for (size_t p = 0; p < n; p++) {
+        std::string name = prefix + "." + std::to_string(p);
+        outs[p]->close();
+        aggOuts[p]->close();
+        if (!*outs[p] || !*aggOuts[p] || !syncFile(name) || !syncFile(name + ".agg"))
+            return fail("failed to write " + name);
+    }
+    return true;
+}
+
+
+std::string describeTotals(const PartitionTotals &t) {
+    std::ostringstream out;
+    out << "accounts " << t.accounts << "\n"
+        << "balance_cents " << t.balanceCents << "\n"
+        << "open_holds " << t.openHolds << "\n"
+        << "held_cents " << t.heldCents << "\n"
+        << "last_transfer_id " << t.lastTransferId << "\n";
+    return out.str();
+}
+
+
+bool parseTotals(const std::string &text, PartitionTotals &out) {
+    std::istringstream in(text);
+    std::string key;
+    PartitionTotals t;
+    size_t seen = 0;
+    while (in >> key) {
+        if (key == "accounts" && in >> t.accounts) seen++;
+        else if (key == "balance_cents" && in >> t.balanceCents) seen++;
+        else if (key == "open_holds" && in >> t.openHolds) seen++;
+        else if (key == "held_cents" && in >> t.heldCents) seen++;
+        else if (key == "last_transfer_id" && in >> t.lastTransferId) seen++;
+        else return false;
+    }
+    if (seen != 5) return false;
+    out = t;
+    return true;
+}
+
+
+PartitionTotals sumTotals(const std::vector<PartitionTotals> &parts) {
+    PartitionTotals sum;
+    for (const auto &p : parts) {
+        sum.accounts += p.accounts;
+        sum.balanceCents += p.balanceCents;
+        sum.openHolds += p.openHolds;
+        sum.heldCents += p.heldCents;
+        sum.lastTransferId = std::max(sum.lastTransferId, p.lastTransferId);
+    }
+    return sum;
+}
+
+
+TransferLog::~TransferLog() {
+    if (file) std::fclose(file);
+}
+
+
+bool TransferLog::open(const std::string &logPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    path = logPath;
+    if (path.empty()) return true;
+
+    std::ifstream in(path);
+    std::string kind;
+    while (in >> kind) {
+        PendingTransfer t;
+        if (kind == "B" && in >> t.id >> t.from >> t.to >> t.amount) {
+            pending[t.id] = t;
+        } else if (kind == "D" && in >> t.id) {
+            pending.erase(t.id);
+        } else {
+            break;                           // a torn last line
+        }
+        lastId = std::max(lastId, t.id);
+    }
+    file = std::fopen(path.c_str(), "a");
+    if (!file) {
+        error = "cannot open transfer log " + path;
+        return false;
+    }
+    return true;
+}
+
+
+void TransferLog::observe(int lastTransferId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    lastId = std::max(lastId, lastTransferId);
+}
+
+
+bool TransferLog::begin(std::vector<PendingTransfer> &transfers) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &t : transfers) t.id = ++lastId;
+    if (!file) return true;
+
+    std::string lines;
+    char line[96];
+    for (const auto &t : transfers) {
+        std::snprintf(line, sizeof line, "B %d %d %d %.17g\n", t.id, t.from, t.to, t.amount);
+        lines += line;
+    }
+    long long before = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+    if (std::fwrite(lines.data(), 1, lines.size(), file) == lines.size() && std::fflush(file) == 0 &&
+        syncFd(fileno(file))) {
+        for (const auto &t : transfers) pending[t.id] = t;
+        return true;
+    }
+    error = "cannot write transfer log " + path;
+    // The clients hear UNAVAILABLE either way; what matters is that the file
+    // and `pending` agree, so compact() keeps whatever recovery would redo.
+    std::clearerr(file);
+    if (before < 0 || !truncateFd(fileno(file), before) || !syncFd(fileno(file)))
+        for (const auto &t : transfers) pending[t.id] = t;
+    return false;
+}
+
+
+bool TransferLog::finish(const std::vector<int> &ids, bool sync) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file || ids.empty()) return true;
+    for (int id : ids) {
+        std::fprintf(file, "D %d\n", id);
+        pending.erase(id);
+    }
+    bool written = std::fflush(file) == 0;
+    if (!sync) return true;
+    if (written && syncFd(fileno(file))) return true;
+    std::clearerr(file);
+    error = "cannot sync transfer log " + path;
+    return false;
+}
+
+
+std::vector<PendingTransfer> TransferLog::unfinished() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<PendingTransfer> out;
+    for (const auto &kv : pending) out.push_back(kv.second);
+    return out;
+}
+
+
+bool TransferLog::compact() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file) return true;
+    std::string tmp = path + ".tmp";
+    FILE* fresh = std::fopen(tmp.c_str(), "w");
+    if (!fresh) {
+        error = "cannot write " + tmp;
+        return false;
+    }
+    for (const auto &kv : pending) {
+        const PendingTransfer &t = kv.second;
+        std::fprintf(fresh, "B %d %d %d %.17g\n", t.id, t.from, t.to, t.amount);
+    }
+    bool ok = std::fflush(fresh) == 0 && syncFd(fileno(fresh));
+    std::fclose(fresh);
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        error = "cannot replace transfer log " + path;
+        return false;
+    }
+    std::fclose(file);
+    file = std::fopen(path.c_str(), "a");
+    return file != nullptr;
+}
+
+
+std::string TransferLog::lastError() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return error;
+}
+
+
+PartitionRouter::PartitionRouter(const PartitionMap &map, const std::vector<std::string> &sockets,
+                                 TransferLog &log)
+    : map(map), sockets(sockets), log(log) {
+    for (size_t p = 0; p < sockets.size(); p++) clients.emplace_back(new EngineClient());
+}
+
+
+EngineClient* PartitionRouter::client(size_t partition) {
+    if (partition >= clients.size()) return nullptr;
+    EngineClient &c = *clients[partition];
+    if (!c.connected() && !c.connectUnix(sockets[partition])) {
+        error = "cannot connect to partition " + std::to_string(partition) + " at " + sockets[partition];
+        return nullptr;
+    }
+    return &c;
+}
+
+
+// Sends every leg to its partition, all pipelined, and matches the replies
+// by index. Legs on a partition that cannot be reached are answered
+// STATUS_UNAVAILABLE: their outcome is unknown.
+bool PartitionRouter::exchange(std::vector<Leg> &legs) {
+    std::vector<size_t> sent(clients.size(), 0);
+    for (size_t i = 0; i < legs.size(); i++) {
+        Leg &l = legs[i];
+        l.resp = WireResponse();
+        l.resp.status = STATUS_UNAVAILABLE;
+        l.req.requestId = static_cast<uint32_t>(i);
+        EngineClient* c = client(l.partition);
+        if (!c) continue;
+        c->send(l.req);
+        sent[l.partition]++;
+    }
+
+    bool ok = true;
+    for (size_t p = 0; p < clients.size(); p++) {
+        if (sent[p] == 0 || clients[p]->flush()) continue;
+        clients[p]->close();
+        sent[p] = 0;
+    }
+    for (size_t p = 0; p < clients.size(); p++) {
+        for (size_t got = 0; got < sent[p]; got++) {
+            WireResponse resp;
+            std::string payload;
+            if (!clients[p]->receive(resp, &payload)) {
+                clients[p]->close();
+                break;
+            }
+            if (resp.requestId >= legs.size()) continue;
+            legs[resp.requestId].resp = resp;
+            legs[resp.requestId].payload.swap(payload);
+        }
+    }
+    for (const Leg &l : legs) {
+        if (l.resp.status != STATUS_UNAVAILABLE) continue;
+        if (ok) error = "lost partition " + std::to_string(l.partition) + " at " + sockets[l.partition];
+        ok = false;
+    }
+    return ok;
+}
+
+
+static bool routable(uint8_t op) {
+    return op == OP_DEPOSIT || op == OP_WITHDRAW || op == OP_TRANSFER || op == OP_BALANCE ||
+           op == OP_AGGREGATES || op == OP_HISTORY;
+}
+
+
+// A wave runs up to the first request that touches an account a transfer
+// between partitions earlier in the wave moves money out of or into.
+// Everything else in the wave goes out with the transfers' HOLDs, behind
+// whatever came before it on the same partition.
+bool PartitionRouter::execute(const std::vector<WireRequest> &reqs, std::vector<WireResponse> &resps,
+                              std::vector<std::string>* payloads) {
+    const size_t n = reqs.size();
+    resps.assign(n, WireResponse());
+    if (payloads) payloads->assign(n, std::string());
+    for (size_t i = 0; i < n; i++) {
+        resps[i].requestId = reqs[i].requestId;
+        resps[i].status = STATUS_BAD_REQUEST;
+    }
+
+    bool ok = true;
+    std::vector<Leg> legs;
+    std::vector<size_t> index, crossIndex;
+    std::vector<PendingTransfer> transfers;
+    std::vector<WireResponse> results;
+    std::unordered_set<int> moving;
+    size_t i = 0;
+    while (i < n) {
+        legs.clear();
+        index.clear();
+        crossIndex.clear();
+        transfers.clear();
+        moving.clear();
+        for (; i < n; i++) {
+            const WireRequest &r = reqs[i];
+            if (moving.count(r.accNo) || (r.op == OP_TRANSFER && moving.count(r.targetAcc))) break;
+            if (crosses(r)) {
+                if (!(r.amount > 0)) {
+                    resps[i].status = STATUS_REJECTED;
+                    continue;
+                }
+                PendingTransfer t;
+                t.from = r.accNo;
+                t.to = r.targetAcc;
+                t.amount = r.amount;
+                transfers.push_back(t);
+                crossIndex.push_back(i);
+                moving.insert(r.accNo);
+                moving.insert(r.targetAcc);
+            } else if (routable(r.op)) {
+                legs.push_back({map.owner(r.accNo), r, WireResponse(), std::string()});
+                index.push_back(i);
+            }
+        }
+
+        if (!transfers.empty() && !log.begin(transfers)) {
+            error = log.lastError();
+            for (size_t k : crossIndex) resps[k].status = STATUS_UNAVAILABLE;
+            transfers.clear();
+            crossIndex.clear();
+            ok = false;
+        }
+        ok = runTransfers(transfers, results, legs) && ok;
+        counters.forwarded += legs.size();
+        for (size_t k = 0; k < legs.size(); k++) {
+            resps[index[k]] = legs[k].resp;
+            resps[index[k]].requestId = reqs[index[k]].requestId;
+            if (payloads) (*payloads)[index[k]].swap(legs[k].payload);
+        }
+        for (size_t k = 0; k < crossIndex.size(); k++) {
+            resps[crossIndex[k]] = results[k];
+            resps[crossIndex[k]].requestId = reqs[crossIndex[k]].requestId;
+        }
+    }
+    return ok;
+}
+
+
+bool PartitionRouter::call(const WireRequest &req, WireResponse &resp, std::string* payload) {
+    std::vector<WireResponse> resps;
+    std::vector<std::string> payloads;
+    bool ok = execute({req}, resps, payload ? &payloads : nullptr);
+    resp = resps[0];
+    if (payload) payload->swap(payloads[0]);
+    return ok;
+}
+
+
+// HOLD every transfer (after the `forward` legs, in the same exchange),
+// CREDIT the held ones, then SETTLE the credited ones and REFUND those whose
+// credit was refused. A transfer leaves the log once its outcome is settled
+// either way; one with a leg whose answer was lost stays there, is answered
+// STATUS_UNAVAILABLE, and is re-driven by the next recover(). Each result
+// carries the sender's balance and the HOLD's LSN.
+bool PartitionRouter::runTransfers(const std::vector<PendingTransfer> &transfers,
+                                   std::vector<WireResponse> &results, std::vector<Leg> &forward) {
+    const auto started = std::chrono::steady_clock::now();
+    const size_t n = transfers.size();
+    const size_t first = forward.size();
+    results.assign(n, WireResponse());
+
+    for (const PendingTransfer &t : transfers)
+        forward.push_back({map.owner(t.from), makeRequest(0, OP_HOLD, t.from, t.id, t.amount), WireResponse(), ""});
+    bool ok = exchange(forward);
+    std::vector<Leg> holds(forward.begin() + static_cast<std::ptrdiff_t>(first), forward.end());
+    forward.resize(first);
+    if (n == 0) return ok;
+
+    std::vector<Leg> credits;
+    std::vector<size_t> creditOf;
+    for (size_t i = 0; i < n; i++) {
+        results[i] = holds[i].resp;
+        if (holds[i].resp.status != STATUS_OK) continue;
+        const PendingTransfer &t = transfers[i];
+        credits.push_back({map.owner(t.to), makeRequest(0, OP_CREDIT, t.to, t.id, t.amount), WireResponse(), ""});
+        creditOf.push_back(i);
+    }
+    ok = exchange(credits) && ok;
+
+    std::vector<Leg> closes;
+    std::vector<size_t> closeOf;
+    for (size_t k = 0; k < credits.size(); k++) {
+        size_t i = creditOf[k];
+        uint8_t status = credits[k].resp.status;
+        if (status == STATUS_UNAVAILABLE) {
+            results[i].status = STATUS_UNAVAILABLE;
+            continue;
+        }
+        const PendingTransfer &t = transfers[i];
+        WireOp op = status == STATUS_OK ? OP_SETTLE : OP_REFUND;
+        closes.push_back({map.owner(t.from), makeRequest(0, op, t.from, t.id, t.amount), WireResponse(), ""});
+        closeOf.push_back(i);
+    }
+    ok = exchange(closes) && ok;
+
+    std::vector<int> finished;
+    std::vector<size_t> refused;       // answered as not having happened
+    for (size_t i = 0; i < n; i++) {
+        if (holds[i].resp.status != STATUS_OK && holds[i].resp.status != STATUS_UNAVAILABLE) {
+            finished.push_back(transfers[i].id);
+            refused.push_back(i);
+        }
+    }
+    for (size_t k = 0; k < closes.size(); k++) {
+        size_t i = closeOf[k];
+        bool refund = closes[k].req.op == OP_REFUND;
+        if (closes[k].resp.status == STATUS_OK) {
+            finished.push_back(transfers[i].id);
+            if (refund) {
+                results[i].status = STATUS_REJECTED;
+                results[i].balance = closes[k].resp.balance;
+                counters.refunded++;
+                refused.push_back(i);
+            }
+        } else if (refund) {
+            results[i].status = STATUS_UNAVAILABLE;
+        }
+        // A credited transfer whose SETTLE was lost has still happened.
+    }
+    if (!log.finish(finished, !refused.empty())) {
+        // A crash could still re-drive these, so they have not surely failed.
+        for (size_t i : refused) results[i].status = STATUS_UNAVAILABLE;
+        error = log.lastError();
+        ok = false;
+    }
+
+    [[maybe_unused]] uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - started).count());
+    for (size_t i = 0; i < n; i++) {
+        if (results[i].status == STATUS_UNAVAILABLE) counters.unresolved++;
+        METRICS_CROSS_TRANSFER(ns, results[i].status == STATUS_OK);
+    }
+    counters.crossTransfers += n;
+    return ok;
+}
+
+
+bool PartitionRouter::totals(std::vector<PartitionTotals> &out) {
+    std::vector<Leg> legs;
+    for (size_t p = 0; p < clients.size(); p++) legs.push_back({p, makeRequest(0, OP_TOTALS), WireResponse(), ""});
+    bool ok = exchange(legs);
+    out.assign(legs.size(), PartitionTotals());
+    for (size_t p = 0; p < legs.size(); p++) {
+        if (legs[p].resp.status == STATUS_OK && parseTotals(legs[p].payload, out[p])) continue;
+        if (ok) error = "partition " + std::to_string(p) + " sent no totals";
+        ok = false;
+    }
+    return ok;
+}
+
+
+bool PartitionRouter::recover(size_t* redriven) {
+    std::vector<PartitionTotals> parts;
+    if (!totals(parts)) return false;
+    for (const auto &p : parts) log.observe(p.lastTransferId);
+
+    std::vector<PendingTransfer> pending = log.unfinished();
+    if (redriven) *redriven = pending.size();
+    std::vector<WireResponse> results;
+    std::vector<Leg> none;
+    if (!pending.empty() && !runTransfers(pending, results, none)) return false;
+    if (!log.compact()) {
+        error = log.lastError();
+        return false;
+    }
+    return true;
+}
+
+
+RouterServer::RouterServer(const PartitionMap &map, const std::vector<std::string> &sockets, TransferLog &log,
+                           const std::string &socketPath)
+    : map(map), sockets(sockets), log(log), socketPath(socketPath) {}
+
+
+RouterServer::~RouterServer() {
+    stop();
+    for (auto &w : workers)
+        if (w->thread.joinable()) w->thread.join();
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+
+bool RouterServer::start() {
+    sockaddr_un addr{};
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        error = "unix socket path too long";
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, socketPath.c_str());
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::unlink(socketPath.c_str());
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+        ::listen(listenFd, 128) != 0) {
+        error = "cannot listen on " + socketPath + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+
+void RouterServer::stop() {
+    stopping.store(true);
+    if (listenFd >= 0) ::shutdown(listenFd, SHUT_RDWR);
+}
+
+
+void RouterServer::run() {
+    while (!stopping.load()) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        // Forget clients that have gone away.
+        for (auto it = workers.begin(); it != workers.end();) {
+            if (!(*it)->done.load()) {
+                ++it;
+                continue;
+            }
+            (*it)->thread.join();
+            it = workers.erase(it);
+        }
+        workers.emplace_back(new Worker());
+        Worker &w = *workers.back();
+        w.fd = fd;
+        w.thread = std::thread(&RouterServer::serve, this, std::ref(w));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &w : workers)
+            if (!w->done.load()) ::shutdown(w->fd, SHUT_RDWR);
+    }
+    for (auto &w : workers) w->thread.join();
+    workers.clear();
+}
+
+
+static bool writeAll(int fd, const std::string &data) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        ssize_t sent = ::send(fd, data.data() + pos, data.size() - pos, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        pos += static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+
+// Everything the client has sent so far is answered as one pipeline.
+void RouterServer::serve(Worker &w) {
+    const int fd = w.fd;
+    PartitionRouter router(map, sockets, log);
+    std::vector<char> in;
+    std::vector<WireRequest> reqs;
+    std::vector<WireResponse> resps;
+    std::vector<std::string> payloads;
+    std::string out;
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t got = ::read(fd, buf, sizeof buf);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        in.insert(in.end(), buf, buf + got);
+
+        const size_t frames = in.size() / sizeof(WireRequest);
+        reqs.resize(frames);
+        std::memcpy(reqs.data(), in.data(), frames * sizeof(WireRequest));
+        in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(frames * sizeof(WireRequest)));
+        router.execute(reqs, resps, &payloads);
+
+        out.clear();
+        for (size_t i = 0; i < frames; i++) {
+            const WireRequest &req = reqs[i];
+            std::string &payload = payloads[i];
+            if (req.op == OP_PING) {
+                resps[i].status = STATUS_OK;
+            } else if (req.op == OP_STATS) {
+                resps[i].status = STATUS_OK;
+                payload = Metrics::snapshot();
+            } else if (req.op == OP_TOTALS) {
+                std::vector<PartitionTotals> parts;
+                bool ok = router.totals(parts);
+                resps[i].status = ok ? STATUS_OK : STATUS_UNAVAILABLE;
+                payload = ok ? describeTotals(sumTotals(parts)) : "";
+            }
+            resps[i].payloadLen = static_cast<uint32_t>(payload.size());
+            out.append(reinterpret_cast<const char*>(&resps[i]), sizeof resps[i]);
+            out.append(payload);
+        }
+        if (!writeAll(fd, out)) break;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ::close(fd);
+    w.done.store(true);
+}
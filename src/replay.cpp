@@ -0,0 +1,483 @@
+#include "replay.h"
+#include "durable.h"
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+
+// Records per apply window; windows are also cut at checkpoint boundaries.
+static const size_t WINDOW_RECORDS = 64 * 1024;
+
+// Parallel segments shorter than this run inline: spawning workers for a
+// handful of records costs more than applying them.
+static const size_t MIN_PARALLEL_SEGMENT = 4096;
+
+
+// Buffered reader over either ledger format. offset() is the file position
+// just past the last record returned, which is what checkpoints store.
+class LedgerStream {
+public:
+    LedgerStream(FILE* file, bool binary, uint64_t startOffset)
+        : file(file), binary(binary), bufStart(startOffset), buf(1 << 20) {}
+
+    bool next(Transaction &t, uint64_t &malformed) {
+        return binary ? nextBinary(t) : nextText(t, malformed);
+    }
+
+    uint64_t offset() const { return bufStart + pos; }
+    // LSN of the last record returned; base() before the first.
+    uint64_t lsn() const { return lsnBase + sinceBase; }
+    uint64_t base() const { return lsnBase; }
+    // Picks up the numbering a checkpoint saved, since seeking past the
+    // "#lsn" header skips it.
+    void resume(uint64_t base, uint64_t last) {
+        lsnBase = base;
+        sinceBase = last - base;
+    }
+
+private:
+    FILE* file;
+    bool binary;
+    uint64_t bufStart;          // file offset of buf[0]
+    std::vector<char> buf;
+    size_t pos = 0, len = 0;
+    bool eof = false;
+    uint64_t lsnBase = 0, sinceBase = 0;
+    std::time_t readAt = 0;     // stamps lines that carry no timestamp of their own
+
+    // Keeps the unread tail, reads more behind it and NUL-terminates so the
+    // strto* parsers can never run off the end of the data.
+    bool fill() {
+        if (eof) return false;
+        if (pos > 0) {
+            std::memmove(buf.data(), buf.data() + pos, len - pos);
+            bufStart += pos;
+            len -= pos;
+            pos = 0;
+        }
+        if (len + 1 >= buf.size()) buf.resize(buf.size() * 2);
+        size_t got = std::fread(buf.data() + len, 1, buf.size() - len - 1, file);
+        readAt = std::time(nullptr);
+        if (got == 0) eof = true;
+        len += got;
+        buf[len] = '\0';
+        return got > 0;
+    }
+
+    bool nextBinary(Transaction &t) {
+        while (len - pos < sizeof(LedgerRecord)) {
+            if (!fill()) return false;
+        }
+        LedgerRecord r;
+        std::memcpy(&r, buf.data() + pos, sizeof r);
+        pos += sizeof r;
+        t = fromLedgerRecord(r);
+        sinceBase++;
+        return true;
+    }
+
+    bool nextText(Transaction &t, uint64_t &malformed) {
+        for (;;) {
+            char* start = buf.data() + pos;
+            char* nl = static_cast<char*>(std::memchr(start, '\n', len - pos));
+            if (!nl) {
+                if (fill()) continue;
+                if (pos == len) return false;
+                nl = buf.data() + len;      // last line without a newline
+            }
+            size_t lineLen = static_cast<size_t>(nl - start);
+            pos = std::min(len, static_cast<size_t>(nl - buf.data()) + 1);
+
+            if (lineLen == 0 || (lineLen == 1 && *start == '\r')) continue;
+            if (*start == '#') {
+                if (lineLen > 5 && std::memcmp(start, "#lsn ", 5) == 0) {
+                    lsnBase = std::strtoull(start + 5, nullptr, 10);
+                    sinceBase = 0;
+                    continue;
+                }
+            } else if (parseLine(start, nl, readAt, t)) {
+                sinceBase++;
+                return true;
+            }
+            malformed++;
+        }
+    }
+
+    // Hand-rolled equivalent of parseTransactionLine() without the
+    // stringstream and temporary strings.
+    static bool parseLine(char* p, char* end, std::time_t readAt, Transaction &t) {
+        char* bar = static_cast<char*>(std::memchr(p, '|', static_cast<size_t>(end - p)));
+        if (!bar) return false;
+        size_t n = static_cast<size_t>(bar - p);
+        TransactionType type = UNKNOWN;
+        if (n == 7 && std::memcmp(p, "DEPOSIT", 7) == 0) type = DEPOSIT;
+        else if (n == 8 && std::memcmp(p, "WITHDRAW", 8) == 0) type = WITHDRAW;
+        else if (n == 8 && std::memcmp(p, "TRANSFER", 8) == 0) type = TRANSFER;
+        else if (n == 4 && std::memcmp(p, "HOLD", 4) == 0) type = HOLD;
+        else if (n == 6 && std::memcmp(p, "CREDIT", 6) == 0) type = CREDIT;
+        else if (n == 6 && std::memcmp(p, "SETTLE", 6) == 0) type = SETTLE;
+        else if (n == 6 && std::memcmp(p, "REFUND", 6) == 0) type = REFUND;
+        else return false;
+
+        char* q = bar + 1;
+        long acc = std::strtol(q, &q, 10);
+        if (*q != '|') return false;
+        long target = 0;
+        if (type == TRANSFER || isEscrowLeg(type)) {
+            target = std::strtol(q + 1, &q, 10);
+            if (*q != '|') return false;
+        }
+        char* amountStart = q + 1;
+        double amount = std::strtod(amountStart, &q);
+        if (q == amountStart || q > end) return false;
+        std::time_t when = readAt;
+        if (*q == '|' && q < end) {
+            char* stampStart = q + 1;
+            long long stamp = std::strtoll(stampStart, &q, 10);
+            if (q == stampStart || q > end) return false;
+            when = static_cast<std::time_t>(stamp);
+        }
+
+        t.type = type;
+        t.accNo = static_cast<int>(acc);
+        t.targetAcc = static_cast<int>(target);
+        t.amount = amount;
+        t.timestamp = when;
+        return true;
+    }
+};
+
+
+ReplayEngine::ReplayEngine(Banking &bank, const ReplayOptions &opts)
+    : bank(bank), opts(opts) {}
+
+
+bool ReplayEngine::run(const std::string &ledgerPath, ReplayStats &stats) {
+    stats = ReplayStats();
+    uint64_t offset = 0;
+    uint64_t done = 0;
+    uint64_t baseLsn = 0, lastLsn = 0;
+
+    if (opts.resume && !opts.checkpointPath.empty()) {
+        std::ifstream probe(opts.checkpointPath);
+        if (probe && !loadCheckpoint(offset, done, baseLsn, lastLsn)) return false;
+    }
+    stats.resumedFrom = done;
+
+    FILE* file = std::fopen(ledgerPath.c_str(), "rb");
+    if (!file) {
+        error = "cannot open ledger " + ledgerPath;
+        return false;
+    }
+    if (offset > 0 && std::fseek(file, static_cast<long>(offset), SEEK_SET) != 0) {
+        std::fclose(file);
+        error = "cannot seek to checkpoint offset";
+        return false;
+    }
+
+    bool parallel = opts.threads > 1 && opts.skipLimits && opts.skipMessages;
+    LedgerStream stream(file, opts.binary, offset);
+    stream.resume(baseLsn, lastLsn);
+    std::vector<Transaction> window;
+    window.reserve(WINDOW_RECORDS);
+
+    auto started = std::chrono::steady_clock::now();
+    bool more = true;
+    while (more) {
+        size_t limit = WINDOW_RECORDS;
+        if (opts.checkpointEvery > 0) {
+            size_t untilCheckpoint = opts.checkpointEvery - (done % opts.checkpointEvery);
+            if (untilCheckpoint < limit) limit = untilCheckpoint;
+        }
+
+        window.clear();
+        Transaction t;
+        while (window.size() < limit) {
+            if (!stream.next(t, stats.malformed)) {
+                more = false;
+                break;
+            }
+            if (stream.lsn() <= opts.appliedLsn) {
+                stats.skipped++;
+                continue;
+            }
+            window.push_back(t);
+        }
+        if (window.empty()) break;
+
+        if (parallel) applyParallel(window, stats);
+        else applySequential(window, stats);
+
+        stats.records += window.size();
+        done += window.size();
+
+        if (opts.checkpointEvery > 0 && done % opts.checkpointEvery == 0) {
+            if (!writeCheckpoint(stream.offset(), done, stream.base(), stream.lsn())) {
+                std::fclose(file);
+                return false;
+            }
+            stats.checkpoints++;
+        }
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    stats.bytes = stream.offset() - offset;
+    stats.baseLsn = stream.base();
+    stats.lastLsn = stream.lsn();
+    std::fclose(file);
+    return true;
+}
+
+
+void ReplayEngine::applySequential(const std::vector<Transaction> &window, ReplayStats &stats) {
+    const bool checkLimits = !opts.skipLimits;
+    for (const auto &t : window) {
+        bool ok = bank.applyTransaction(t, checkLimits);
+        if (ok) stats.applied++;
+        else stats.rejected++;
+        if (!opts.skipMessages)
+            std::cout << (ok ? "✅ " : "❌ ") << describeTransaction(t, ok) << "\n";
+    }
+}
+
+
+// Same acceptance rules as Banking::applyTransaction without the limit
+// check, on accounts that were resolved up front.
+static bool applyResolved(const Transaction &t, Account* from, Account* to) {
+    if (t.amount <= 0 || !from) return false;
+    switch (t.type) {
+        case DEPOSIT:
+            from->balance += t.amount;
+            break;
+        case WITHDRAW:
+            if (from->balance < t.amount) return false;
+            from->balance -= t.amount;
+            break;
+        case TRANSFER:
+            if (!to || from->balance < t.amount) return false;
+            from->balance -= t.amount;
+            to->balance += t.amount;
+            break;
+        default:
+            return false;
+    }
+    recordAggregates(t, from, to, 1);
+    return true;
+}
+
+
+// Accounts are sharded by accNo. A record only touches its own shard unless
+// it is a transfer between shards; those act as barriers and are applied
+// alone, so every account still sees its records in ledger order. Escrow
+// legs share the bank's hold table and are barriers too.
+void ReplayEngine::applyParallel(const std::vector<Transaction> &window, ReplayStats &stats) {
+    const unsigned shards = opts.threads;
+    const size_t n = window.size();
+    std::vector<Account*> from(n), to(n);
+    for (size_t i = 0; i < n; i++) {
+        from[i] = bank.findAccount(window[i].accNo);
+        to[i] = window[i].type == TRANSFER ? bank.findAccount(window[i].targetAcc) : nullptr;
+    }
+    auto shardOf = [shards](int accNo) { return static_cast<unsigned>(accNo) % shards; };
+
+    auto runSegment = [&](size_t begin, size_t end) {
+        if (end - begin < MIN_PARALLEL_SEGMENT) {
+            for (size_t i = begin; i < end; i++) {
+                if (applyResolved(window[i], from[i], to[i])) stats.applied++;
+                else stats.rejected++;
+            }
+            return;
+        }
+        std::vector<uint64_t> applied(shards, 0);
+        std::vector<std::thread> workers;
+        for (unsigned s = 0; s < shards; s++) {
+            workers.emplace_back([&, s]() {
+                uint64_t ok = 0;
+                for (size_t i = begin; i < end; i++) {
+                    if (shardOf(window[i].accNo) != s) continue;
+                    ok += applyResolved(window[i], from[i], to[i]);
+                }
+                applied[s] = ok;
+            });
+        }
+        uint64_t total = 0;
+        for (unsigned s = 0; s < shards; s++) {
+            workers[s].join();
+            total += applied[s];
+        }
+        stats.applied += total;
+        stats.rejected += (end - begin) - total;
+    };
+
+    size_t segStart = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Transaction &t = window[i];
+        bool crossShard = t.type == TRANSFER && shardOf(t.accNo) != shardOf(t.targetAcc);
+        if (!crossShard && !isEscrowLeg(t.type)) continue;
+        runSegment(segStart, i);
+        bool ok = isEscrowLeg(t.type) ? bank.applyEscrowLeg(t, false) : applyResolved(t, from[i], to[i]);
+        if (ok) stats.applied++;
+        else stats.rejected++;
+        segStart = i + 1;
+    }
+    runSegment(segStart, n);
+    bank.publishAll();   // the shard workers bypass the seqlock
+}
+
+
+// Checkpoint file: "offset N", "records N" and "lsn BASE LAST" lines (the
+// ledger's "#lsn" base and the last record's LSN), the escrow holds and
+// credits as "#hold"/"#credit" lines, then every account in the
+// accounts-file format, then an "aggregates" line followed by the
+// per-account aggregates. Written to a temp file and renamed into place so
+// a crash leaves either the old or the new checkpoint.
+bool ReplayEngine::writeCheckpoint(uint64_t offset, uint64_t records, uint64_t baseLsn, uint64_t lastLsn) {
+    std::string tmp = opts.checkpointPath + ".tmp";
+    std::ofstream file(tmp, std::ios::trunc);
+    if (!file) {
+        error = "cannot write checkpoint " + tmp;
+        return false;
+    }
+    file << "offset " << offset << "\n" << "records " << records << "\n";
+    file << "lsn " << baseLsn << " " << lastLsn << "\n";
+    bank.writeEscrow(file);
+    file << std::setprecision(17);     // balances must come back bit for bit
+    bank.forEachAccount([&file](const Account &a) {
+        file << a.accNo << '|' << a.name << '|' << a.balance << '|' << a.age << '\n';
+    }, false);
+    file << "aggregates\n";
+    bank.forEachAccount([&file](const Account &a) {
+        if (!a.aggregates.empty()) a.aggregates.write(file, a.accNo);
+    });
+    file.close();
+
+    if (!file || !syncFile(tmp) || !replaceFile(tmp, opts.checkpointPath)) {
+        error = "failed to persist checkpoint " + opts.checkpointPath;
+        return false;
+    }
+    return true;
+}
+
+
+// "accNo|name|balance[|age]", every number whole and in range.
+static bool parseCheckpointAccount(const std::string &line, int &accNo, std::string &name, double &balance, int &age) {
+    size_t nameAt = line.find('|');
+    size_t balanceAt = nameAt == std::string::npos ? nameAt : line.find('|', nameAt + 1);
+    if (nameAt == 0 || balanceAt == std::string::npos) return false;
+    size_t ageAt = line.find('|', balanceAt + 1);
+    const char* s = line.c_str();
+    char* end;
+
+    errno = 0;
+    long acc = std::strtol(s, &end, 10);
+    if (end != s + nameAt || errno == ERANGE || acc < INT_MIN || acc > INT_MAX) return false;
+    balance = std::strtod(s + balanceAt + 1, &end);
+    if (end == s + balanceAt + 1 || end != s + (ageAt == std::string::npos ? line.size() : ageAt)) return false;
+    age = 18;
+    if (ageAt != std::string::npos) {
+        long a = std::strtol(s + ageAt + 1, &end, 10);
+        if (end == s + ageAt + 1 || *end != '\0' || a < 0 || a > INT_MAX) return false;
+        age = static_cast<int>(a);
+    }
+    accNo = static_cast<int>(acc);
+    name = line.substr(nameAt + 1, balanceAt - nameAt - 1);
+    return true;
+}
+
+
+bool ReplayEngine::loadCheckpoint(uint64_t &offset, uint64_t &records, uint64_t &baseLsn, uint64_t &lastLsn) {
+    std::ifstream file(opts.checkpointPath);
+    std::string key;
+    if (!(file >> key >> offset) || key != "offset" || !(file >> key >> records) || key != "records") {
+        error = "malformed checkpoint " + opts.checkpointPath;
+        return false;
+    }
+    file.ignore();
+    // Checkpoints written before the "lsn" line resume numbering from 0.
+    baseLsn = lastLsn = 0;
+    if (file.peek() == 'l') {
+        if (!(file >> key >> baseLsn >> lastLsn) || key != "lsn" || lastLsn < baseLsn) {
+            error = "malformed checkpoint " + opts.checkpointPath;
+            return false;
+        }
+        file.ignore();
+    }
+
+    // The checkpoint's escrow replaces whatever the account file brought.
+    bank.holds.clear();
+    bank.credits.clear();
+
+    std::string line;
+    bool inAggregates = false;
+    AccountAggregates agg;
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        if (!inAggregates && line[0] == '#') {
+            if (!bank.parseEscrowLine(line)) {
+                error = "malformed checkpoint " + opts.checkpointPath + ": " + line;
+                return false;
+            }
+            continue;
+        }
+        if (line == "aggregates") {
+            inAggregates = true;
+            continue;
+        }
+        if (inAggregates) {
+            int accNo = 0;
+            Account* a = AccountAggregates::parse(line, accNo, agg) ? bank.findAccount(accNo) : nullptr;
+            if (a) {
+                a->aggregates = agg;
+                a->transactionCount = static_cast<int>(agg.transactionCount());
+            }
+            continue;
+        }
+        int accNo = 0, age = 18;
+        std::string name;
+        double balance = 0.0;
+        if (!parseCheckpointAccount(line, accNo, name, balance, age)) {
+            error = "malformed checkpoint " + opts.checkpointPath + ": " + line;
+            return false;
+        }
+        if (Account* a = bank.findAccount(accNo)) {
+            a->balance = balance;
+            continue;
+        }
+        bank.addLoadedAccount(accNo, name, balance, age);
+    }
+    bank.publishAll();
+    return true;
+}
+
+
+bool convertTextLedgerToBinary(const std::string &textPath, const std::string &binaryPath) {
+    FILE* in = std::fopen(textPath.c_str(), "rb");
+    if (!in) return false;
+
+    LedgerStream stream(in, false, 0);
+    std::vector<LedgerRecord> chunk;
+    chunk.reserve(WINDOW_RECORDS);
+    uint64_t malformed = 0;
+    bool first = true, ok = true;
+    Transaction t;
+
+    for (;;) {
+        bool more = stream.next(t, malformed);
+        if (more) chunk.push_back(toLedgerRecord(t));
+        if (chunk.size() == WINDOW_RECORDS || (!more && (first || !chunk.empty()))) {
+            ok = writeLedgerRecords(binaryPath, chunk, !first);
+            first = false;
+            chunk.clear();
+            if (!ok) break;
+        }
+        if (!more) break;
+    }
+    std::fclose(in);
+    return ok;
+}
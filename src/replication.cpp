@@ -0,0 +1,419 @@
+#include "replication.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// A primary with nothing to send heartbeats this often.
+static const std::chrono::milliseconds HEARTBEAT_INTERVAL(100);
+// How long a follower waits before reconnecting to its primary.
+static const std::chrono::milliseconds RECONNECT_DELAY(200);
+// Frames for one follower are batched into sends of about this size.
+static const size_t MAX_SEND_BYTES = 1 << 20;
+// The WAL loaded at start is split into records frames of this many lines.
+static const size_t PRELOAD_LINES = 4096;
+
+
+static int64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static bool sendAll(int fd, const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t sent = ::send(fd, data, n, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        data += sent;
+        n -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+
+static bool readFull(int fd, void* buf, size_t n) {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t got = ::read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+
+static bool fillUnixAddr(const std::string &path, sockaddr_un &addr) {
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+
+static void appendFrame(std::string &out, uint8_t kind, uint64_t lsn, uint64_t primaryLsn, int64_t committedNs,
+                        const char* payload = nullptr, size_t len = 0) {
+    ReplFrame f{};
+    f.kind = kind;
+    f.payloadLen = static_cast<uint32_t>(len);
+    f.lsn = lsn;
+    f.primaryLsn = primaryLsn;
+    f.committedNs = committedNs;
+    out.append(reinterpret_cast<const char*>(&f), sizeof f);
+    if (len) out.append(payload, len);
+}
+
+
+LogShipper::~LogShipper() {
+    stop();
+}
+
+
+bool LogShipper::start(const std::string &walPath, uint64_t startLsn) {
+    windowLsn = lastLsn = startLsn;
+    if (!walPath.empty()) {
+        std::ifstream in(walPath, std::ios::binary);
+        if (in) log.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        size_t whole = log.rfind('\n');
+        log.resize(whole == std::string::npos ? 0 : whole + 1);
+        // The "#lsn" header numbers the records; it is not shipped.
+        uint64_t base = 0;
+        if (log.compare(0, 5, "#lsn ") == 0) {
+            base = std::strtoull(log.c_str() + 5, nullptr, 10);
+            log.erase(0, log.find('\n') + 1);
+        }
+        windowLsn = lastLsn = base;
+
+        int64_t now = steadyNs();
+        size_t begin = 0, lines = 0;
+        for (size_t i = 0; i < log.size(); i++) {
+            if (log[i] != '\n' || (++lines % PRELOAD_LINES != 0 && i + 1 != log.size())) continue;
+            uint64_t first = lastLsn + 1;
+            lastLsn = base + lines;
+            batches.push_back({first, lastLsn, begin, i + 1, now});
+            begin = i + 1;
+        }
+        // A WAL that ends short of the snapshot does not lead up to the
+        // records that come next, so none of it is shipped.
+        if (lastLsn != startLsn) {
+            log.clear();
+            batches.clear();
+            windowLsn = lastLsn = startLsn;
+        }
+        dropOldBatches();
+    }
+
+    sockaddr_un addr;
+    if (!fillUnixAddr(socketPath, addr)) {
+        error = "replication socket path too long";
+        return false;
+    }
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::unlink(socketPath.c_str());
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+        ::listen(listenFd, 16) != 0) {
+        error = "cannot listen on " + socketPath + ": " + std::strerror(errno);
+        return false;
+    }
+    acceptor = std::thread(&LogShipper::acceptLoop, this);
+    return true;
+}
+
+
+void LogShipper::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || listenFd < 0) return;
+        stopping = true;
+        for (auto &f : followerList)
+            if (f->fd >= 0) ::shutdown(f->fd, SHUT_RDWR);
+    }
+    cv.notify_all();
+    ::shutdown(listenFd, SHUT_RDWR);
+    if (acceptor.joinable()) acceptor.join();
+    for (auto &f : followerList)
+        if (f->thread.joinable()) f->thread.join();
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+}
+
+
+void LogShipper::append(const std::string &walLines, uint64_t lsn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batches.push_back({lastLsn + 1, lsn, log.size(), log.size() + walLines.size(), steadyNs()});
+        log += walLines;
+        lastLsn = lsn;
+        dropOldBatches();
+    }
+    cv.notify_all();
+}
+
+
+// Called with `mutex` held. The newest batch always stays; the log is
+// compacted once more than half of it is dropped batches.
+void LogShipper::dropOldBatches() {
+    while (batches.size() > 1 && log.size() - logStart > windowBytes) {
+        windowLsn = batches.front().lastLsn;
+        logStart = batches.front().end;
+        batches.pop_front();
+    }
+    if (logStart == 0 || logStart < log.size() / 2) return;
+    log.erase(0, logStart);
+    for (auto &b : batches) {
+        b.begin -= logStart;
+        b.end -= logStart;
+    }
+    logStart = 0;
+}
+
+
+uint64_t LogShipper::lsn() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastLsn;
+}
+
+
+std::vector<FollowerInfo> LogShipper::followers() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<FollowerInfo> out;
+    for (const auto &f : followerList)
+        out.push_back({f->acked.load(std::memory_order_relaxed), f->connected.load(std::memory_order_relaxed)});
+    return out;
+}
+
+
+void LogShipper::acceptLoop() {
+    for (;;) {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;   // shut down by stop()
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            ::close(fd);
+            return;
+        }
+        // Forget followers that have gone away.
+        for (auto it = followerList.begin(); it != followerList.end();) {
+            if ((*it)->connected.load()) {
+                ++it;
+                continue;
+            }
+            (*it)->thread.join();
+            it = followerList.erase(it);
+        }
+        followerList.emplace_back(new Follower());
+        Follower &f = *followerList.back();
+        f.fd = fd;
+        f.thread = std::thread(&LogShipper::serve, this, std::ref(f));
+    }
+}
+
+
+void LogShipper::serve(Follower &f) {
+    ReplHello hello{};
+    std::string out;
+    bool ok = readFull(f.fd, &hello, sizeof hello);
+    uint64_t pos = hello.appliedLsn;
+    f.acked.store(pos, std::memory_order_relaxed);
+
+    if (ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pos > lastLsn) {
+            std::string why = "follower at LSN " + std::to_string(pos) + " is ahead of the primary (" +
+                              std::to_string(lastLsn) + "); re-seed it from the primary's accounts file";
+            appendFrame(out, REPL_REFUSED, lastLsn, lastLsn, 0, why.data(), why.size());
+            sendAll(f.fd, out.data(), out.size());
+            ok = false;
+        }
+    }
+
+    char ackBuf[sizeof(uint64_t)];
+    size_t ackHave = 0;
+    while (ok) {
+        out.clear();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, HEARTBEAT_INTERVAL, [&] { return stopping || lastLsn > pos; });
+            if (stopping) break;
+            if (pos < windowLsn) {
+                std::string why = "follower at LSN " + std::to_string(pos) + " is behind the primary's log (kept from " +
+                                  std::to_string(windowLsn + 1) + "); re-seed it from the primary's accounts file";
+                appendFrame(out, REPL_REFUSED, lastLsn, lastLsn, 0, why.data(), why.size());
+                ok = false;
+            }
+            auto it = std::upper_bound(batches.begin(), batches.end(), pos,
+                                       [](uint64_t v, const Batch &b) { return v < b.lastLsn; });
+            for (; ok && it != batches.end() && out.size() < MAX_SEND_BYTES; ++it) {
+                size_t begin = it->begin;
+                // A follower can resume in the middle of a batch.
+                for (uint64_t skip = pos >= it->firstLsn ? pos - it->firstLsn + 1 : 0; skip > 0; skip--)
+                    begin = log.find('\n', begin) + 1;
+                appendFrame(out, REPL_RECORDS, it->lastLsn, lastLsn, it->committedNs,
+                            log.data() + begin, it->end - begin);
+                pos = it->lastLsn;
+            }
+            if (ok && out.empty())
+                appendFrame(out, REPL_HEARTBEAT, lastLsn, lastLsn, batches.empty() ? 0 : batches.back().committedNs);
+        }
+        if (!sendAll(f.fd, out.data(), out.size()) || !ok) break;
+
+        for (;;) {
+            ssize_t got = ::recv(f.fd, ackBuf + ackHave, sizeof ackBuf - ackHave, MSG_DONTWAIT);
+            if (got <= 0) {
+                ok = got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+                break;
+            }
+            ackHave += static_cast<size_t>(got);
+            if (ackHave == sizeof ackBuf) {
+                uint64_t acked;
+                std::memcpy(&acked, ackBuf, sizeof acked);
+                f.acked.store(acked, std::memory_order_relaxed);
+                ackHave = 0;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ::close(f.fd);
+    f.fd = -1;
+    f.connected.store(false);
+}
+
+
+ReplicaFollower::~ReplicaFollower() {
+    stop();
+}
+
+
+void ReplicaFollower::start(const std::string &path) {
+    stop();
+    primaryPath = path;
+    stopping.store(false);
+    worker = std::thread(&ReplicaFollower::run, this);
+}
+
+
+void ReplicaFollower::stop() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(statusMutex);
+        if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+    }
+    if (worker.joinable()) worker.join();
+}
+
+
+ReplicaStatus ReplicaFollower::status() const {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    return current;
+}
+
+
+std::string ReplicaFollower::lastError() const {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    return error;
+}
+
+
+void ReplicaFollower::run() {
+    while (!stopping.load()) {
+        sockaddr_un addr;
+        int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool connected = sock >= 0 && fillUnixAddr(primaryPath, addr) &&
+                         ::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0;
+        bool retry = true;
+        if (connected) {
+            {
+                std::lock_guard<std::mutex> lock(statusMutex);
+                fd = sock;
+            }
+            // stop() may have come in before fd was set.
+            if (!stopping.load()) retry = follow(sock);
+            std::lock_guard<std::mutex> lock(statusMutex);
+            fd = -1;
+            current.connected = false;
+        }
+        if (sock >= 0) ::close(sock);
+        if (!retry) return;
+
+        auto until = std::chrono::steady_clock::now() + RECONNECT_DELAY;
+        while (!stopping.load() && std::chrono::steady_clock::now() < until)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+
+// Returns false when the primary refused this follower, true when the
+// stream merely ended and is worth reconnecting.
+bool ReplicaFollower::follow(int sock) {
+    ReplHello hello{committer.committedLsn()};
+    if (!sendAll(sock, reinterpret_cast<const char*>(&hello), sizeof hello)) return true;
+    {
+        std::lock_guard<std::mutex> lock(statusMutex);
+        current.connected = true;
+        current.appliedLsn = hello.appliedLsn;
+    }
+
+    std::string payload;
+    while (!stopping.load()) {
+        ReplFrame frame;
+        if (!readFull(sock, &frame, sizeof frame)) return true;
+        payload.resize(frame.payloadLen);
+        if (frame.payloadLen && !readFull(sock, &payload[0], payload.size())) return true;
+
+        if (frame.kind == REPL_REFUSED) {
+            std::lock_guard<std::mutex> lock(statusMutex);
+            error = payload;
+            return false;
+        }
+
+        bool applied = false;
+        if (frame.kind == REPL_RECORDS) {
+            uint64_t lines = static_cast<uint64_t>(std::count(payload.begin(), payload.end(), '\n'));
+            if (committer.committedLsn() + lines != frame.lsn) {
+                std::lock_guard<std::mutex> lock(statusMutex);
+                error = "gap in the replication stream before LSN " + std::to_string(frame.lsn);
+                return true;   // reconnecting resumes from our LSN
+            }
+            if (!committer.applyReplicated(payload)) {
+                std::lock_guard<std::mutex> lock(statusMutex);
+                error = committer.lastError();
+                return true;
+            }
+            applied = true;
+        }
+
+        uint64_t lsn = committer.committedLsn();
+        {
+            std::lock_guard<std::mutex> lock(statusMutex);
+            current.appliedLsn = lsn;
+            current.primaryLsn = std::max(frame.primaryLsn, lsn);
+            if (applied) {
+                double lagMs = static_cast<double>(steadyNs() - frame.committedNs) / 1e6;
+                current.frames++;
+                current.lastLagMs = lagMs;
+                current.maxLagMs = std::max(current.maxLagMs, lagMs);
+                totalLagMs += lagMs;
+                current.meanLagMs = totalLagMs / static_cast<double>(current.frames);
+                METRICS_REPLICATION_LAG(static_cast<uint64_t>(std::max(0.0, lagMs * 1e6)));
+            }
+            METRICS_REPLICA_BEHIND(current.behind());
+        }
+        if (!sendAll(sock, reinterpret_cast<const char*>(&lsn), sizeof lsn)) return true;
+    }
+    return true;
+}
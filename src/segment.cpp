@@ -0,0 +1,380 @@
+#include "segment.h"
+#include "durable.h"
+#include "ledger_view.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char SEGMENT_MAGIC[8] = {'B', 'T', 'M', 'S', 'E', 'G', '0', '2'};
+static const char SEGMENT_MAGIC_V1[8] = {'B', 'T', 'M', 'S', 'E', 'G', '0', '1'};
+
+enum { SEC_TIMESTAMPS, SEC_ACCOUNTS, SEC_TARGETS, SEC_AMOUNTS, SEC_BALANCES, SEC_COUNT };
+
+
+static inline uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+
+static inline int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+
+static inline void putVarint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+
+static inline bool getVarint(const uint8_t* &p, const uint8_t* end, uint64_t &v) {
+    if (p < end && *p < 0x80) {             // most ids and deltas fit in one byte
+        v = *p++;
+        return true;
+    }
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        result |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Whole cents as (zigzag << 1); anything else as the tag 1 and the raw bits.
+static inline void putMoney(std::string &out, double v) {
+    if (std::fabs(v) < 1e15) {
+        int64_t cents = std::llround(v * 100.0);
+        if (static_cast<double>(cents) / 100.0 == v) {
+            putVarint(out, zigzag(cents) << 1);
+            return;
+        }
+    }
+    putVarint(out, 1);
+    char raw[sizeof(double)];
+    std::memcpy(raw, &v, sizeof raw);
+    out.append(raw, sizeof raw);
+}
+
+
+static inline bool getMoney(const uint8_t* &p, const uint8_t* end, double &v) {
+    uint64_t code;
+    if (!getVarint(p, end, code)) return false;
+    if (!(code & 1)) {
+        v = static_cast<double>(unzigzag(code >> 1)) / 100.0;
+        return true;
+    }
+    if (end - p < static_cast<std::ptrdiff_t>(sizeof(double))) return false;
+    std::memcpy(&v, p, sizeof v);
+    p += sizeof v;
+    return true;
+}
+
+
+void encodeSegmentBlock(const LedgerRecord* records, size_t n, std::string &out) {
+    std::string nibbles((n + 1) / 2, '\0');
+    std::string sections[SEC_COUNT];
+    int64_t prevTs = n ? records[0].timestamp : 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const LedgerRecord &r = records[i];
+        uint8_t type = static_cast<uint8_t>(ledgerType(r.type));
+        bool hasTarget = r.targetAcc != 0;
+        uint8_t code = static_cast<uint8_t>(type | (hasTarget ? 8 : 0));
+        nibbles[i / 2] = static_cast<char>(nibbles[i / 2] | (code << ((i & 1) * 4)));
+
+        putVarint(sections[SEC_TIMESTAMPS], zigzag(r.timestamp - prevTs));
+        prevTs = r.timestamp;
+        putVarint(sections[SEC_ACCOUNTS], zigzag(r.accNo));
+        if (hasTarget) putVarint(sections[SEC_TARGETS], zigzag(r.targetAcc));
+        putMoney(sections[SEC_AMOUNTS], r.amount);
+        putMoney(sections[SEC_BALANCES], r.balanceAfter);
+    }
+
+    SegmentBlockHeader h{};
+    h.records = static_cast<uint32_t>(n);
+    h.baseTimestamp = n ? records[0].timestamp : 0;
+    size_t payload = nibbles.size();
+    for (int s = 0; s < SEC_COUNT; s++) {
+        h.sectionBytes[s] = static_cast<uint32_t>(sections[s].size());
+        payload += sections[s].size();
+    }
+    h.payloadBytes = static_cast<uint32_t>(payload);
+
+    out.append(reinterpret_cast<const char*>(&h), sizeof h);
+    out += nibbles;
+    for (const auto &s : sections) out += s;
+}
+
+
+bool decodeSegmentBlock(const uint8_t* block, size_t bytes, LedgerRecord* out, int version) {
+    SegmentBlockHeader h;
+    if (bytes < sizeof h) return false;
+    std::memcpy(&h, block, sizeof h);
+
+    const size_t nibbleBytes = (static_cast<size_t>(h.records) + 1) / 2;
+    uint64_t expected = nibbleBytes;
+    for (int s = 0; s < SEC_COUNT; s++) expected += h.sectionBytes[s];
+    if (expected != h.payloadBytes || sizeof h + expected > bytes) return false;
+
+    const uint8_t* nibbles = block + sizeof h;
+    const uint8_t* p[SEC_COUNT];
+    const uint8_t* end[SEC_COUNT];
+    const uint8_t* cursor = nibbles + nibbleBytes;
+    for (int s = 0; s < SEC_COUNT; s++) {
+        p[s] = cursor;
+        cursor += h.sectionBytes[s];
+        end[s] = cursor;
+    }
+
+    const uint8_t typeMask = version >= 2 ? 7 : 3;
+    const uint8_t targetBit = version >= 2 ? 8 : 4;
+    int64_t ts = h.baseTimestamp;
+    uint64_t v;
+    for (uint32_t i = 0; i < h.records; i++) {
+        uint8_t code = (nibbles[i / 2] >> ((i & 1) * 4)) & 0xF;
+        LedgerRecord &r = out[i];
+        std::memset(r.reserved, 0, sizeof r.reserved);
+        r.type = code & typeMask;
+
+        if (!getVarint(p[SEC_TIMESTAMPS], end[SEC_TIMESTAMPS], v)) return false;
+        ts += unzigzag(v);
+        r.timestamp = ts;
+        if (!getVarint(p[SEC_ACCOUNTS], end[SEC_ACCOUNTS], v)) return false;
+        r.accNo = static_cast<int32_t>(unzigzag(v));
+        r.targetAcc = 0;
+        if (code & targetBit) {
+            if (!getVarint(p[SEC_TARGETS], end[SEC_TARGETS], v)) return false;
+            r.targetAcc = static_cast<int32_t>(unzigzag(v));
+        }
+        if (!getMoney(p[SEC_AMOUNTS], end[SEC_AMOUNTS], r.amount) ||
+            !getMoney(p[SEC_BALANCES], end[SEC_BALANCES], r.balanceAfter)) return false;
+    }
+
+    for (int s = 0; s < SEC_COUNT; s++)
+        if (p[s] != end[s]) return false;
+    return true;
+}
+
+
+SegmentWriter::~SegmentWriter() {
+    if (file) std::fclose(file);
+}
+
+
+bool SegmentWriter::open(const std::string &target) {
+    path = target;
+    file = std::fopen((path + ".tmp").c_str(), "wb");
+    if (!file) {
+        error = "cannot write " + path + ".tmp: " + std::strerror(errno);
+        return false;
+    }
+    offset = 0;
+    records = 0;
+    pending.clear();
+    index.clear();
+    if (std::fwrite(SEGMENT_MAGIC, 1, sizeof SEGMENT_MAGIC, file) != sizeof SEGMENT_MAGIC) {
+        error = "write failed for " + path;
+        return false;
+    }
+    offset = sizeof SEGMENT_MAGIC;
+    pending.reserve(SEGMENT_BLOCK_RECORDS);
+    return true;
+}
+
+
+bool SegmentWriter::append(const LedgerRecord &r) {
+    pending.push_back(r);
+    records++;
+    return pending.size() < SEGMENT_BLOCK_RECORDS || flushBlock();
+}
+
+
+bool SegmentWriter::flushBlock() {
+    if (pending.empty()) return true;
+    encoded.clear();
+    encodeSegmentBlock(pending.data(), pending.size(), encoded);
+
+    SegmentBlockInfo info{};
+    info.offset = offset;
+    info.records = static_cast<uint32_t>(pending.size());
+    info.bytes = static_cast<uint32_t>(encoded.size());
+    info.minTimestamp = info.maxTimestamp = pending[0].timestamp;
+    for (const auto &r : pending) {
+        info.minTimestamp = std::min<int64_t>(info.minTimestamp, r.timestamp);
+        info.maxTimestamp = std::max<int64_t>(info.maxTimestamp, r.timestamp);
+    }
+
+    if (std::fwrite(encoded.data(), 1, encoded.size(), file) != encoded.size()) {
+        error = "write failed for " + path;
+        return false;
+    }
+    offset += encoded.size();
+    index.push_back(info);
+    pending.clear();
+    return true;
+}
+
+
+// The segment is written to "<path>.tmp" and renamed into place once it is
+// durable, so a reader never sees a segment without its footer.
+bool SegmentWriter::seal() {
+    if (!file || !flushBlock()) return false;
+
+    SegmentFooter footer{};
+    footer.indexOffset = offset;
+    footer.records = records;
+    footer.blockCount = static_cast<uint32_t>(index.size());
+    footer.blockRecords = static_cast<uint32_t>(SEGMENT_BLOCK_RECORDS);
+    std::memcpy(footer.magic, SEGMENT_MAGIC, sizeof footer.magic);
+
+    size_t indexBytes = index.size() * sizeof(SegmentBlockInfo);
+    bool ok = std::fwrite(index.data(), 1, indexBytes, file) == indexBytes &&
+              std::fwrite(&footer, 1, sizeof footer, file) == sizeof footer &&
+              std::fflush(file) == 0 && syncFd(fileno(file));
+    ok = std::fclose(file) == 0 && ok;
+    file = nullptr;
+    if (!ok || std::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+        error = "failed to seal " + path;
+        return false;
+    }
+    return true;
+}
+
+
+SegmentReader::~SegmentReader() {
+    close();
+}
+
+
+bool SegmentReader::open(const std::string &path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size < sizeof SEGMENT_MAGIC + sizeof(SegmentFooter)) {
+        error = path + " is too short to be a segment";
+        close();
+        return false;
+    }
+
+    void* m = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        error = "cannot map " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    base = static_cast<const uint8_t*>(m);
+    mappedBytes = size;
+
+    SegmentFooter footer;
+    std::memcpy(&footer, base + size - sizeof footer, sizeof footer);
+    uint64_t indexBytes = static_cast<uint64_t>(footer.blockCount) * sizeof(SegmentBlockInfo);
+    version = std::memcmp(base, SEGMENT_MAGIC_V1, sizeof SEGMENT_MAGIC_V1) == 0 ? 1 : SEGMENT_VERSION;
+    const char* magic = version == 1 ? SEGMENT_MAGIC_V1 : SEGMENT_MAGIC;
+    if (std::memcmp(base, magic, sizeof SEGMENT_MAGIC) != 0 ||
+        std::memcmp(footer.magic, magic, sizeof SEGMENT_MAGIC) != 0 ||
+        footer.indexOffset + indexBytes + sizeof footer != size) {
+        error = path + " is not a sealed segment";
+        close();
+        return false;
+    }
+
+    index.resize(footer.blockCount);
+    std::memcpy(index.data(), base + footer.indexOffset, indexBytes);
+    for (const auto &b : index) {
+        if (b.offset + b.bytes > footer.indexOffset) {
+            error = path + " has a corrupt block index";
+            close();
+            return false;
+        }
+    }
+    totalRecords = footer.records;
+    return true;
+}
+
+
+void SegmentReader::close() {
+    if (base) ::munmap(const_cast<uint8_t*>(base), mappedBytes);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    base = nullptr;
+    mappedBytes = 0;
+    version = SEGMENT_VERSION;
+    totalRecords = 0;
+    index.clear();
+}
+
+
+bool SegmentReader::readBlock(size_t i, std::vector<LedgerRecord> &out) const {
+    const SegmentBlockInfo &b = index[i];
+    out.resize(b.records);
+    return decodeSegmentBlock(base + b.offset, b.bytes, out.data(), version);
+}
+
+
+bool sealLedgerSegment(const std::string &binaryPath, const std::string &segmentPath, std::string* error) {
+    MappedLedger ledger;
+    SegmentWriter writer;
+    if (!ledger.open(binaryPath)) {
+        if (error) *error = ledger.lastError();
+        return false;
+    }
+    if (!writer.open(segmentPath)) {
+        if (error) *error = writer.lastError();
+        return false;
+    }
+    for (const LedgerRecord &r : ledger) {
+        if (!writer.append(r)) {
+            if (error) *error = writer.lastError();
+            return false;
+        }
+    }
+    if (!writer.seal()) {
+        if (error) *error = writer.lastError();
+        return false;
+    }
+    return true;
+}
+
+
+bool unsealLedgerSegment(const std::string &segmentPath, const std::string &binaryPath, std::string* error) {
+    SegmentReader reader;
+    if (!reader.open(segmentPath)) {
+        if (error) *error = reader.lastError();
+        return false;
+    }
+    std::FILE* out = std::fopen(binaryPath.c_str(), "wb");
+    if (!out) {
+        if (error) *error = "cannot write " + binaryPath;
+        return false;
+    }
+    std::vector<LedgerRecord> buf;
+    bool ok = true;
+    for (size_t i = 0; ok && i < reader.blockCount(); i++) {
+        ok = reader.readBlock(i, buf) &&
+             std::fwrite(buf.data(), sizeof(LedgerRecord), buf.size(), out) == buf.size();
+    }
+    ok = ok && std::fflush(out) == 0 && syncFd(fileno(out));
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok && error) *error = "failed to decode " + segmentPath + " into " + binaryPath;
+    return ok;
+}
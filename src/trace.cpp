@@ -0,0 +1,163 @@
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+
+
+std::atomic<bool> Trace::recording{false};
+
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<TraceRing>> rings;
+static std::atomic<uint64_t> startedAt{0};
+static std::atomic<size_t> ringSpans{Trace::DEFAULT_SPANS};
+
+static thread_local TraceRing* ownRing = nullptr;
+static thread_local const char* ownName = nullptr;
+
+
+uint64_t Trace::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+void Trace::start(size_t spansPerThread) {
+    ringSpans.store(std::max<size_t>(spansPerThread, 1), std::memory_order_relaxed);
+    startedAt.store(now(), std::memory_order_relaxed);
+    recording.store(true, std::memory_order_relaxed);
+}
+
+
+void Trace::stop() {
+    recording.store(false, std::memory_order_relaxed);
+}
+
+
+TraceRing& Trace::local() {
+    if (!ownRing) {
+        auto owned = std::make_unique<TraceRing>(ringSpans.load(std::memory_order_relaxed));
+        ownRing = owned.get();
+        ownRing->threadName.store(ownName, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        ownRing->tid = static_cast<uint32_t>(rings.size() + 1);
+        rings.push_back(std::move(owned));
+    }
+    return *ownRing;
+}
+
+
+// Threads are usually named before tracing starts, so the name waits for
+// the thread's first span to get a ring.
+void Trace::nameThread(const char* name) {
+    ownName = name;
+    if (ownRing) ownRing->threadName.store(name, std::memory_order_relaxed);
+}
+
+
+void Trace::record(const char* name, const char* category, uint64_t startNs, uint64_t endNs) {
+    TraceRing &r = local();
+    uint64_t n = r.written.load(std::memory_order_relaxed);
+    TraceEvent &e = r.events[n % r.capacity];
+    e.name.store(name, std::memory_order_relaxed);
+    e.category.store(category, std::memory_order_relaxed);
+    e.startNs.store(startNs, std::memory_order_relaxed);
+    e.durationNs.store(endNs - startNs, std::memory_order_relaxed);
+    r.written.store(n + 1, std::memory_order_release);
+}
+
+
+static void appendString(std::ostringstream &out, const char* s) {
+    out << '"';
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\') out << '\\';
+        out << *s;
+    }
+    out << '"';
+}
+
+
+// Trace-event timestamps are microseconds; ours keep their nanoseconds as
+// three decimals.
+static void appendMicros(std::ostringstream &out, uint64_t ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu.%03u", static_cast<unsigned long long>(ns / 1000),
+             static_cast<unsigned>(ns % 1000));
+    out << buf;
+}
+
+
+struct Span {
+    const char* name;
+    const char* category;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+
+std::string Trace::chromeJson() {
+    const uint64_t since = startedAt.load(std::memory_order_relaxed);
+    const long pid = static_cast<long>(getpid());
+    std::ostringstream out;
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    uint64_t dropped = 0;
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (const auto &ring : rings) {
+        const TraceRing &r = *ring;
+        if (const char* name = r.threadName.load(std::memory_order_relaxed)) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                << ",\"tid\":" << r.tid << ",\"args\":{\"name\":";
+            appendString(out, name);
+            out << "}}";
+            first = false;
+        }
+
+        // Copy what the ring holds, then keep only the slots the writer
+        // cannot have reached while we were copying.
+        const uint64_t end = r.written.load(std::memory_order_acquire);
+        const uint64_t begin = end > r.capacity ? end - r.capacity : 0;
+        std::vector<Span> copy;
+        copy.reserve(end - begin);
+        for (uint64_t i = begin; i < end; i++) {
+            const TraceEvent &e = r.events[i % r.capacity];
+            copy.push_back({e.name.load(std::memory_order_relaxed), e.category.load(std::memory_order_relaxed),
+                            e.startNs.load(std::memory_order_relaxed), e.durationNs.load(std::memory_order_relaxed)});
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t after = r.written.load(std::memory_order_relaxed);
+        const uint64_t safe = after >= r.capacity ? after - r.capacity + 1 : 0;
+        dropped += begin;
+
+        for (uint64_t i = std::max(begin, safe); i < end; i++) {
+            const Span &c = copy[i - begin];
+            if (c.startNs < since) continue;
+            out << (first ? "\n" : ",\n") << "{\"name\":";
+            appendString(out, c.name);
+            out << ",\"cat\":";
+            appendString(out, c.category);
+            out << ",\"ph\":\"X\",\"ts\":";
+            appendMicros(out, c.startNs - since);
+            out << ",\"dur\":";
+            appendMicros(out, c.durationNs);
+            out << ",\"pid\":" << pid << ",\"tid\":" << r.tid << "}";
+            first = false;
+        }
+        if (safe > begin) dropped += std::min(safe, end) - begin;
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"overwritten_spans\":" << dropped << "}}\n";
+    return out.str();
+}
+
+
+bool Trace::writeChromeJson(const std::string &path) {
+    std::ofstream file(path, std::ios::trunc);
+    file << chromeJson();
+    file.close();
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,64 @@
+#include "warmup.h"
+#include <algorithm>
+
+
+AccountWarmer::~AccountWarmer() {
+    stop();
+}
+
+
+void AccountWarmer::start(std::vector<int> accNos, size_t batch) {
+    launch([accNos = std::move(accNos)]() { return accNos; }, batch);
+}
+
+
+void AccountWarmer::start(const LedgerHistory &history, size_t accounts, size_t batch) {
+    launch([&history, accounts]() {
+        std::vector<int> recent;
+        history.recentAccounts(accounts, recent);
+        return recent;
+    }, batch);
+}
+
+
+void AccountWarmer::launch(std::function<std::vector<int>()> pick, size_t batch) {
+    stop();
+    cancel.store(false);
+    finished.store(false);
+    count.store(0);
+    begin = std::chrono::steady_clock::now();
+    worker = std::thread([this, pick = std::move(pick), batch]() {
+        const std::vector<int> accNos = pick();
+        size_t i = 0;
+        bool room = true;
+        while (room && i < accNos.size() && !cancel.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(bankMutex);
+            for (size_t end = std::min(accNos.size(), i + batch); i < end; i++) {
+                if (!bank.prefetchAccount(accNos[i])) {
+                    room = false;
+                    break;
+                }
+                count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        elapsed = std::chrono::steady_clock::now() - begin;
+        finished.store(true, std::memory_order_release);
+    });
+}
+
+
+void AccountWarmer::wait() {
+    if (worker.joinable()) worker.join();
+}
+
+
+void AccountWarmer::stop() {
+    cancel.store(true);
+    wait();
+}
+
+
+double AccountWarmer::seconds() const {
+    if (!done()) return 0.0;
+    return std::chrono::duration<double>(elapsed).count();
+}